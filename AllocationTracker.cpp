@@ -0,0 +1,113 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include "AllocationTracker.h"
+
+#ifdef HAND_TO_CONTROLLER_TRACK_ALLOCATIONS
+
+namespace {
+    thread_local uint64_t threadAllocationCount = 0;
+
+    void* TrackedAllocate(
+        size_t size,
+        size_t alignment = 0)
+    {
+        threadAllocationCount++;
+
+        if (size == 0)
+        {
+            size = 1;
+        }
+        void* const ptr = alignment ? _aligned_malloc(size, alignment) : malloc(size);
+        if (!ptr)
+        {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+}
+
+namespace AllocationTracker {
+    uint64_t GetThreadAllocationCount()
+    {
+        return threadAllocationCount;
+    }
+}
+
+// The nothrow variants forward to these by default.
+void* operator new(size_t size)
+{
+    return TrackedAllocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return TrackedAllocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return TrackedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return TrackedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    _aligned_free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+    _aligned_free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept
+{
+    _aligned_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept
+{
+    _aligned_free(ptr);
+}
+
+#endif
@@ -0,0 +1,35 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pch.h"
+
+// Debugging aid to verify that the frame hooks do not allocate once warmed up.
+//
+// Build with HAND_TO_CONTROLLER_TRACK_ALLOCATIONS defined to replace the global operator new of the layer with one
+// that counts the heap allocations made by each thread. Only the allocations from the layer's own code are counted,
+// not those made by the runtime or the D3D driver. A frame hook that allocates once warmed up logs the allocations and
+// breaks into the debugger, or crashes the application when no debugger is attached.
+#ifdef HAND_TO_CONTROLLER_TRACK_ALLOCATIONS
+namespace AllocationTracker {
+    // The number of frames to let go by before any allocation in the frame hooks is a failure.
+    constexpr uint64_t WarmupFrames = 100;
+
+    // The number of heap allocations made so far by the calling thread.
+    uint64_t GetThreadAllocationCount();
+}
+#endif
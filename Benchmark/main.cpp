@@ -0,0 +1,341 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Micro-benchmarks for the hot paths of the layer, built from the same sources but without an OpenXR runtime. Use the
+// Release configuration for meaningful results.
+//
+// Usage: Benchmark
+
+#include "pch.h"
+
+#include <cstdio>
+
+#include "GestureKernels.h"
+#include "HandFeatures.h"
+#include "HandRenderer.h"
+#include "InterceptedCalls.h"
+
+namespace {
+
+    // Time a function, in nanoseconds per call.
+    template <typename Function>
+    double Measure(
+        const uint32_t iterations,
+        Function&& function)
+    {
+        LARGE_INTEGER frequency, start, end;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&start);
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            function(i);
+        }
+        QueryPerformanceCounter(&end);
+
+        return (end.QuadPart - start.QuadPart) * 1e9 / (frequency.QuadPart * static_cast<double>(iterations));
+    }
+
+    // The action values recorded by the gestures.
+    float actionsValue[2 * GestureBitsCount];
+
+    struct BenchmarkRecorder
+    {
+        static void Record(
+            const float value,
+            const int valueSlot,
+            const int clickSlot)
+        {
+            actionsValue[valueSlot] = value;
+            if (clickSlot >= 0)
+            {
+                actionsValue[clickSlot] = value;
+            }
+        }
+    };
+
+    using GenericGestureKernel = void (*)(const HandFeatures& features, int side, const BuiltinGestures& gestures, uint32_t mask);
+
+    // A pair of open hands facing each other, with some spread between the joints.
+    void MakeHands(
+        HandJointsSnapshot hands[2])
+    {
+        for (int side = 0; side <= 1; side++)
+        {
+            HandJointsSnapshot& hand = hands[side];
+            hand.result = XR_SUCCESS;
+            for (uint32_t i = 0; i < XR_HAND_JOINT_COUNT_EXT; i++)
+            {
+                XrHandJointLocationEXT& joint = hand.jointLocations[i];
+                joint.locationFlags = XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_VALID_BIT;
+                joint.pose.orientation = { 0.f, 0.f, 0.f, 1.f };
+                joint.pose.position = { (side ? 0.1f : -0.1f) + 0.004f * (i % 5), 0.01f * (i / 5), -0.3f };
+                joint.radius = 0.01f;
+            }
+        }
+    }
+
+    // Compare the specialized gesture kernels with the generic evaluation testing the mask at runtime, for a few
+    // typical combinations of gestures.
+    void BenchmarkGestures()
+    {
+        constexpr uint32_t Iterations = 10000000;
+
+        HandJointsSnapshot hands[2];
+        MakeHands(hands);
+        const HandJointsSnapshot* const handsPointers[2] = { &hands[0], &hands[1] };
+
+        HandFeatures features;
+        const auto addGesture = [&](BuiltinGesture& gesture, int& slot, int joint1, int joint2, bool isTwoHanded) {
+            gesture = { joint1 >= 0 ? features.AddDistance(joint1, joint2, isTwoHanded) : -1, 0.01f, 0.05f, slot++, -1 };
+        };
+
+        BuiltinGestures gestures[2];
+        int slot = 0;
+        for (int side = 0; side <= 1; side++)
+        {
+            addGesture(gestures[side].pinch, slot, XR_HAND_JOINT_THUMB_TIP_EXT, XR_HAND_JOINT_INDEX_TIP_EXT, false);
+            addGesture(gestures[side].thumbPress, slot, XR_HAND_JOINT_INDEX_INTERMEDIATE_EXT, XR_HAND_JOINT_THUMB_TIP_EXT, false);
+            addGesture(gestures[side].indexBend, slot, XR_HAND_JOINT_INDEX_PROXIMAL_EXT, XR_HAND_JOINT_INDEX_TIP_EXT, false);
+            addGesture(gestures[side].fingerGun, slot, XR_HAND_JOINT_THUMB_TIP_EXT, XR_HAND_JOINT_MIDDLE_INTERMEDIATE_EXT, false);
+            addGesture(gestures[side].squeeze, slot, -1, -1, false);
+            addGesture(gestures[side].palmTap, slot, XR_HAND_JOINT_PALM_EXT, XR_HAND_JOINT_INDEX_TIP_EXT, true);
+            addGesture(gestures[side].wristTap, slot, XR_HAND_JOINT_WRIST_EXT, XR_HAND_JOINT_INDEX_TIP_EXT, true);
+            addGesture(gestures[side].indexTipTap, slot, XR_HAND_JOINT_INDEX_TIP_EXT, XR_HAND_JOINT_INDEX_TIP_EXT, true);
+            addGesture(gestures[side].custom1, slot, XR_HAND_JOINT_MIDDLE_TIP_EXT, XR_HAND_JOINT_RING_TIP_EXT, false);
+        }
+        features.Update(handsPointers);
+
+        const struct
+        {
+            const char* name;
+            uint32_t mask;
+        } combinations[] = {
+            { "pinch", PinchBit },
+            { "pinch+squeeze", PinchBit | SqueezeBit },
+            { "one-handed", PinchBit | ThumbPressBit | IndexBendBit | FingerGunBit | Custom1Bit | SqueezeBit },
+            { "all", (1u << GestureBitsCount) - 1 },
+        };
+
+        for (const auto& combination : combinations)
+        {
+            // Read through a volatile so that the compiler cannot specialize the generic path for a known mask.
+            volatile uint32_t runtimeMask = combination.mask;
+            const uint32_t mask = runtimeMask;
+
+            // Both evaluations are called through a function pointer, as the layer calls the kernels, so that neither is
+            // inlined into the loop.
+            const GestureKernel<BenchmarkRecorder> kernel = SelectGestureKernel<BenchmarkRecorder>(mask);
+            const double specializedTime = Measure(Iterations, [&](const uint32_t i) {
+                const int side = i & 1;
+                kernel(features, side, gestures[side]);
+            });
+            volatile GenericGestureKernel runtimeGeneric = &EvaluateGestures<BenchmarkRecorder, uint32_t>;
+            const GenericGestureKernel generic = runtimeGeneric;
+            const double genericTime = Measure(Iterations, [&](const uint32_t i) {
+                const int side = i & 1;
+                generic(features, side, gestures[side], mask);
+            });
+
+            printf("Gestures evaluation (%s): specialized %.1f ns, generic %.1f ns\n", combination.name, specializedTime, genericTime);
+        }
+    }
+
+    // The OpenXR 1.0 core functions, as resolved by an engine during its startup.
+    const char* const CoreFunctionNames[] = {
+        "xrGetInstanceProcAddr", "xrEnumerateApiLayerProperties", "xrEnumerateInstanceExtensionProperties",
+        "xrCreateInstance", "xrDestroyInstance", "xrGetInstanceProperties", "xrPollEvent", "xrResultToString",
+        "xrStructureTypeToString", "xrGetSystem", "xrGetSystemProperties", "xrEnumerateEnvironmentBlendModes",
+        "xrCreateSession", "xrDestroySession", "xrEnumerateReferenceSpaces", "xrCreateReferenceSpace",
+        "xrGetReferenceSpaceBoundsRect", "xrCreateActionSpace", "xrLocateSpace", "xrDestroySpace",
+        "xrEnumerateViewConfigurations", "xrGetViewConfigurationProperties", "xrEnumerateViewConfigurationViews",
+        "xrEnumerateSwapchainFormats", "xrCreateSwapchain", "xrDestroySwapchain", "xrEnumerateSwapchainImages",
+        "xrAcquireSwapchainImage", "xrWaitSwapchainImage", "xrReleaseSwapchainImage", "xrBeginSession",
+        "xrEndSession", "xrRequestExitSession", "xrWaitFrame", "xrBeginFrame", "xrEndFrame", "xrLocateViews",
+        "xrStringToPath", "xrPathToString", "xrCreateActionSet", "xrDestroyActionSet", "xrCreateAction",
+        "xrDestroyAction", "xrSuggestInteractionProfileBindings", "xrAttachSessionActionSets",
+        "xrGetCurrentInteractionProfile", "xrGetActionStateBoolean", "xrGetActionStateFloat",
+        "xrGetActionStateVector2f", "xrGetActionStatePose", "xrSyncActions", "xrEnumerateBoundSourcesForAction",
+        "xrGetInputSourceLocalizedName", "xrApplyHapticFeedback", "xrStopHapticFeedback"
+    };
+
+    // The lookup that the perfect hash replaced: the name is copied to a std::string and compared with each call.
+    int FindInterceptedCallLinear(const char* const name)
+    {
+        const std::string apiName(name);
+        for (size_t i = 0; i < std::size(InterceptedCallNames); i++)
+        {
+            if (apiName == InterceptedCallNames[i])
+            {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // Compare the lookups of xrGetInstanceProcAddr() when resolving all the core functions. The rest of the chain is
+    // not included, since there is no runtime.
+    void BenchmarkGetInstanceProcAddr()
+    {
+        constexpr uint32_t FunctionsCount = static_cast<uint32_t>(std::size(CoreFunctionNames));
+        constexpr uint32_t Iterations = 100000 * FunctionsCount;
+
+        uint32_t interceptedCount = 0;
+        for (const char* name : CoreFunctionNames)
+        {
+            const int index = FindInterceptedCall(name);
+            if (index != FindInterceptedCallLinear(name))
+            {
+                printf("Mismatched lookup for %s\n", name);
+            }
+            interceptedCount += index >= 0 ? 1 : 0;
+        }
+
+        volatile int sink = 0;
+        const double perfectHashTime = Measure(Iterations, [&](const uint32_t i) {
+            sink = FindInterceptedCall(CoreFunctionNames[i % FunctionsCount]);
+        });
+        const double linearTime = Measure(Iterations, [&](const uint32_t i) {
+            sink = FindInterceptedCallLinear(CoreFunctionNames[i % FunctionsCount]);
+        });
+
+        printf("xrGetInstanceProcAddr lookup: perfect hash %.1f ns, linear %.1f ns (%u functions, %u intercepted)\n",
+            perfectHashTime, linearTime, FunctionsCount, interceptedCount);
+    }
+
+    // Compare the CPU time to render the hands with each of the pipeline state isolation modes, which is what they add to
+    // xrEndFrame(). The GPU is drained between the frames, outside of the measurement.
+    void BenchmarkRendering()
+    {
+        constexpr uint32_t WarmupFrames = 10;
+        constexpr uint32_t Frames = 1000;
+        constexpr int32_t ImageSize = 1024;
+
+        ComPtr<ID3D11Device> device;
+        ComPtr<ID3D11DeviceContext> context;
+        const D3D_FEATURE_LEVEL featureLevel = D3D_FEATURE_LEVEL_11_0;
+        if (FAILED(D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, &featureLevel, 1, D3D11_SDK_VERSION,
+                device.GetAddressOf(), nullptr, context.GetAddressOf())))
+        {
+            printf("Hands rendering: could not create a D3D11 device\n");
+            return;
+        }
+
+        // One color and depth image per eye, like an application without VPRT.
+        ComPtr<ID3D11RenderTargetView> rtvs[2];
+        ComPtr<ID3D11DepthStencilView> dsvs[2];
+        for (int eye = 0; eye <= 1; eye++)
+        {
+            D3D11_TEXTURE2D_DESC desc{};
+            desc.Width = desc.Height = ImageSize;
+            desc.MipLevels = desc.ArraySize = 1;
+            desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+            desc.SampleDesc.Count = 1;
+            desc.Usage = D3D11_USAGE_DEFAULT;
+            desc.BindFlags = D3D11_BIND_RENDER_TARGET;
+
+            ComPtr<ID3D11Texture2D> color;
+            CHECK_HRCMD(device->CreateTexture2D(&desc, nullptr, color.GetAddressOf()));
+            CHECK_HRCMD(device->CreateRenderTargetView(color.Get(), nullptr, rtvs[eye].GetAddressOf()));
+
+            desc.Format = DXGI_FORMAT_D32_FLOAT;
+            desc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+
+            ComPtr<ID3D11Texture2D> depth;
+            CHECK_HRCMD(device->CreateTexture2D(&desc, nullptr, depth.GetAddressOf()));
+            CHECK_HRCMD(device->CreateDepthStencilView(depth.Get(), nullptr, dsvs[eye].GetAddressOf()));
+        }
+        ID3D11RenderTargetView* const rtv[2] = { rtvs[0].Get(), rtvs[1].Get() };
+        ID3D11DepthStencilView* const dsv[2] = { dsvs[0].Get(), dsvs[1].Get() };
+        const XrRect2Di imageRect{ { 0, 0 }, { ImageSize, ImageSize } };
+
+        D3D11_QUERY_DESC queryDesc{};
+        queryDesc.Query = D3D11_QUERY_EVENT;
+        ComPtr<ID3D11Query> frameDone;
+        CHECK_HRCMD(device->CreateQuery(&queryDesc, frameDone.GetAddressOf()));
+
+        HandRenderer renderer;
+        renderer.SetDevice(device);
+        while (!renderer.IsReady())
+        {
+            if (const char* error = renderer.GetInitializationError())
+            {
+                printf("Hands rendering: %s\n", error);
+                return;
+            }
+            Sleep(1);
+        }
+
+        HandJointsSnapshot hands[2];
+        MakeHands(hands);
+        const HandJointsSnapshot* const handsPointers[2] = { &hands[0], &hands[1] };
+
+        const XrPosef eyePoses[2] = { { { 0.f, 0.f, 0.f, 1.f }, { -0.032f, 0.f, 0.f } }, { { 0.f, 0.f, 0.f, 1.f }, { 0.032f, 0.f, 0.f } } };
+        const XrFovf fovs[2] = { { -0.8f, 0.8f, 0.8f, -0.8f }, { -0.8f, 0.8f, 0.8f, -0.8f } };
+
+        renderer.SetProperties(1, 1.f);
+        renderer.SetEyePoses(eyePoses, fovs);
+        renderer.SetJointsLocations(handsPointers);
+
+        const struct
+        {
+            const char* name;
+            HandRenderer::Isolation isolation;
+        } modes[] = {
+            { "deferred context", HandRenderer::Isolation::DeferredContext },
+            { "state object", HandRenderer::Isolation::StateObject },
+            { "save/restore", HandRenderer::Isolation::SaveRestore },
+        };
+
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        for (const auto& mode : modes)
+        {
+            renderer.SetIsolation(mode.isolation);
+
+            LONGLONG ticks = 0;
+            for (uint32_t i = 0; i < WarmupFrames + Frames; i++)
+            {
+                LARGE_INTEGER start, end;
+                QueryPerformanceCounter(&start);
+                renderer.RenderHands(rtv, dsv, imageRect, false /* isVPRT */, true /* clearDepthBuffer */, 0.1f, 20.f);
+                QueryPerformanceCounter(&end);
+                if (i >= WarmupFrames)
+                {
+                    ticks += end.QuadPart - start.QuadPart;
+                }
+
+                context->End(frameDone.Get());
+                while (context->GetData(frameDone.Get(), nullptr, 0, 0) == S_FALSE)
+                {
+                }
+            }
+
+            printf("Hands rendering (%s): %.1f us (%u frames)\n", mode.name, ticks * 1e6 / (frequency.QuadPart * static_cast<double>(Frames)), Frames);
+        }
+
+        renderer.SetDevice(nullptr);
+    }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    BenchmarkGestures();
+    BenchmarkGetInstanceProcAddr();
+    BenchmarkRendering();
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pch.h"
+
+// The description of the configuration options, shared by the configuration files, the live updates, the dump to the
+// log and the defaults.
+namespace ConfigSchema
+{
+    enum class Type
+    {
+        Bool = 0,
+        Int,
+        Float,
+        String,
+
+        // 3 floats separated by spaces, into an XrVector3f.
+        Vector3,
+
+        // 4 floats separated by spaces, into an XrQuaternionf.
+        Quaternion,
+
+        // Accepted but not used by the layer (for the ConfigUI's own use).
+        Ignored,
+    };
+
+    template <typename Config>
+    struct Key
+    {
+        const char* name;
+        Type type;
+
+        // Returns the address of the field holding the value, of the type corresponding to Type.
+        void* (*field)(Config& config);
+
+        // The default value, in the same format as the configuration files.
+        const char* defaultValue;
+
+        // The valid range, for Int and Float.
+        float minValue = -FLT_MAX;
+        float maxValue = FLT_MAX;
+    };
+
+    // FNV-1a.
+    constexpr uint32_t Hash(std::string_view name)
+    {
+        uint32_t hash = 2166136261u;
+        for (const char c : name)
+        {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        return hash;
+    }
+
+    constexpr uint32_t Mix(uint32_t hash, uint32_t seed)
+    {
+        hash ^= seed;
+        hash ^= hash >> 16;
+        hash *= 0x85ebca6bu;
+        hash ^= hash >> 13;
+        hash *= 0xc2b2ae35u;
+        hash ^= hash >> 16;
+        return hash;
+    }
+
+    // Identifies a set of keys, to detect data that was stored for a different version of the schema.
+    template <typename Config, size_t N>
+    constexpr uint32_t Fingerprint(const Key<Config> (&keys)[N])
+    {
+        uint32_t fingerprint = 0;
+        for (size_t i = 0; i < N; i++)
+        {
+            fingerprint = Mix(fingerprint ^ Hash(keys[i].name), static_cast<uint32_t>(keys[i].type));
+        }
+        return fingerprint;
+    }
+
+    template <typename Config>
+    constexpr std::string_view NameOf(const Key<Config>& key)
+    {
+        return key.name;
+    }
+
+    constexpr std::string_view NameOf(std::string_view name)
+    {
+        return name;
+    }
+
+    // A collision-free mapping from a set of names (or the names of a set of keys) to their index, found at compile
+    // time by trying seeds until no two names land in the same slot.
+    template <uint32_t Slots>
+    struct PerfectHash
+    {
+        static_assert((Slots & (Slots - 1)) == 0, "Slots must be a power of 2");
+
+        uint32_t seed;
+
+        // The index of the key plus 1, or 0 for an empty slot.
+        uint16_t slots[Slots];
+
+        // Returns the index of the only key that may have this name, or -1 if there is none. The caller must still
+        // compare the name.
+        constexpr int Lookup(std::string_view name) const
+        {
+            return static_cast<int>(slots[Mix(Hash(name), seed) & (Slots - 1)]) - 1;
+        }
+    };
+
+    template <uint32_t Slots, typename Item, size_t N>
+    constexpr PerfectHash<Slots> MakePerfectHash(const Item (&items)[N])
+    {
+        static_assert(N < Slots, "Too many keys for the number of slots");
+
+        uint32_t hashes[N] = {};
+        for (size_t i = 0; i < N; i++)
+        {
+            hashes[i] = Hash(NameOf(items[i]));
+        }
+
+        // Each slot is marked with the seed that last used it, so that we don't have to clear the slots for each seed.
+        uint32_t usedBySeed[Slots] = {};
+        for (uint32_t seed = 1; seed < 10000; seed++)
+        {
+            bool hasCollision = false;
+            for (size_t i = 0; i < N && !hasCollision; i++)
+            {
+                const uint32_t slot = Mix(hashes[i], seed) & (Slots - 1);
+                hasCollision = usedBySeed[slot] == seed;
+                usedBySeed[slot] = seed;
+            }
+
+            if (!hasCollision)
+            {
+                PerfectHash<Slots> table{};
+                table.seed = seed;
+                for (size_t i = 0; i < N; i++)
+                {
+                    table.slots[Mix(hashes[i], seed) & (Slots - 1)] = static_cast<uint16_t>(i + 1);
+                }
+                return table;
+            }
+        }
+
+        // Not a constant expression: fails the compilation if no seed works.
+        throw std::logic_error("No perfect hash found, increase the number of slots");
+    }
+}
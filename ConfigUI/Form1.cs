@@ -92,7 +92,7 @@ namespace ConfigUI
             }
 
             // Set all the defaults.
-            // NOTE: Have to maintain parity with config::Reset() in dllmain.cpp.
+            // NOTE: Have to maintain parity with ConfigKeys in dllmain.cpp.
 
             leftXOffset.Value = 0;
             leftXOffset_Scroll(null, null);
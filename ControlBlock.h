@@ -0,0 +1,64 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// This header is shared with the ControlWriter tool, so it must not depend on pch.h.
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// The shared memory block used by a local tool to push a complete configuration to the layer.
+//
+// The block is created by the layer, with a name specific to the process, so that several applications can be tuned
+// side by side. The writer increments the sequence number before and after updating the payload (making it odd while
+// the update is in progress), then signals the update event. The reader copies the payload and retries if the sequence
+// number was odd or changed during the copy.
+namespace ControlBlock
+{
+    // 'HTCB'
+    constexpr uint32_t Magic = 0x42435448;
+
+    // Must be incremented whenever the layout below changes.
+    constexpr uint32_t Version = 1;
+
+    constexpr uint32_t MaxPayloadSize = 16384;
+
+    struct Layout
+    {
+        uint32_t magic;
+        uint32_t version;
+
+        std::atomic<uint32_t> sequence;
+
+        // The configuration, as statements in the same format as the configuration files, separated by new lines. The
+        // options that are not specified take their default value.
+        uint32_t payloadSize;
+        char payload[MaxPayloadSize];
+    };
+
+    inline std::string GetMappingName(
+        uint32_t processId)
+    {
+        return "Local\\XR_APILAYER_NOVENDOR_hand_to_controller_" + std::to_string(processId);
+    }
+
+    inline std::string GetUpdateEventName(
+        uint32_t processId)
+    {
+        return GetMappingName(processId) + "_update";
+    }
+}
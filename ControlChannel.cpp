@@ -0,0 +1,99 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include "ControlChannel.h"
+
+bool ControlChannel::Open()
+{
+    Close();
+
+    const DWORD processId = GetCurrentProcessId();
+    m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(ControlBlock::Layout),
+        ControlBlock::GetMappingName(processId).c_str());
+    if (!m_mapping)
+    {
+        return false;
+    }
+    const bool alreadyExists = GetLastError() == ERROR_ALREADY_EXISTS;
+
+    m_layout = reinterpret_cast<ControlBlock::Layout*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ControlBlock::Layout)));
+    m_updateEvent = CreateEventA(nullptr, FALSE, FALSE, ControlBlock::GetUpdateEventName(processId).c_str());
+    if (!m_layout || !m_updateEvent)
+    {
+        Close();
+        return false;
+    }
+
+    // The block outlives our instance if the application creates another one. Keep the last configuration in that case.
+    if (!alreadyExists || m_layout->magic != ControlBlock::Magic || m_layout->version != ControlBlock::Version)
+    {
+        m_layout->sequence = 0;
+        m_layout->payloadSize = 0;
+        m_layout->version = ControlBlock::Version;
+        m_layout->magic = ControlBlock::Magic;
+    }
+    m_lastSequence = 0;
+
+    return true;
+}
+
+void ControlChannel::Close()
+{
+    if (m_layout)
+    {
+        UnmapViewOfFile(m_layout);
+        m_layout = nullptr;
+    }
+    if (m_updateEvent)
+    {
+        CloseHandle(m_updateEvent);
+        m_updateEvent = nullptr;
+    }
+    if (m_mapping)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+}
+
+bool ControlChannel::Read(std::string& payload)
+{
+    if (!m_layout)
+    {
+        return false;
+    }
+
+    const uint32_t sequence = m_layout->sequence.load(std::memory_order_acquire);
+    if ((sequence & 1) || sequence == m_lastSequence)
+    {
+        return false;
+    }
+
+    const uint32_t payloadSize = min(m_layout->payloadSize, ControlBlock::MaxPayloadSize);
+    payload.assign(m_layout->payload, payloadSize);
+
+    // Discard the copy if the writer started another update in the meantime.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_layout->sequence.load(std::memory_order_relaxed) != sequence)
+    {
+        return false;
+    }
+
+    m_lastSequence = sequence;
+    return true;
+}
@@ -0,0 +1,58 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pch.h"
+
+#include "ControlBlock.h"
+
+// The layer's end of the shared memory control block (see ControlBlock.h).
+class ControlChannel
+{
+public:
+    ~ControlChannel()
+    {
+        Close();
+    }
+
+    // Create the control block for the current process.
+    bool Open();
+
+    void Close();
+
+    bool IsOpen() const
+    {
+        return m_layout != nullptr;
+    }
+
+    // The event signaled by the writer after each update.
+    HANDLE GetUpdateEvent() const
+    {
+        return m_updateEvent;
+    }
+
+    // Copy the payload if it was updated since the last read. Never blocks on the writer: returns false if an update is
+    // in progress, in which case the writer will signal the event again when done.
+    bool Read(std::string& payload);
+
+private:
+    HANDLE m_mapping{ nullptr };
+    HANDLE m_updateEvent{ nullptr };
+    ControlBlock::Layout* m_layout{ nullptr };
+
+    uint32_t m_lastSequence{ 0 };
+};
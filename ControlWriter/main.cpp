@@ -0,0 +1,114 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A minimal writer for the control block (see ControlBlock.h), to push a configuration to the layer of a running
+// application without the ConfigUI.
+//
+// Usage: ControlWriter <process id> [<config file>] [<option>=<value>...]
+//
+// The configuration file is sent first, then the options given on the command line override it. Options that are not
+// specified take their default value.
+
+#include <windows.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "ControlBlock.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <process id> [<config file>] [<option>=<value>...]\n", argv[0]);
+        return 1;
+    }
+
+    const uint32_t processId = std::stoul(argv[1]);
+
+    std::string payload;
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string argument(argv[i]);
+        if (argument.find('=') != std::string::npos)
+        {
+            payload += argument + "\n";
+        }
+        else
+        {
+            std::ifstream configFile(argument);
+            if (!configFile.is_open())
+            {
+                fprintf(stderr, "Could not open %s\n", argument.c_str());
+                return 1;
+            }
+
+            std::string line;
+            while (std::getline(configFile, line))
+            {
+                payload += line + "\n";
+            }
+        }
+    }
+
+    if (payload.size() > ControlBlock::MaxPayloadSize)
+    {
+        fprintf(stderr, "The configuration is too large (%zu bytes, up to %u bytes)\n", payload.size(), ControlBlock::MaxPayloadSize);
+        return 1;
+    }
+
+    const HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, ControlBlock::GetMappingName(processId).c_str());
+    if (!mapping)
+    {
+        fprintf(stderr, "No control block for process %u, is the layer loaded?\n", processId);
+        return 1;
+    }
+
+    auto layout = reinterpret_cast<ControlBlock::Layout*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ControlBlock::Layout)));
+    const HANDLE updateEvent = OpenEventA(EVENT_MODIFY_STATE, FALSE, ControlBlock::GetUpdateEventName(processId).c_str());
+    if (!layout || !updateEvent)
+    {
+        fprintf(stderr, "Failed to open the control block for process %u\n", processId);
+        return 1;
+    }
+
+    if (layout->magic != ControlBlock::Magic || layout->version != ControlBlock::Version)
+    {
+        fprintf(stderr, "The control block for process %u has version %u, expected version %u\n", processId, layout->version, ControlBlock::Version);
+        return 1;
+    }
+
+    // The sequence number is odd while we update the payload.
+    const uint32_t sequence = layout->sequence.load(std::memory_order_relaxed);
+    layout->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    memcpy(layout->payload, payload.data(), payload.size());
+    layout->payloadSize = static_cast<uint32_t>(payload.size());
+
+    layout->sequence.store(sequence + 2, std::memory_order_release);
+    SetEvent(updateEvent);
+
+    printf("Sent %zu bytes to process %u\n", payload.size(), processId);
+
+    CloseHandle(updateEvent);
+    UnmapViewOfFile(layout);
+    CloseHandle(mapping);
+
+    return 0;
+}
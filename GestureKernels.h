@@ -0,0 +1,194 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pch.h"
+
+#include "HandFeatures.h"
+
+// The evaluation of the built-in gestures for a hand, specialized for each combination of gestures to evaluate.
+//
+// The values are passed to Recorder::Record(value, valueSlot, clickSlot), so that the kernels can be instantiated
+// both by the layer and by the benchmark.
+
+// The gestures to evaluate for a hand. The gesture evaluation is specialized for each combination.
+enum GestureBits : uint32_t
+{
+    PinchBit = 1 << 0,
+    ThumbPressBit = 1 << 1,
+    IndexBendBit = 1 << 2,
+    FingerGunBit = 1 << 3,
+    Custom1Bit = 1 << 4,
+    SqueezeBit = 1 << 5,
+    PalmTapBit = 1 << 6,
+    WristTapBit = 1 << 7,
+    IndexTipTapBit = 1 << 8,
+
+    TwoHandedBits = PalmTapBit | WristTapBit | IndexTipTapBit,
+    GestureBitsCount = 9
+};
+
+// A built-in gesture, resolved for one hand.
+struct BuiltinGesture
+{
+    // The index returned by HandFeatures::AddDistance(). Squeeze uses the finger curls instead.
+    int distance;
+
+    float nearDistance;
+    float farDistance;
+
+    int valueSlot;
+    int clickSlot;
+};
+
+struct BuiltinGestures
+{
+    BuiltinGesture pinch;
+    BuiltinGesture thumbPress;
+    BuiltinGesture indexBend;
+    BuiltinGesture fingerGun;
+    BuiltinGesture squeeze;
+    BuiltinGesture palmTap;
+    BuiltinGesture wristTap;
+    BuiltinGesture indexTipTap;
+    BuiltinGesture custom1;
+};
+
+// Compute the scaled action value based on the distance between 2 joints.
+inline float ComputeJointActionValue(
+    const float distance,
+    const float nearDistance,
+    const float farDistance)
+{
+    if (!isnan(distance))
+    {
+        // We ignore joints radius and assume the near/far distance are configured to account for them.
+        return 1.f - (std::clamp(distance, nearDistance, farDistance) - nearDistance) / (farDistance - nearDistance);
+    }
+    return NAN;
+}
+
+// Compute an action state based on the distance between 2 joints.
+template <typename Recorder>
+void ComputeJointAction(
+    const HandFeatures& features,
+    const int side,
+    const BuiltinGesture& gesture)
+{
+    const float value = ComputeJointActionValue(features.GetDistance(side, gesture.distance), gesture.nearDistance, gesture.farDistance);
+    if (!isnan(value))
+    {
+        Recorder::Record(value, gesture.valueSlot, gesture.clickSlot);
+    }
+}
+
+// Evaluate the gestures for a hand. With a std::integral_constant mask, the tests on the mask are resolved at
+// compile-time and the evaluation is fully inlined, otherwise the mask is tested at runtime.
+template <typename Recorder, typename GestureMask>
+void EvaluateGestures(
+    const HandFeatures& features,
+    const int side,
+    const BuiltinGestures& gestures,
+    const GestureMask mask)
+{
+#define EVALUATE_ACTION(name, bit)                                                                                  \
+    if (mask & bit)                                                                                                 \
+    {                                                                                                               \
+        ComputeJointAction<Recorder>(features, side, gestures.name);                                                \
+    }
+
+    // Handle gestures made up from one hand.
+    EVALUATE_ACTION(pinch, PinchBit);
+    EVALUATE_ACTION(thumbPress, ThumbPressBit);
+    EVALUATE_ACTION(indexBend, IndexBendBit);
+    EVALUATE_ACTION(fingerGun, FingerGunBit);
+    EVALUATE_ACTION(custom1, Custom1Bit);
+
+    if (mask & SqueezeBit)
+    {
+        // Squeeze requires to look at 3 fingers.
+        const BuiltinGesture& squeezeGesture = gestures.squeeze;
+        float squeeze[3] = {
+            ComputeJointActionValue(features.GetCurl(side, HandFinger::Middle), squeezeGesture.nearDistance, squeezeGesture.farDistance),
+            ComputeJointActionValue(features.GetCurl(side, HandFinger::Ring), squeezeGesture.nearDistance, squeezeGesture.farDistance),
+            ComputeJointActionValue(features.GetCurl(side, HandFinger::Little), squeezeGesture.nearDistance, squeezeGesture.farDistance)
+        };
+
+        // Quickly bubble sort.
+        if (squeeze[0] > squeeze[1])
+        {
+            std::swap(squeeze[0], squeeze[1]);
+        }
+        if (squeeze[0] > squeeze[2])
+        {
+            std::swap(squeeze[0], squeeze[2]);
+        }
+        if (squeeze[1] > squeeze[2])
+        {
+            std::swap(squeeze[1], squeeze[2]);
+        }
+
+        // Ignore the lowest value, average the other ones.
+        const float value = (squeeze[1] + squeeze[2]) / 2.f;
+        if (!isnan(value))
+        {
+            Recorder::Record(value, squeezeGesture.valueSlot, squeezeGesture.clickSlot);
+        }
+    }
+
+    if ((mask & TwoHandedBits) && features.IsValid(side ^ 1))
+    {
+        // Handle gestures made up using both hands.
+        EVALUATE_ACTION(palmTap, PalmTapBit);
+        EVALUATE_ACTION(wristTap, WristTapBit);
+        EVALUATE_ACTION(indexTipTap, IndexTipTapBit);
+    }
+
+    // TODO: Feature: add more gesture recognition here.
+#undef EVALUATE_ACTION
+}
+
+template <typename Recorder>
+using GestureKernel = void (*)(const HandFeatures& features, int side, const BuiltinGestures& gestures);
+
+template <typename Recorder, uint32_t Mask>
+void EvaluateGesturesSpecialized(
+    const HandFeatures& features,
+    const int side,
+    const BuiltinGestures& gestures)
+{
+    EvaluateGestures<Recorder>(features, side, gestures, std::integral_constant<uint32_t, Mask>());
+}
+
+template <typename Recorder, uint32_t... Masks>
+constexpr std::array<GestureKernel<Recorder>, sizeof...(Masks)> MakeGestureKernels(
+    std::integer_sequence<uint32_t, Masks...>)
+{
+    return { &EvaluateGesturesSpecialized<Recorder, Masks>... };
+}
+
+// The specialized evaluation for a combination of GestureBits.
+template <typename Recorder>
+GestureKernel<Recorder> SelectGestureKernel(
+    const uint32_t mask)
+{
+    // One instantiation per combination of gestures.
+    static constexpr std::array<GestureKernel<Recorder>, 1u << GestureBitsCount> gestureKernels =
+        MakeGestureKernels<Recorder>(std::make_integer_sequence<uint32_t, 1u << GestureBitsCount>());
+
+    return gestureKernels[mask];
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include "GestureProgram.h"
+
+void GestureProgram::AddGesture(
+    const int* distances,
+    uint32_t count,
+    bool isTwoHanded,
+    float nearDistance,
+    float farDistance,
+    GestureReduce reduce,
+    int valueSlot,
+    int clickSlot)
+{
+    count = min(count, MaxTerms);
+    if (!count)
+    {
+        return;
+    }
+
+    if (isTwoHanded)
+    {
+        // Skip the loads, the reduce (if any) and the store.
+        Instruction requireOtherHand{ Op::RequireOtherHand };
+        requireOtherHand.count = count + (count > 1 ? 1 : 0) + 1;
+        m_instructions.push_back(requireOtherHand);
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Instruction load{ Op::Load };
+        load.index = distances[i];
+        load.farDistance = farDistance;
+        load.inverseRange = 1.f / (farDistance - nearDistance);
+        m_instructions.push_back(load);
+    }
+
+    if (count > 1)
+    {
+        Instruction reduction{ Op::Reduce };
+        reduction.count = count;
+        reduction.index = static_cast<int>(reduce);
+        m_instructions.push_back(reduction);
+    }
+
+    Instruction store{ Op::Store };
+    store.index = valueSlot;
+    store.index2 = clickSlot;
+    m_instructions.push_back(store);
+}
+
+float GestureProgram::Reduce(
+    GestureReduce reduce,
+    const float* values,
+    uint32_t count)
+{
+    float sum = 0.f;
+    float lowest = values[0];
+    float highest = values[0];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        sum += values[i];
+        lowest = min(lowest, values[i]);
+        highest = max(highest, values[i]);
+    }
+
+    // Any untracked joint invalidates the whole gesture.
+    if (isnan(sum))
+    {
+        return NAN;
+    }
+
+    switch (reduce)
+    {
+    case GestureReduce::Min:
+        return lowest;
+
+    case GestureReduce::Max:
+        return highest;
+
+    case GestureReduce::DropLowest:
+        return (sum - lowest) / (count - 1);
+
+    case GestureReduce::Average:
+    default:
+        return sum / count;
+    }
+}
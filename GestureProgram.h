@@ -0,0 +1,146 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pch.h"
+
+#include "HandFeatures.h"
+
+// How the values of the joint pairs of a gesture are combined into one action value.
+enum class GestureReduce
+{
+    Average = 0,
+    Min,
+    Max,
+
+    // Ignore the lowest value, average the other ones.
+    DropLowest,
+};
+
+// The gestures defined in the configuration for one hand, compiled into a flat sequence of instructions.
+//
+// Each gesture is compiled to one Load per joint pair (mapping the distance to [0, 1] with its near/far thresholds),
+// an optional Reduce, and a Store of the resulting value. Two-handed gestures are prefixed with a RequireOtherHand
+// that skips the gesture when the other hand is not tracked.
+class GestureProgram
+{
+public:
+    // The maximum number of joint pairs in one gesture.
+    static constexpr uint32_t MaxTerms = 8;
+
+    void Clear()
+    {
+        m_instructions.clear();
+    }
+
+    bool IsEmpty() const
+    {
+        return m_instructions.empty();
+    }
+
+    // Append a gesture. The distances are indices returned by HandFeatures::AddDistance() and the slots are passed back
+    // to the Record function of Run().
+    void AddGesture(
+        const int* distances,
+        uint32_t count,
+        bool isTwoHanded,
+        float nearDistance,
+        float farDistance,
+        GestureReduce reduce,
+        int valueSlot,
+        int clickSlot);
+
+    // Evaluate all the gestures for one hand, calling record(value, valueSlot, clickSlot) for each gesture with a
+    // valid value.
+    template <typename Record>
+    void Run(
+        const HandFeatures& features,
+        int side,
+        Record&& record) const
+    {
+        const bool isOtherHandValid = features.IsValid(side ^ 1);
+
+        float stack[MaxTerms];
+        uint32_t top = 0;
+
+        const Instruction* const end = m_instructions.data() + m_instructions.size();
+        for (const Instruction* instruction = m_instructions.data(); instruction < end; instruction++)
+        {
+            switch (instruction->op)
+            {
+            case Op::RequireOtherHand:
+                if (!isOtherHandValid)
+                {
+                    instruction += instruction->count;
+                }
+                break;
+
+            case Op::Load:
+                stack[top++] = std::clamp((instruction->farDistance - features.GetDistance(side, instruction->index)) * instruction->inverseRange, 0.f, 1.f);
+                break;
+
+            case Op::Reduce:
+                top -= instruction->count;
+                stack[top] = Reduce(static_cast<GestureReduce>(instruction->index), &stack[top], instruction->count);
+                top++;
+                break;
+
+            case Op::Store:
+                top--;
+                if (!isnan(stack[top]))
+                {
+                    record(stack[top], instruction->index, instruction->index2);
+                }
+                break;
+            }
+        }
+    }
+
+private:
+    enum class Op : uint32_t
+    {
+        RequireOtherHand,
+        Load,
+        Reduce,
+        Store,
+    };
+
+    struct Instruction
+    {
+        Op op;
+
+        // RequireOtherHand: the number of instructions to skip. Reduce: the number of values to reduce.
+        uint32_t count;
+
+        // Load: the distance index. Reduce: the GestureReduce. Store: the value slot.
+        int index;
+
+        // Store: the click slot.
+        int index2;
+
+        // Load: the mapping from distance to value, as (farDistance - distance) * inverseRange.
+        float farDistance;
+        float inverseRange;
+    };
+
+    static float Reduce(
+        GestureReduce reduce,
+        const float* values,
+        uint32_t count);
+
+    std::vector<Instruction> m_instructions;
+};
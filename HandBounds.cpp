@@ -0,0 +1,136 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "pch.h"
+
+#include "HandBounds.h"
+
+namespace HandBounds
+{
+    using namespace xr::math;
+
+    Sphere Enclose(
+        const XrVector3f* points,
+        uint32_t count,
+        float margin)
+    {
+        if (!count)
+        {
+            return { {}, -1.f };
+        }
+
+        DirectX::XMVECTOR lowest = LoadXrVector3(points[0]);
+        DirectX::XMVECTOR highest = lowest;
+        for (uint32_t i = 1; i < count; i++)
+        {
+            const DirectX::XMVECTOR point = LoadXrVector3(points[i]);
+            lowest = DirectX::XMVectorMin(lowest, point);
+            highest = DirectX::XMVectorMax(highest, point);
+        }
+
+        Sphere sphere;
+        StoreXrVector3(&sphere.center, DirectX::XMVectorScale(DirectX::XMVectorAdd(lowest, highest), 0.5f));
+        sphere.radius = 0.5f * DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(highest, lowest))) + margin;
+        return sphere;
+    }
+
+    bool Project(
+        const Sphere& sphere,
+        DirectX::FXMMATRIX viewProjection,
+        const XrRect2Di& imageRect,
+        XrRect2Di& bounds)
+    {
+        if (sphere.radius < 0.f)
+        {
+            return false;
+        }
+
+        // Project the corners of the box enclosing the sphere. The sphere is outside of the frustum if all the corners
+        // are outside of the same side plane, or behind the eye.
+        uint32_t outsideLeft = 0, outsideRight = 0, outsideBottom = 0, outsideTop = 0, behind = 0;
+        float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX;
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            const XrVector3f corner{
+                sphere.center.x + (i & 1 ? sphere.radius : -sphere.radius),
+                sphere.center.y + (i & 2 ? sphere.radius : -sphere.radius),
+                sphere.center.z + (i & 4 ? sphere.radius : -sphere.radius),
+            };
+            DirectX::XMFLOAT4 clip;
+            DirectX::XMStoreFloat4(&clip, DirectX::XMVector3Transform(LoadXrVector3(corner), viewProjection));
+
+            outsideLeft += clip.x < -clip.w;
+            outsideRight += clip.x > clip.w;
+            outsideBottom += clip.y < -clip.w;
+            outsideTop += clip.y > clip.w;
+            if (clip.w <= FLT_EPSILON)
+            {
+                behind++;
+                continue;
+            }
+
+            minX = min(minX, clip.x / clip.w);
+            maxX = max(maxX, clip.x / clip.w);
+            minY = min(minY, clip.y / clip.w);
+            maxY = max(maxY, clip.y / clip.w);
+        }
+        if (outsideLeft == 8 || outsideRight == 8 || outsideBottom == 8 || outsideTop == 8 || behind == 8)
+        {
+            return false;
+        }
+
+        // A corner behind the eye may project anywhere, assume that the sphere covers the whole image.
+        if (behind)
+        {
+            bounds = imageRect;
+            return true;
+        }
+
+        // Convert to pixels, with Y pointing down.
+        const float width = static_cast<float>(imageRect.extent.width);
+        const float height = static_cast<float>(imageRect.extent.height);
+        const int32_t left = static_cast<int32_t>(std::floor((std::clamp(minX, -1.f, 1.f) * 0.5f + 0.5f) * width));
+        const int32_t right = static_cast<int32_t>(std::ceil((std::clamp(maxX, -1.f, 1.f) * 0.5f + 0.5f) * width));
+        const int32_t top = static_cast<int32_t>(std::floor((0.5f - std::clamp(maxY, -1.f, 1.f) * 0.5f) * height));
+        const int32_t bottom = static_cast<int32_t>(std::ceil((0.5f - std::clamp(minY, -1.f, 1.f) * 0.5f) * height));
+
+        bounds.offset = { imageRect.offset.x + left, imageRect.offset.y + top };
+        bounds.extent = { right - left, bottom - top };
+        return !IsEmpty(bounds);
+    }
+
+    XrRect2Di Union(
+        const XrRect2Di& a,
+        const XrRect2Di& b)
+    {
+        if (IsEmpty(a))
+        {
+            return b;
+        }
+        if (IsEmpty(b))
+        {
+            return a;
+        }
+
+        const int32_t left = min(a.offset.x, b.offset.x);
+        const int32_t top = min(a.offset.y, b.offset.y);
+        const int32_t right = max(a.offset.x + a.extent.width, b.offset.x + b.extent.width);
+        const int32_t bottom = max(a.offset.y + a.extent.height, b.offset.y + b.extent.height);
+        return { { left, top }, { right - left, bottom - top } };
+    }
+
+} // namespace HandBounds
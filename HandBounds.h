@@ -0,0 +1,58 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include "pch.h"
+
+// Conservative bounds of the hands on screen, so that the draws can be skipped or limited to the area actually covered.
+// This is only math, with no dependency on the graphics API or the runtime.
+namespace HandBounds
+{
+    // A sphere in the space of the projection layer. A negative radius means that the sphere is empty.
+    struct Sphere
+    {
+        XrVector3f center;
+        float radius;
+    };
+
+    // The sphere enclosing the bounding box of a set of points, grown by a margin.
+    Sphere Enclose(
+        const XrVector3f* points,
+        uint32_t count,
+        float margin);
+
+    // The rectangle of the image covered by a sphere, rounded outwards and clipped to the image. The view projection
+    // transforms from the space of the sphere to clip space. Returns false when the sphere is entirely outside of the
+    // view frustum.
+    bool Project(
+        const Sphere& sphere,
+        DirectX::FXMMATRIX viewProjection,
+        const XrRect2Di& imageRect,
+        XrRect2Di& bounds);
+
+    // The smallest rectangle containing both rectangles, where a rectangle with no area is ignored.
+    XrRect2Di Union(
+        const XrRect2Di& a,
+        const XrRect2Di& b);
+
+    inline bool IsEmpty(const XrRect2Di& rect)
+    {
+        return rect.extent.width <= 0 || rect.extent.height <= 0;
+    }
+
+} // namespace HandBounds
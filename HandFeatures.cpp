@@ -0,0 +1,151 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include "HandFeatures.h"
+
+namespace {
+    using namespace xr::math;
+
+    // The joints used to measure the curl of each finger (see enum HandFinger).
+    const uint8_t FingerTips[static_cast<int>(HandFinger::Count)] = {
+        XR_HAND_JOINT_THUMB_TIP_EXT,
+        XR_HAND_JOINT_INDEX_TIP_EXT,
+        XR_HAND_JOINT_MIDDLE_TIP_EXT,
+        XR_HAND_JOINT_RING_TIP_EXT,
+        XR_HAND_JOINT_LITTLE_TIP_EXT
+    };
+    const uint8_t FingerMetacarpals[static_cast<int>(HandFinger::Count)] = {
+        XR_HAND_JOINT_THUMB_METACARPAL_EXT,
+        XR_HAND_JOINT_INDEX_METACARPAL_EXT,
+        XR_HAND_JOINT_MIDDLE_METACARPAL_EXT,
+        XR_HAND_JOINT_RING_METACARPAL_EXT,
+        XR_HAND_JOINT_LITTLE_METACARPAL_EXT
+    };
+}
+
+int HandFeatures::AddDistance(
+    int joint1,
+    int joint2,
+    bool isTwoHanded)
+{
+    if (joint1 < 0 || joint1 >= XR_HAND_JOINT_COUNT_EXT || joint2 < 0 || joint2 >= XR_HAND_JOINT_COUNT_EXT)
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < m_distancesCount; i++)
+    {
+        if (m_joint1[i] == joint1 && m_joint2[i] == joint2 && m_isTwoHanded[i] == isTwoHanded)
+        {
+            return i;
+        }
+    }
+
+    if (m_distancesCount == MaxDistances)
+    {
+        return -1;
+    }
+
+    m_joint1[m_distancesCount] = joint1;
+    m_joint2[m_distancesCount] = joint2;
+    m_isTwoHanded[m_distancesCount] = isTwoHanded;
+    return m_distancesCount++;
+}
+
+void HandFeatures::ClearDistances()
+{
+    for (uint32_t i = 0; i < MaxDistances; i++)
+    {
+        m_joint1[i] = m_joint2[i] = XR_HAND_JOINT_PALM_EXT;
+        m_isTwoHanded[i] = false;
+    }
+
+    // The finger curls always come first, so their index is the finger.
+    m_distancesCount = 0;
+    for (int finger = 0; finger < static_cast<int>(HandFinger::Count); finger++)
+    {
+        AddDistance(FingerTips[finger], FingerMetacarpals[finger], false);
+    }
+}
+
+void HandFeatures::Update(const HandJointsSnapshot* const hands[2])
+{
+    for (int side = 0; side < 2; side++)
+    {
+        Hand& hand = m_hands[side];
+        hand.isValid = hands[side] && hands[side]->result == XR_SUCCESS;
+
+        // Convert to structure-of-arrays.
+        for (uint32_t i = 0; i < JointsStride; i++)
+        {
+            if (hand.isValid && i < XR_HAND_JOINT_COUNT_EXT && Pose::IsPoseValid(hands[side]->jointLocations[i].locationFlags))
+            {
+                const XrVector3f& position = hands[side]->jointLocations[i].pose.position;
+                hand.x[i] = position.x;
+                hand.y[i] = position.y;
+                hand.z[i] = position.z;
+            }
+            else
+            {
+                hand.x[i] = hand.y[i] = hand.z[i] = NAN;
+            }
+        }
+    }
+
+    // Both hands must be converted before we can measure the two-handed distances.
+    for (int side = 0; side < 2; side++)
+    {
+        ComputeDistances(side);
+    }
+}
+
+void HandFeatures::ComputeDistances(
+    int side)
+{
+    Hand& hand = m_hands[side];
+    const Hand& otherHand = m_hands[side ^ 1];
+
+    for (uint32_t i = 0; i < m_distancesCount; i += 4)
+    {
+        // Gather the 4 pairs of joints.
+        alignas(16) float lanes[6][4];
+        for (uint32_t lane = 0; lane < 4; lane++)
+        {
+            const uint32_t pair = i + lane;
+            const Hand& hand2 = m_isTwoHanded[pair] ? otherHand : hand;
+            lanes[0][lane] = hand.x[m_joint1[pair]];
+            lanes[1][lane] = hand.y[m_joint1[pair]];
+            lanes[2][lane] = hand.z[m_joint1[pair]];
+            lanes[3][lane] = hand2.x[m_joint2[pair]];
+            lanes[4][lane] = hand2.y[m_joint2[pair]];
+            lanes[5][lane] = hand2.z[m_joint2[pair]];
+        }
+
+        const auto load = [&lanes](int row) {
+            return DirectX::XMLoadFloat4A(reinterpret_cast<const DirectX::XMFLOAT4A*>(lanes[row]));
+        };
+        const DirectX::XMVECTOR dx = DirectX::XMVectorSubtract(load(0), load(3));
+        const DirectX::XMVECTOR dy = DirectX::XMVectorSubtract(load(1), load(4));
+        const DirectX::XMVECTOR dz = DirectX::XMVectorSubtract(load(2), load(5));
+        DirectX::XMVECTOR squared = DirectX::XMVectorMultiply(dx, dx);
+        squared = DirectX::XMVectorMultiplyAdd(dy, dy, squared);
+        squared = DirectX::XMVectorMultiplyAdd(dz, dz, squared);
+
+        DirectX::XMStoreFloat4A(reinterpret_cast<DirectX::XMFLOAT4A*>(&hand.distances[i]), DirectX::XMVectorSqrt(squared));
+    }
+}
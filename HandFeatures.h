@@ -0,0 +1,108 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pch.h"
+
+#include "HandJointsCache.h"
+
+enum class HandFinger
+{
+    Thumb = 0,
+    Index,
+    Middle,
+    Ring,
+    Little,
+
+    Count
+};
+
+// The features of both hands for a frame, extracted once and shared by all the gesture recognizers.
+//
+// The joint positions are stored as structure-of-arrays, with the positions of invalid joints set to NaN. The distances
+// between all the joint pairs registered with AddDistance() are then computed 4 at a time, and any distance involving
+// an invalid joint naturally comes out as NaN.
+class HandFeatures
+{
+public:
+    HandFeatures()
+    {
+        ClearDistances();
+    }
+
+    // Register a pair of joints to measure, either within the same hand or with joint2 on the other hand. Returns the
+    // index to pass to GetDistance(). Pairs that are already registered are shared.
+    int AddDistance(
+        int joint1,
+        int joint2,
+        bool isTwoHanded);
+
+    // Unregister all the pairs, except for the finger curls.
+    void ClearDistances();
+
+    // Extract the features for both hands. The snapshots must be located in the same space.
+    void Update(const HandJointsSnapshot* const hands[2]);
+
+    bool IsValid(int side) const
+    {
+        return m_hands[side].isValid;
+    }
+
+    // The distance (in meters) for a registered pair, or NaN if either joint is not valid.
+    float GetDistance(
+        int side,
+        int index) const
+    {
+        return m_hands[side].distances[index];
+    }
+
+    // The distance (in meters) between the tip and the metacarpal of a finger, or NaN if either joint is not valid.
+    float GetCurl(
+        int side,
+        HandFinger finger) const
+    {
+        return m_hands[side].distances[static_cast<int>(finger)];
+    }
+
+private:
+    // Enough for the finger curls, the built-in gestures and a couple dozen custom ones.
+    static constexpr uint32_t MaxDistances = 64;
+
+    // Padded to a multiple of 4 for the SIMD loads.
+    static constexpr uint32_t JointsStride = (XR_HAND_JOINT_COUNT_EXT + 3) & ~3;
+
+    struct Hand
+    {
+        bool isValid;
+
+        alignas(16) float x[JointsStride];
+        alignas(16) float y[JointsStride];
+        alignas(16) float z[JointsStride];
+
+        alignas(16) float distances[MaxDistances];
+    };
+
+    void ComputeDistances(
+        int side);
+
+    uint8_t m_joint1[MaxDistances];
+    uint8_t m_joint2[MaxDistances];
+    bool m_isTwoHanded[MaxDistances];
+    uint32_t m_distancesCount;
+
+    Hand m_hands[2];
+};
@@ -0,0 +1,207 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include "HandJointsCache.h"
+
+namespace {
+    using namespace xr::math;
+
+    // Re-express all the joints of a hand from the reference space into a base space, given the pose of the reference
+    // space within the base space. The rigid transform is loaded once for the whole batch.
+    void TransformJoints(
+        const XrHandJointLocationEXT source[XR_HAND_JOINT_COUNT_EXT],
+        const XrPosef& referenceInBase,
+        const XrSpaceLocationFlags referenceFlags,
+        XrHandJointLocationEXT destination[XR_HAND_JOINT_COUNT_EXT])
+    {
+        const DirectX::XMMATRIX transform = LoadXrPose(referenceInBase);
+        const DirectX::XMVECTOR rotation = LoadXrQuaternion(referenceInBase.orientation);
+
+        for (uint32_t i = 0; i < XR_HAND_JOINT_COUNT_EXT; i++)
+        {
+            const DirectX::XMVECTOR position = DirectX::XMVector3Transform(LoadXrVector3(source[i].pose.position), transform);
+            const DirectX::XMVECTOR orientation = DirectX::XMQuaternionMultiply(LoadXrQuaternion(source[i].pose.orientation), rotation);
+
+            StoreXrVector3(&destination[i].pose.position, position);
+            StoreXrQuaternion(&destination[i].pose.orientation, orientation);
+            destination[i].radius = source[i].radius;
+
+            // A joint is only as valid/tracked as the relation between the two spaces.
+            destination[i].locationFlags = source[i].locationFlags & referenceFlags;
+        }
+    }
+}
+
+const HandJointsSnapshot& HandJointsCache::Locate(
+    XrHandTrackerEXT tracker,
+    XrSpace baseSpace,
+    XrTime time)
+{
+    for (uint32_t i = 0; i < MaxSnapshots; i++)
+    {
+        const HandJointsSnapshot& snapshot = m_snapshots[i];
+        if (snapshot.tracker == tracker && snapshot.baseSpace == baseSpace && snapshot.time == time)
+        {
+            m_hitCount++;
+            return snapshot;
+        }
+    }
+
+    m_missCount++;
+
+    if (m_referenceSpace == XR_NULL_HANDLE || baseSpace == m_referenceSpace || !m_xrLocateSpace)
+    {
+        HandJointsSnapshot& snapshot = AllocateSnapshot(tracker, baseSpace, time, nullptr);
+
+        XrHandJointsLocateInfoEXT locateInfo{ XR_TYPE_HAND_JOINTS_LOCATE_INFO_EXT };
+        locateInfo.baseSpace = baseSpace;
+        locateInfo.time = time;
+
+        XrHandJointLocationsEXT locations{ XR_TYPE_HAND_JOINT_LOCATIONS_EXT };
+        locations.jointCount = XR_HAND_JOINT_COUNT_EXT;
+        locations.jointLocations = snapshot.jointLocations;
+
+        snapshot.result = m_xrLocateHandJointsEXT ? m_xrLocateHandJointsEXT(tracker, &locateInfo, &locations) : XR_ERROR_FUNCTION_UNSUPPORTED;
+        m_handLocateCount++;
+
+        return snapshot;
+    }
+
+    // Derive the joints from the reference space snapshot.
+    const HandJointsSnapshot& reference = Locate(tracker, m_referenceSpace, time);
+    const SpaceRelation& relation = LocateReferenceSpace(baseSpace, time);
+
+    HandJointsSnapshot& snapshot = AllocateSnapshot(tracker, baseSpace, time, &reference);
+    snapshot.result = reference.result != XR_SUCCESS ? reference.result : relation.result;
+    if (snapshot.result == XR_SUCCESS)
+    {
+        TransformJoints(reference.jointLocations, relation.pose, relation.locationFlags, snapshot.jointLocations);
+    }
+
+    return snapshot;
+}
+
+void HandJointsCache::Insert(const HandJointsSnapshot& snapshot)
+{
+    for (uint32_t i = 0; i < MaxSnapshots; i++)
+    {
+        const HandJointsSnapshot& existing = m_snapshots[i];
+        if (existing.tracker == snapshot.tracker && existing.baseSpace == snapshot.baseSpace && existing.time == snapshot.time)
+        {
+            return;
+        }
+    }
+
+    AllocateSnapshot(snapshot.tracker, snapshot.baseSpace, snapshot.time, nullptr) = snapshot;
+}
+
+HandJointsSnapshot& HandJointsCache::AllocateSnapshot(
+    XrHandTrackerEXT tracker,
+    XrSpace baseSpace,
+    XrTime time,
+    const HandJointsSnapshot* pinned)
+{
+    // Elect the entry to evict: either a free entry or the one with the oldest time, but never the pinned entry that
+    // the new snapshot is derived from.
+    uint32_t victim = &m_snapshots[0] != pinned ? 0 : 1;
+    for (uint32_t i = victim + 1; i < MaxSnapshots; i++)
+    {
+        const HandJointsSnapshot& snapshot = m_snapshots[i];
+        const HandJointsSnapshot& candidate = m_snapshots[victim];
+        if (&snapshot != pinned && candidate.tracker != XR_NULL_HANDLE &&
+            (snapshot.tracker == XR_NULL_HANDLE || snapshot.time < candidate.time))
+        {
+            victim = i;
+        }
+    }
+
+    HandJointsSnapshot& snapshot = m_snapshots[victim];
+    snapshot.tracker = tracker;
+    snapshot.baseSpace = baseSpace;
+    snapshot.time = time;
+
+    return snapshot;
+}
+
+const HandJointsCache::SpaceRelation& HandJointsCache::LocateReferenceSpace(
+    XrSpace baseSpace,
+    XrTime time)
+{
+    uint32_t victim = 0;
+    for (uint32_t i = 0; i < MaxRelations; i++)
+    {
+        const SpaceRelation& relation = m_relations[i];
+        if (relation.baseSpace == baseSpace && relation.time == time)
+        {
+            return relation;
+        }
+
+        const SpaceRelation& candidate = m_relations[victim];
+        if (candidate.baseSpace != XR_NULL_HANDLE && (relation.baseSpace == XR_NULL_HANDLE || relation.time < candidate.time))
+        {
+            victim = i;
+        }
+    }
+
+    SpaceRelation& relation = m_relations[victim];
+    relation.baseSpace = baseSpace;
+    relation.time = time;
+
+    XrSpaceLocation location{ XR_TYPE_SPACE_LOCATION };
+    relation.result = m_xrLocateSpace(m_referenceSpace, baseSpace, time, &location);
+    relation.locationFlags = location.locationFlags;
+    relation.pose = location.pose;
+    m_spaceLocateCount++;
+
+    return relation;
+}
+
+void HandJointsCache::Invalidate(XrSpace space)
+{
+    for (uint32_t i = 0; i < MaxSnapshots; i++)
+    {
+        if (m_snapshots[i].baseSpace == space)
+        {
+            m_snapshots[i].tracker = XR_NULL_HANDLE;
+        }
+    }
+    for (uint32_t i = 0; i < MaxRelations; i++)
+    {
+        if (m_relations[i].baseSpace == space)
+        {
+            m_relations[i].baseSpace = XR_NULL_HANDLE;
+        }
+    }
+}
+
+void HandJointsCache::Clear()
+{
+    for (uint32_t i = 0; i < MaxSnapshots; i++)
+    {
+        m_snapshots[i].tracker = XR_NULL_HANDLE;
+        m_snapshots[i].baseSpace = XR_NULL_HANDLE;
+        m_snapshots[i].time = 0;
+        m_snapshots[i].result = XR_ERROR_HANDLE_INVALID;
+    }
+    for (uint32_t i = 0; i < MaxRelations; i++)
+    {
+        m_relations[i].baseSpace = XR_NULL_HANDLE;
+        m_relations[i].time = 0;
+        m_relations[i].result = XR_ERROR_HANDLE_INVALID;
+    }
+}
@@ -0,0 +1,136 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pch.h"
+
+// The joints locations for one hand, located in a given space at a given time.
+struct HandJointsSnapshot
+{
+    XrHandTrackerEXT tracker;
+    XrSpace baseSpace;
+    XrTime time;
+
+    XrResult result;
+    XrHandJointLocationEXT jointLocations[XR_HAND_JOINT_COUNT_EXT];
+};
+
+// A frame-scoped store of hand joints snapshots, so that xrLocateSpace(), xrSyncActions() and xrEndFrame() can share
+// the result of a single call to xrLocateHandJointsEXT() per hand.
+//
+// The hands are only ever located in the reference space. The joints in any other space are derived from that
+// snapshot with one xrLocateSpace() per distinct base space, which is much cheaper than locating the hands again.
+class HandJointsCache
+{
+public:
+    HandJointsCache()
+    {
+        Clear();
+    }
+
+    void SetLocateFunctions(
+        PFN_xrLocateHandJointsEXT locateHandJoints,
+        PFN_xrLocateSpace locateSpace)
+    {
+        m_xrLocateHandJointsEXT = locateHandJoints;
+        m_xrLocateSpace = locateSpace;
+        Clear();
+    }
+
+    void SetReferenceSpace(XrSpace referenceSpace)
+    {
+        m_referenceSpace = referenceSpace;
+        Clear();
+    }
+
+    // Get the joints for a hand, only calling into the runtime if no snapshot exists for this tracker/space/time.
+    // The returned reference remains valid until the snapshot is evicted by a lookup for a more recent time.
+    const HandJointsSnapshot& Locate(
+        XrHandTrackerEXT tracker,
+        XrSpace baseSpace,
+        XrTime time);
+
+    // Store a snapshot obtained elsewhere (eg: located by another thread), unless one already exists for its
+    // tracker/space/time.
+    void Insert(const HandJointsSnapshot& snapshot);
+
+    // Drop all the snapshots referring to a space that is being destroyed.
+    void Invalidate(XrSpace space);
+
+    // Drop all the snapshots.
+    void Clear();
+
+    uint64_t GetHitCount() const
+    {
+        return m_hitCount;
+    }
+
+    uint64_t GetMissCount() const
+    {
+        return m_missCount;
+    }
+
+    // The number of calls made to xrLocateHandJointsEXT().
+    uint64_t GetHandLocateCount() const
+    {
+        return m_handLocateCount;
+    }
+
+    // The number of calls made to xrLocateSpace() to relate a base space to the reference space.
+    uint64_t GetSpaceLocateCount() const
+    {
+        return m_spaceLocateCount;
+    }
+
+private:
+    // The pose of the reference space within a base space.
+    struct SpaceRelation
+    {
+        XrSpace baseSpace;
+        XrTime time;
+
+        XrResult result;
+        XrSpaceLocationFlags locationFlags;
+        XrPosef pose;
+    };
+
+    HandJointsSnapshot& AllocateSnapshot(
+        XrHandTrackerEXT tracker,
+        XrSpace baseSpace,
+        XrTime time,
+        const HandJointsSnapshot* pinned);
+
+    const SpaceRelation& LocateReferenceSpace(
+        XrSpace baseSpace,
+        XrTime time);
+
+    // Enough for both hands in 3 distinct spaces, and to keep the previous frame around while the next one begins.
+    static constexpr uint32_t MaxSnapshots = 12;
+    static constexpr uint32_t MaxRelations = 6;
+
+    PFN_xrLocateHandJointsEXT m_xrLocateHandJointsEXT = nullptr;
+    PFN_xrLocateSpace m_xrLocateSpace = nullptr;
+    XrSpace m_referenceSpace = XR_NULL_HANDLE;
+
+    HandJointsSnapshot m_snapshots[MaxSnapshots];
+    SpaceRelation m_relations[MaxRelations];
+
+    uint64_t m_hitCount = 0;
+    uint64_t m_missCount = 0;
+    uint64_t m_handLocateCount = 0;
+    uint64_t m_spaceLocateCount = 0;
+};
@@ -8,22 +8,20 @@
 #include "pch.h"
 
 #include "HandRenderer.h"
+#include "resource.h"
 
 namespace CubeShader {
     struct Vertex {
         XrVector3f Position;
-        XrVector3f Color;
     };
 
     // https://www.schemecolor.com/real-skin-tones-color-palette.php
-    constexpr XrVector3f Bright1{ 255 / 255.f, 219 / 255.f, 172 / 255.f };
-    constexpr XrVector3f Bright2{ 255 / 255.f, 219 / 255.f, 172 / 255.f };
-    constexpr XrVector3f Medium1{ 224 / 255.f, 172 / 255.f, 105 / 255.f };
-    constexpr XrVector3f Medium2{ 224 / 255.f, 172 / 255.f, 105 / 255.f };
-    constexpr XrVector3f Dark1{ 141 / 255.f, 85 / 255.f, 36 / 255.f };
-    constexpr XrVector3f Dark2{ 141 / 255.f, 85 / 255.f, 36 / 255.f };
-    constexpr XrVector3f Darker1{ 77 / 255.f, 42 / 255.f, 34 / 255.f };
-    constexpr XrVector3f Darker2{ 77 / 255.f, 42 / 255.f, 34 / 255.f };
+    constexpr XrVector3f SkinTones[] = {
+        { 255 / 255.f, 219 / 255.f, 172 / 255.f }, // Bright
+        { 224 / 255.f, 172 / 255.f, 105 / 255.f }, // Medium
+        { 141 / 255.f, 85 / 255.f, 36 / 255.f }, // Dark
+        { 77 / 255.f, 42 / 255.f, 34 / 255.f }, // Darker
+    };
 
     // Vertices for a 1x1x1 meter cube. (Left/Right, Top/Bottom, Front/Back)
     constexpr XrVector3f LBB{ -0.5f, -0.5f, -0.5f };
@@ -35,42 +33,15 @@ namespace CubeShader {
     constexpr XrVector3f RTB{ 0.5f, 0.5f, -0.5f };
     constexpr XrVector3f RTF{ 0.5f, 0.5f, 0.5f };
 
-#define CUBE_SIDE(V1, V2, V3, V4, V5, V6, COLOR) {V1, COLOR}, {V2, COLOR}, {V3, COLOR}, {V4, COLOR}, {V5, COLOR}, {V6, COLOR},
-
-    constexpr Vertex c_cubeVerticesBright[] = {
-        CUBE_SIDE(LTB, LBF, LBB, LTB, LTF, LBF, Bright1)  // -X
-        CUBE_SIDE(RTB, RBB, RBF, RTB, RBF, RTF, Bright1)  // +X
-        CUBE_SIDE(LBB, LBF, RBF, LBB, RBF, RBB, Bright2)  // -Y
-        CUBE_SIDE(LTB, RTB, RTF, LTB, RTF, LTF, Bright2)  // +Y
-        CUBE_SIDE(LBB, RBB, RTB, LBB, RTB, LTB, Bright1)  // -Z
-        CUBE_SIDE(LBF, LTF, RTF, LBF, RTF, RBF, Bright2)  // +Z
-    };
-
-    constexpr Vertex c_cubeVerticesMedium[] = {
-        CUBE_SIDE(LTB, LBF, LBB, LTB, LTF, LBF, Medium1)  // -X
-        CUBE_SIDE(RTB, RBB, RBF, RTB, RBF, RTF, Medium1)  // +X
-        CUBE_SIDE(LBB, LBF, RBF, LBB, RBF, RBB, Medium2)  // -Y
-        CUBE_SIDE(LTB, RTB, RTF, LTB, RTF, LTF, Medium2)  // +Y
-        CUBE_SIDE(LBB, RBB, RTB, LBB, RTB, LTB, Medium1)  // -Z
-        CUBE_SIDE(LBF, LTF, RTF, LBF, RTF, RBF, Medium2)  // +Z
-    };
-
-    constexpr Vertex c_cubeVerticesDark[] = {
-        CUBE_SIDE(LTB, LBF, LBB, LTB, LTF, LBF, Dark1)  // -X
-        CUBE_SIDE(RTB, RBB, RBF, RTB, RBF, RTF, Dark1)  // +X
-        CUBE_SIDE(LBB, LBF, RBF, LBB, RBF, RBB, Dark2)  // -Y
-        CUBE_SIDE(LTB, RTB, RTF, LTB, RTF, LTF, Dark2)  // +Y
-        CUBE_SIDE(LBB, RBB, RTB, LBB, RTB, LTB, Dark1)  // -Z
-        CUBE_SIDE(LBF, LTF, RTF, LBF, RTF, RBF, Dark2)  // +Z
-    };
+#define CUBE_SIDE(V1, V2, V3, V4, V5, V6) {V1}, {V2}, {V3}, {V4}, {V5}, {V6},
 
-    constexpr Vertex c_cubeVerticesDarker[] = {
-        CUBE_SIDE(LTB, LBF, LBB, LTB, LTF, LBF, Darker1)  // -X
-        CUBE_SIDE(RTB, RBB, RBF, RTB, RBF, RTF, Darker1)  // +X
-        CUBE_SIDE(LBB, LBF, RBF, LBB, RBF, RBB, Darker2)  // -Y
-        CUBE_SIDE(LTB, RTB, RTF, LTB, RTF, LTF, Darker2)  // +Y
-        CUBE_SIDE(LBB, RBB, RTB, LBB, RTB, LTB, Darker1)  // -Z
-        CUBE_SIDE(LBF, LTF, RTF, LBF, RTF, RBF, Darker2)  // +Z
+    constexpr Vertex c_cubeVertices[] = {
+        CUBE_SIDE(LTB, LBF, LBB, LTB, LTF, LBF)  // -X
+        CUBE_SIDE(RTB, RBB, RBF, RTB, RBF, RTF)  // +X
+        CUBE_SIDE(LBB, LBF, RBF, LBB, RBF, RBB)  // -Y
+        CUBE_SIDE(LTB, RTB, RTF, LTB, RTF, LTF)  // +Y
+        CUBE_SIDE(LBB, RBB, RTB, LBB, RTB, LTB)  // -Z
+        CUBE_SIDE(LBF, LTF, RTF, LBF, RTF, RBF)  // +Z
     };
 
     // Winding order is clockwise. Each side uses a different color.
@@ -83,49 +54,40 @@ namespace CubeShader {
         30, 31, 32, 33, 34, 35, // +Z
     };
 
-    struct ModelConstantBuffer {
-        DirectX::XMFLOAT4X4 Model;
-    };
+    // One instance per joint of both hands, in the same order as the instances of a view.
+    constexpr uint32_t JointsCount = 2 * XR_HAND_JOINT_COUNT_EXT;
 
     struct ViewProjectionConstantBuffer {
         DirectX::XMFLOAT4X4 ViewProjection[2];
+        XrVector3f Color;
+        float ClearDepth;
     };
 
     constexpr uint32_t MaxViewInstance = 2;
 
-    // Separate entrypoints for the vertex and pixel shader functions.
-    constexpr char ShaderHlsl[] = R"_(
-            struct VSOutput {
-                float4 Pos : SV_POSITION;
-                float3 Color : COLOR0;
-                uint viewId : SV_RenderTargetArrayIndex;
-            };
-            struct VSInput {
-                float3 Pos : POSITION;
-                float3 Color : COLOR0;
-                uint instId : SV_InstanceID;
-            };
-            cbuffer ModelConstantBuffer : register(b0) {
-                float4x4 Model;
-            };
-            cbuffer ViewProjectionConstantBuffer : register(b1) {
-                float4x4 ViewProjection[2];
-            };
-
-            VSOutput MainVS(VSInput input) {
-                VSOutput output;
-                output.Pos = mul(mul(float4(input.Pos, 1), Model), ViewProjection[input.instId]);
-                output.Color = input.Color;
-                output.viewId = input.instId;
-                return output;
-            }
+    // Separate entrypoints for the vertex and pixel shader functions, prebuilt from HandShader.hlsl.
+#include "HandShaderVS.h"
+#include "HandShaderPS.h"
+#include "HandShaderClearVS.h"
 
-            float4 MainPS(VSOutput input) : SV_TARGET {
-                return float4(input.Color, 1);
-            }
-            )_";
+    // The source of HandShader.hlsl, embedded in our DLL.
+    std::string_view GetShaderHlsl() {
+        HMODULE module;
+        if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, (LPCSTR)&GetShaderHlsl, &module)) {
+            return {};
+        }
+
+        const HRSRC resource = FindResource(module, MAKEINTRESOURCE(IDR_HAND_SHADER), RT_RCDATA);
+        const HGLOBAL data = resource ? LoadResource(module, resource) : nullptr;
+        if (!data) {
+            return {};
+        }
 
-    ComPtr<ID3DBlob> CompileShader(const char* hlsl, const char* entrypoint, const char* shaderTarget) {
+        return std::string_view(static_cast<const char*>(LockResource(data)), SizeofResource(module, resource));
+    }
+
+    // Only used when the device does not accept the prebuilt bytecode.
+    ComPtr<ID3DBlob> CompileShader(std::string_view hlsl, const char* entrypoint, const char* shaderTarget) {
         ComPtr<ID3DBlob> compiled;
         ComPtr<ID3DBlob> errMsgs;
         DWORD flags = D3DCOMPILE_PACK_MATRIX_COLUMN_MAJOR | D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_WARNINGS_ARE_ERRORS;
@@ -137,97 +99,259 @@ namespace CubeShader {
 #endif
 
         HRESULT hr =
-            D3DCompile(hlsl, strlen(hlsl), nullptr, nullptr, nullptr, entrypoint, shaderTarget, flags, 0, compiled.GetAddressOf(), errMsgs.GetAddressOf());
+            D3DCompile(hlsl.data(), hlsl.size(), nullptr, nullptr, nullptr, entrypoint, shaderTarget, flags, 0, compiled.GetAddressOf(), errMsgs.GetAddressOf());
         if (FAILED(hr)) {
-            std::string errMsg((const char*)errMsgs->GetBufferPointer(), errMsgs->GetBufferSize());
-            CHECK_HRESULT(hr, "D3DCompile failed");
+            const std::string errMsg = errMsgs ? std::string((const char*)errMsgs->GetBufferPointer(), errMsgs->GetBufferSize()) : "D3DCompile failed";
+            CHECK_HRESULT(hr, errMsg.c_str());
         }
 
         return compiled;
     }
 
+    static_assert(JointsCount == 52, "The shader must be updated");
+    static_assert(sizeof(ViewProjectionConstantBuffer) % 16 == 0, "The constant buffer size must be a multiple of 16 bytes");
+
 } // namespace CubeShader
 
+namespace {
+    // The pipeline slots touched by HandRenderer::RecordHands(), saved from and restored into the immediate context.
+    class SavedPipelineState
+    {
+    public:
+        void Save(ID3D11DeviceContext* context)
+        {
+            context->IAGetInputLayout(m_inputLayout.ReleaseAndGetAddressOf());
+            context->IAGetPrimitiveTopology(&m_topology);
+            context->IAGetVertexBuffers(0, 1, m_vertexBuffer.ReleaseAndGetAddressOf(), &m_vertexStride, &m_vertexOffset);
+            context->IAGetIndexBuffer(m_indexBuffer.ReleaseAndGetAddressOf(), &m_indexFormat, &m_indexOffset);
+
+            context->VSGetShader(m_vertexShader.ReleaseAndGetAddressOf(), nullptr, nullptr);
+            context->VSGetConstantBuffers(0, 1, m_vsConstantBuffer.ReleaseAndGetAddressOf());
+            context->VSGetShaderResources(0, 1, m_vsShaderResource.ReleaseAndGetAddressOf());
+            context->HSGetShader(m_hullShader.ReleaseAndGetAddressOf(), nullptr, nullptr);
+            context->DSGetShader(m_domainShader.ReleaseAndGetAddressOf(), nullptr, nullptr);
+            context->GSGetShader(m_geometryShader.ReleaseAndGetAddressOf(), nullptr, nullptr);
+            context->PSGetShader(m_pixelShader.ReleaseAndGetAddressOf(), nullptr, nullptr);
+
+            m_viewportsCount = (UINT)std::size(m_viewports);
+            context->RSGetViewports(&m_viewportsCount, m_viewports);
+            m_scissorsCount = (UINT)std::size(m_scissors);
+            context->RSGetScissorRects(&m_scissorsCount, m_scissors);
+            context->RSGetState(m_rasterizerState.ReleaseAndGetAddressOf());
+
+            context->OMGetRenderTargets((UINT)std::size(m_renderTargets), m_renderTargets, m_depthStencil.ReleaseAndGetAddressOf());
+            context->OMGetDepthStencilState(m_depthStencilState.ReleaseAndGetAddressOf(), &m_stencilRef);
+            context->OMGetBlendState(m_blendState.ReleaseAndGetAddressOf(), m_blendFactor, &m_sampleMask);
+        }
+
+        void Restore(ID3D11DeviceContext* context)
+        {
+            context->IASetInputLayout(m_inputLayout.Get());
+            context->IASetPrimitiveTopology(m_topology);
+            ID3D11Buffer* const vertexBuffers[] = { m_vertexBuffer.Get() };
+            context->IASetVertexBuffers(0, 1, vertexBuffers, &m_vertexStride, &m_vertexOffset);
+            context->IASetIndexBuffer(m_indexBuffer.Get(), m_indexFormat, m_indexOffset);
+
+            // Note: the class instances (rarely used) are not restored.
+            context->VSSetShader(m_vertexShader.Get(), nullptr, 0);
+            ID3D11Buffer* const constantBuffers[] = { m_vsConstantBuffer.Get() };
+            context->VSSetConstantBuffers(0, 1, constantBuffers);
+            ID3D11ShaderResourceView* const shaderResources[] = { m_vsShaderResource.Get() };
+            context->VSSetShaderResources(0, 1, shaderResources);
+            context->HSSetShader(m_hullShader.Get(), nullptr, 0);
+            context->DSSetShader(m_domainShader.Get(), nullptr, 0);
+            context->GSSetShader(m_geometryShader.Get(), nullptr, 0);
+            context->PSSetShader(m_pixelShader.Get(), nullptr, 0);
+
+            context->RSSetViewports(m_viewportsCount, m_viewports);
+            context->RSSetScissorRects(m_scissorsCount, m_scissors);
+            context->RSSetState(m_rasterizerState.Get());
+
+            context->OMSetRenderTargets((UINT)std::size(m_renderTargets), m_renderTargets, m_depthStencil.Get());
+            context->OMSetDepthStencilState(m_depthStencilState.Get(), m_stencilRef);
+            context->OMSetBlendState(m_blendState.Get(), m_blendFactor, m_sampleMask);
+
+            // The Get functions add a reference.
+            for (auto& renderTarget : m_renderTargets)
+            {
+                if (renderTarget)
+                {
+                    renderTarget->Release();
+                    renderTarget = nullptr;
+                }
+            }
+            m_inputLayout = nullptr;
+            m_vertexBuffer = nullptr;
+            m_indexBuffer = nullptr;
+            m_vertexShader = nullptr;
+            m_vsConstantBuffer = nullptr;
+            m_vsShaderResource = nullptr;
+            m_hullShader = nullptr;
+            m_domainShader = nullptr;
+            m_geometryShader = nullptr;
+            m_pixelShader = nullptr;
+            m_rasterizerState = nullptr;
+            m_depthStencil = nullptr;
+            m_depthStencilState = nullptr;
+            m_blendState = nullptr;
+        }
+
+    private:
+        ComPtr<ID3D11InputLayout> m_inputLayout;
+        D3D11_PRIMITIVE_TOPOLOGY m_topology;
+        ComPtr<ID3D11Buffer> m_vertexBuffer;
+        UINT m_vertexStride;
+        UINT m_vertexOffset;
+        ComPtr<ID3D11Buffer> m_indexBuffer;
+        DXGI_FORMAT m_indexFormat;
+        UINT m_indexOffset;
+
+        ComPtr<ID3D11VertexShader> m_vertexShader;
+        ComPtr<ID3D11Buffer> m_vsConstantBuffer;
+        ComPtr<ID3D11ShaderResourceView> m_vsShaderResource;
+        ComPtr<ID3D11HullShader> m_hullShader;
+        ComPtr<ID3D11DomainShader> m_domainShader;
+        ComPtr<ID3D11GeometryShader> m_geometryShader;
+        ComPtr<ID3D11PixelShader> m_pixelShader;
+
+        D3D11_VIEWPORT m_viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+        UINT m_viewportsCount;
+        D3D11_RECT m_scissors[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+        UINT m_scissorsCount;
+        ComPtr<ID3D11RasterizerState> m_rasterizerState;
+
+        ID3D11RenderTargetView* m_renderTargets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT]{};
+        ComPtr<ID3D11DepthStencilView> m_depthStencil;
+        ComPtr<ID3D11DepthStencilState> m_depthStencilState;
+        UINT m_stencilRef;
+        ComPtr<ID3D11BlendState> m_blendState;
+        FLOAT m_blendFactor[4];
+        UINT m_sampleMask;
+    };
+} // namespace
+
 void HandRenderer::SetDevice(ComPtr<ID3D11Device> device)
 {
+    // Never release the resources under the initialization.
+    if (m_initializationThread.joinable())
+    {
+        m_initializationThread.join();
+    }
+    m_state = State::Uninitialized;
+
 	m_device = device;
     if (!device)
     {
         m_deviceContext = nullptr;
+        m_deferredContext = nullptr;
+        m_deviceContext1 = nullptr;
+        m_stateObject = nullptr;
         m_vertexShader = nullptr;
+        m_clearVertexShader = nullptr;
         m_pixelShader = nullptr;
-        m_modelCBuffer = nullptr;
+        m_jointsBuffer = nullptr;
+        m_jointsView = nullptr;
         m_viewProjectionCBuffer = nullptr;
         m_inputLayout = nullptr;
-        m_cubeVertexBufferBright = nullptr;
-        m_cubeVertexBufferMedium = nullptr;
-        m_cubeVertexBufferDark = nullptr;
-        m_cubeVertexBufferDarker = nullptr;
         m_cubeVertexBuffer = nullptr;
         m_cubeIndexBuffer = nullptr;
         m_reversedZDepthNoStencilTest = nullptr;
+        m_depthClearState = nullptr;
+        m_scissorRasterizerState = nullptr;
         return;
     }
 
 	m_device->GetImmediateContext(m_deviceContext.ReleaseAndGetAddressOf());
 
+    // Create the resources in the background, so we don't delay the session creation. The hands are not rendered until
+    // this completes. A single-threaded device cannot be used concurrently with the application though.
+    m_state = State::Initializing;
+    if (m_device->GetCreationFlags() & D3D11_CREATE_DEVICE_SINGLETHREADED)
+    {
+        Initialize();
+    }
+    else
+    {
+        m_initializationThread = std::thread(&HandRenderer::Initialize, this);
+    }
+}
+
+void HandRenderer::Initialize()
+{
+    try
+    {
+        CreateResources();
+        m_state.store(State::Ready, std::memory_order_release);
+    }
+    catch (std::exception& exc)
+    {
+        m_initializationError = exc.what();
+        m_state.store(State::Failed, std::memory_order_release);
+    }
+}
+
+void HandRenderer::CreateResources()
+{
 	// Create resources necessary for rendering.
-    const ComPtr<ID3DBlob> vertexShaderBytes = CubeShader::CompileShader(CubeShader::ShaderHlsl, "MainVS", "vs_5_0");
-    CHECK_HRCMD(m_device->CreateVertexShader(
-        vertexShaderBytes->GetBufferPointer(), vertexShaderBytes->GetBufferSize(), nullptr, m_vertexShader.ReleaseAndGetAddressOf()));
+    // Use the prebuilt shaders, unless the device rejects them.
+    const void* vertexShaderBytes = CubeShader::g_HandShaderVS;
+    size_t vertexShaderSize = sizeof(CubeShader::g_HandShaderVS);
+    ComPtr<ID3DBlob> compiledVertexShader;
+    if (FAILED(m_device->CreateVertexShader(vertexShaderBytes, vertexShaderSize, nullptr, m_vertexShader.ReleaseAndGetAddressOf())))
+    {
+        compiledVertexShader = CubeShader::CompileShader(CubeShader::GetShaderHlsl(), "MainVS", "vs_5_0");
+        vertexShaderBytes = compiledVertexShader->GetBufferPointer();
+        vertexShaderSize = compiledVertexShader->GetBufferSize();
+        CHECK_HRCMD(m_device->CreateVertexShader(vertexShaderBytes, vertexShaderSize, nullptr, m_vertexShader.ReleaseAndGetAddressOf()));
+    }
 
-    const ComPtr<ID3DBlob> pixelShaderBytes = CubeShader::CompileShader(CubeShader::ShaderHlsl, "MainPS", "ps_5_0");
-    CHECK_HRCMD(m_device->CreatePixelShader(
-        pixelShaderBytes->GetBufferPointer(), pixelShaderBytes->GetBufferSize(), nullptr, m_pixelShader.ReleaseAndGetAddressOf()));
+    if (FAILED(m_device->CreatePixelShader(
+        CubeShader::g_HandShaderPS, sizeof(CubeShader::g_HandShaderPS), nullptr, m_pixelShader.ReleaseAndGetAddressOf())))
+    {
+        const ComPtr<ID3DBlob> pixelShaderBytes = CubeShader::CompileShader(CubeShader::GetShaderHlsl(), "MainPS", "ps_5_0");
+        CHECK_HRCMD(m_device->CreatePixelShader(
+            pixelShaderBytes->GetBufferPointer(), pixelShaderBytes->GetBufferSize(), nullptr, m_pixelShader.ReleaseAndGetAddressOf()));
+    }
+
+    if (FAILED(m_device->CreateVertexShader(
+        CubeShader::g_HandShaderClearVS, sizeof(CubeShader::g_HandShaderClearVS), nullptr, m_clearVertexShader.ReleaseAndGetAddressOf())))
+    {
+        const ComPtr<ID3DBlob> clearVertexShaderBytes = CubeShader::CompileShader(CubeShader::GetShaderHlsl(), "ClearVS", "vs_5_0");
+        CHECK_HRCMD(m_device->CreateVertexShader(
+            clearVertexShaderBytes->GetBufferPointer(), clearVertexShaderBytes->GetBufferSize(), nullptr, m_clearVertexShader.ReleaseAndGetAddressOf()));
+    }
 
     const D3D11_INPUT_ELEMENT_DESC vertexDesc[] = {
         {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
     };
 
     CHECK_HRCMD(m_device->CreateInputLayout(vertexDesc,
         (UINT)std::size(vertexDesc),
-        vertexShaderBytes->GetBufferPointer(),
-        vertexShaderBytes->GetBufferSize(),
+        vertexShaderBytes,
+        vertexShaderSize,
         m_inputLayout.ReleaseAndGetAddressOf()));
 
-    const CD3D11_BUFFER_DESC modelConstantBufferDesc(sizeof(CubeShader::ModelConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
-    CHECK_HRCMD(m_device->CreateBuffer(&modelConstantBufferDesc, nullptr, m_modelCBuffer.ReleaseAndGetAddressOf()));
+    // The joints are written once per frame by the CPU.
+    const CD3D11_BUFFER_DESC jointsBufferDesc(sizeof(Joints::models), D3D11_BIND_SHADER_RESOURCE,
+        D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE, D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, sizeof(DirectX::XMFLOAT4X4));
+    CHECK_HRCMD(m_device->CreateBuffer(&jointsBufferDesc, nullptr, m_jointsBuffer.ReleaseAndGetAddressOf()));
+    const CD3D11_SHADER_RESOURCE_VIEW_DESC jointsViewDesc(m_jointsBuffer.Get(), DXGI_FORMAT_UNKNOWN, 0, CubeShader::JointsCount);
+    CHECK_HRCMD(m_device->CreateShaderResourceView(m_jointsBuffer.Get(), &jointsViewDesc, m_jointsView.ReleaseAndGetAddressOf()));
 
     const CD3D11_BUFFER_DESC viewProjectionConstantBufferDesc(sizeof(CubeShader::ViewProjectionConstantBuffer),
         D3D11_BIND_CONSTANT_BUFFER);
     CHECK_HRCMD(m_device->CreateBuffer(&viewProjectionConstantBufferDesc, nullptr, m_viewProjectionCBuffer.ReleaseAndGetAddressOf()));
 
     {
-        const D3D11_SUBRESOURCE_DATA vertexBufferData{ CubeShader::c_cubeVerticesBright };
-        const CD3D11_BUFFER_DESC vertexBufferDesc(sizeof(CubeShader::c_cubeVerticesBright), D3D11_BIND_VERTEX_BUFFER);
-        CHECK_HRCMD(m_device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, m_cubeVertexBufferBright.ReleaseAndGetAddressOf()));
-    }
-
-    {
-        const D3D11_SUBRESOURCE_DATA vertexBufferData{ CubeShader::c_cubeVerticesMedium };
-        const CD3D11_BUFFER_DESC vertexBufferDesc(sizeof(CubeShader::c_cubeVerticesMedium), D3D11_BIND_VERTEX_BUFFER);
-        CHECK_HRCMD(m_device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, m_cubeVertexBufferMedium.ReleaseAndGetAddressOf()));
-    }
-
-    {
-        const D3D11_SUBRESOURCE_DATA vertexBufferData{ CubeShader::c_cubeVerticesDark };
-        const CD3D11_BUFFER_DESC vertexBufferDesc(sizeof(CubeShader::c_cubeVerticesDark), D3D11_BIND_VERTEX_BUFFER);
-        CHECK_HRCMD(m_device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, m_cubeVertexBufferDark.ReleaseAndGetAddressOf()));
-    }
-
-    {
-        const D3D11_SUBRESOURCE_DATA vertexBufferData{ CubeShader::c_cubeVerticesDarker };
-        const CD3D11_BUFFER_DESC vertexBufferDesc(sizeof(CubeShader::c_cubeVerticesDarker), D3D11_BIND_VERTEX_BUFFER);
-        CHECK_HRCMD(m_device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, m_cubeVertexBufferDarker.ReleaseAndGetAddressOf()));
+        const D3D11_SUBRESOURCE_DATA vertexBufferData{ CubeShader::c_cubeVertices };
+        const CD3D11_BUFFER_DESC vertexBufferDesc(sizeof(CubeShader::c_cubeVertices), D3D11_BIND_VERTEX_BUFFER);
+        CHECK_HRCMD(m_device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, m_cubeVertexBuffer.ReleaseAndGetAddressOf()));
     }
 
     const D3D11_SUBRESOURCE_DATA indexBufferData{ CubeShader::c_cubeIndices };
     const CD3D11_BUFFER_DESC indexBufferDesc(sizeof(CubeShader::c_cubeIndices), D3D11_BIND_INDEX_BUFFER);
     CHECK_HRCMD(m_device->CreateBuffer(&indexBufferDesc, &indexBufferData, m_cubeIndexBuffer.ReleaseAndGetAddressOf()));
 
-    m_cubeVertexBuffer = m_cubeVertexBufferMedium;
-
     D3D11_FEATURE_DATA_D3D11_OPTIONS3 options;
     m_device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS3, &options, sizeof(options));
     CHECK_MSG(options.VPAndRTArrayIndexFromAnyShaderFeedingRasterizer,
@@ -238,6 +362,90 @@ void HandRenderer::SetDevice(ComPtr<ID3D11Device> device)
     depthStencilDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
     depthStencilDesc.DepthFunc = D3D11_COMPARISON_GREATER;
     CHECK_HRCMD(m_device->CreateDepthStencilState(&depthStencilDesc, m_reversedZDepthNoStencilTest.ReleaseAndGetAddressOf()));
+
+    // Unconditionally write the depth (and reset the stencil) of the clear triangle, like ClearDepthStencilView() would.
+    CD3D11_DEPTH_STENCIL_DESC depthClearDesc(CD3D11_DEFAULT{});
+    depthClearDesc.DepthEnable = true;
+    depthClearDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+    depthClearDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+    depthClearDesc.StencilEnable = true;
+    depthClearDesc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+    depthClearDesc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_REPLACE;
+    depthClearDesc.BackFace = depthClearDesc.FrontFace;
+    CHECK_HRCMD(m_device->CreateDepthStencilState(&depthClearDesc, m_depthClearState.ReleaseAndGetAddressOf()));
+
+    // The default state, but limiting the rasterization to the area covered by the hands.
+    CD3D11_RASTERIZER_DESC rasterizerDesc(CD3D11_DEFAULT{});
+    rasterizerDesc.ScissorEnable = TRUE;
+    CHECK_HRCMD(m_device->CreateRasterizerState(&rasterizerDesc, m_scissorRasterizerState.ReleaseAndGetAddressOf()));
+
+    // Use a deferred context so we can use the context saving feature. It is reused for every frame.
+    CHECK_HRCMD(m_device->CreateDeferredContext(0, m_deferredContext.ReleaseAndGetAddressOf()));
+
+    // Create our own state object, if supported.
+    ComPtr<ID3D11Device1> device1;
+    m_stateObject = nullptr;
+    if (SUCCEEDED(m_device.As(&device1)) && SUCCEEDED(m_deviceContext.As(&m_deviceContext1)))
+    {
+        const D3D_FEATURE_LEVEL featureLevel = m_device->GetFeatureLevel();
+        const UINT flags = (m_device->GetCreationFlags() & D3D11_CREATE_DEVICE_SINGLETHREADED) ? D3D11_1_CREATE_DEVICE_CONTEXT_STATE_SINGLETHREADED : 0;
+        if (FAILED(device1->CreateDeviceContextState(flags, &featureLevel, 1, D3D11_SDK_VERSION, __uuidof(ID3D11Device), nullptr,
+            m_stateObject.ReleaseAndGetAddressOf())))
+        {
+            m_stateObject = nullptr;
+        }
+    }
+}
+
+void HandRenderer::SetProperties(
+	const int skinTone,
+	const float opacity)
+{
+	m_color = CubeShader::SkinTones[std::clamp(skinTone, 0, (int)std::size(CubeShader::SkinTones) - 1)];
+}
+
+void HandRenderer::ComputeJoints(
+    const HandJointsSnapshot* const hands[2],
+    uint64_t layerSpaceGeneration,
+    const XrPosef& baseInLayer,
+    Joints& joints)
+{
+    joints.layerSpaceGeneration = layerSpaceGeneration;
+    joints.time = hands[0] ? hands[0]->time : 0;
+    joints.isAnyValid = false;
+
+    const DirectX::XMMATRIX baseToLayer = xr::math::LoadXrPose(baseInLayer);
+    for (uint32_t side = 0; side < 2; side++)
+    {
+        XrVector3f positions[XR_HAND_JOINT_COUNT_EXT];
+        uint32_t positionsCount = 0;
+        float largestRadius = 0.f;
+
+        const bool isHandValid = hands[side] && hands[side]->result == XR_SUCCESS;
+        for (uint32_t i = 0; i < XR_HAND_JOINT_COUNT_EXT; i++)
+        {
+            DirectX::XMFLOAT4X4& model = joints.models[side * XR_HAND_JOINT_COUNT_EXT + i];
+
+            // A null transform collapses the cube of the joints that are not tracked.
+            const XrHandJointLocationEXT* const jointLocation = isHandValid ? &hands[side]->jointLocations[i] : nullptr;
+            if (!jointLocation || !xr::math::Pose::IsPoseValid(jointLocation->locationFlags))
+            {
+                model = {};
+                continue;
+            }
+
+            const DirectX::XMMATRIX scaleMatrix = DirectX::XMMatrixScaling(
+                jointLocation->radius, min(0.0025f, jointLocation->radius), max(0.015f, jointLocation->radius));
+            const DirectX::XMMATRIX modelMatrix = scaleMatrix * xr::math::LoadXrPose(jointLocation->pose) * baseToLayer;
+            DirectX::XMStoreFloat4x4(&model, DirectX::XMMatrixTranspose(modelMatrix));
+            xr::math::StoreXrVector3(&positions[positionsCount++], modelMatrix.r[3]);
+            largestRadius = max(largestRadius, jointLocation->radius);
+            joints.isAnyValid = true;
+        }
+
+        // The cubes are never larger than the joint radius (or the minimum cube length) on any side.
+        joints.bounds[side] = HandBounds::Enclose(positions, positionsCount, max(largestRadius, 0.015f));
+    }
 }
 
 void HandRenderer::RenderHands(
@@ -249,104 +457,181 @@ void HandRenderer::RenderHands(
     float depthNear,
 	float depthFar)
 {
-    // Use a deferred context so we can use the context saving feature.
-    // TODO: Optimization: this is not efficient.
-    ComPtr<ID3D11DeviceContext> deferredContext;
-    CHECK_HRCMD(m_device->CreateDeferredContext(0, deferredContext.GetAddressOf()));
+    if (m_state.load(std::memory_order_acquire) != State::Ready)
+    {
+        return;
+    }
+
+    if (!m_joints.isAnyValid)
+    {
+        return;
+    }
+
+    // Cull the hands against the frustum of each view, and limit the rendering to the area that they cover.
+    bool isAnyViewVisible = false;
+    for (uint32_t k = 0; k < 2; k++)
+    {
+        const DirectX::XMMATRIX spaceToView = xr::math::LoadInvertedXrPose(m_eyePose[k]);
+        const xr::math::NearFar nearFar{ depthNear, depthFar };
+        const DirectX::XMMATRIX viewProjection = spaceToView * xr::math::ComposeProjectionMatrix(m_eyeFov[k], nearFar);
+        DirectX::XMStoreFloat4x4(&m_viewProjection[k], viewProjection);
+
+        XrRect2Di viewBounds{};
+        for (uint32_t side = 0; side < 2; side++)
+        {
+            XrRect2Di handBounds;
+            if (HandBounds::Project(m_joints.bounds[side], viewProjection, imageRect, handBounds))
+            {
+                viewBounds = HandBounds::Union(viewBounds, handBounds);
+            }
+        }
+
+        m_viewBounds[k] = viewBounds;
+        isAnyViewVisible = isAnyViewVisible || !HandBounds::IsEmpty(viewBounds);
+    }
+    if (!isAnyViewVisible)
+    {
+        return;
+    }
+
+    // StateObject falls back to SaveRestore on devices that don't support ID3D11Device1.
+    const Isolation isolation = m_isolation == Isolation::StateObject && !m_stateObject ? Isolation::SaveRestore : m_isolation;
+    switch (isolation)
+    {
+    case Isolation::StateObject:
+    {
+        ComPtr<ID3DDeviceContextState> applicationState;
+        m_deviceContext1->SwapDeviceContextState(m_stateObject.Get(), applicationState.GetAddressOf());
+        RecordHands(m_deviceContext.Get(), rtv, dsv, imageRect, isVPRT, clearDepthBuffer, depthNear, depthFar);
+        m_deviceContext1->SwapDeviceContextState(applicationState.Get(), nullptr);
+        break;
+    }
+
+    case Isolation::SaveRestore:
+    {
+        SavedPipelineState applicationState;
+        applicationState.Save(m_deviceContext.Get());
+        RecordHands(m_deviceContext.Get(), rtv, dsv, imageRect, isVPRT, clearDepthBuffer, depthNear, depthFar);
+        applicationState.Restore(m_deviceContext.Get());
+        break;
+    }
+
+    case Isolation::DeferredContext:
+    default:
+    {
+        // The deferred context state is reset by FinishCommandList() below.
+        RecordHands(m_deferredContext.Get(), rtv, dsv, imageRect, isVPRT, clearDepthBuffer, depthNear, depthFar);
 
-    deferredContext->ClearState();
+        // Execute the commands now.
+        ComPtr<ID3D11CommandList> commandList;
+        CHECK_HRCMD(m_deferredContext->FinishCommandList(FALSE, commandList.GetAddressOf()));
+
+        m_deviceContext->ExecuteCommandList(commandList.Get(), TRUE);
+        break;
+    }
+    }
+}
+
+void HandRenderer::RecordHands(
+    ID3D11DeviceContext* context,
+    ID3D11RenderTargetView* const rtv[2],
+    ID3D11DepthStencilView* const dsv[2],
+    XrRect2Di imageRect,
+    bool isVPRT,
+    bool clearDepthBuffer,
+    float depthNear,
+    float depthFar)
+{
+    // Upload the model transforms for all the joints of both hands at once.
+    {
+        D3D11_MAPPED_SUBRESOURCE mappedJoints;
+        CHECK_HRCMD(context->Map(m_jointsBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedJoints));
+        memcpy(mappedJoints.pData, m_joints.models, sizeof(m_joints.models));
+        context->Unmap(m_jointsBuffer.Get(), 0);
+    }
 
     CD3D11_VIEWPORT viewport(
         (float)imageRect.offset.x, (float)imageRect.offset.y, (float)imageRect.extent.width, (float)imageRect.extent.height);
-	deferredContext->RSSetViewports(1, &viewport);
-    deferredContext->OMSetDepthStencilState(depthNear > depthFar ? m_reversedZDepthNoStencilTest.Get() : nullptr, 0);
+    context->RSSetViewports(1, &viewport);
+    ID3D11DepthStencilState* const depthStencilState = depthNear > depthFar ? m_reversedZDepthNoStencilTest.Get() : nullptr;
+    context->OMSetDepthStencilState(depthStencilState, 0);
+
+    // Reset the stages that we don't use, in case the application's state is inherited.
+    context->RSSetState(m_scissorRasterizerState.Get());
+    context->OMSetBlendState(nullptr, nullptr, 0xffffffff);
+    context->HSSetShader(nullptr, nullptr, 0);
+    context->DSSetShader(nullptr, nullptr, 0);
+    context->GSSetShader(nullptr, nullptr, 0);
 
     // Setup shaders.
-    ID3D11Buffer* const constantBuffers[] = { m_modelCBuffer.Get(), m_viewProjectionCBuffer.Get() };
-    deferredContext->VSSetConstantBuffers(0, (UINT)std::size(constantBuffers), constantBuffers);
-    deferredContext->VSSetShader(m_vertexShader.Get(), nullptr, 0);
-    deferredContext->PSSetShader(m_pixelShader.Get(), nullptr, 0);
+    ID3D11Buffer* const constantBuffers[] = { m_viewProjectionCBuffer.Get() };
+    context->VSSetConstantBuffers(0, (UINT)std::size(constantBuffers), constantBuffers);
+    ID3D11ShaderResourceView* const shaderResources[] = { m_jointsView.Get() };
+    context->VSSetShaderResources(0, (UINT)std::size(shaderResources), shaderResources);
+    context->VSSetShader(m_vertexShader.Get(), nullptr, 0);
+    context->PSSetShader(m_pixelShader.Get(), nullptr, 0);
 
     // Set cube primitive data.
     const UINT strides[] = { sizeof(CubeShader::Vertex) };
     const UINT offsets[] = { 0 };
     ID3D11Buffer* vertexBuffers[] = { m_cubeVertexBuffer.Get() };
-    deferredContext->IASetVertexBuffers(0, (UINT)std::size(vertexBuffers), vertexBuffers, strides, offsets);
-    deferredContext->IASetIndexBuffer(m_cubeIndexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
-    deferredContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    deferredContext->IASetInputLayout(m_inputLayout.Get());
+    context->IASetVertexBuffers(0, (UINT)std::size(vertexBuffers), vertexBuffers, strides, offsets);
+    context->IASetIndexBuffer(m_cubeIndexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
+    context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    context->IASetInputLayout(m_inputLayout.Get());
 
-    // Render each view.
+    // Render each view. With VPRT, a single draw covers both views, otherwise there is one draw per render target.
     for (uint32_t k = 0; k < (isVPRT ? 1u : 2u); k++)
     {
+        // Skip the views where no hand is visible. With VPRT, the scissor applies to both views.
+        const XrRect2Di bounds = isVPRT ? HandBounds::Union(m_viewBounds[0], m_viewBounds[1]) : m_viewBounds[k];
+        if (HandBounds::IsEmpty(bounds))
+        {
+            continue;
+        }
+        const D3D11_RECT scissor = {
+            bounds.offset.x, bounds.offset.y, bounds.offset.x + bounds.extent.width, bounds.offset.y + bounds.extent.height };
+        context->RSSetScissorRects(1, &scissor);
+
         CubeShader::ViewProjectionConstantBuffer viewProjectionCBufferData{};
         if (isVPRT)
         {
-            deferredContext->OMSetRenderTargets(1, rtv, dsv[0]);
-
+            // Set view projection matrix for each view, transpose for shader usage.
             for (uint32_t k = 0; k < 2; k++) {
-                const DirectX::XMMATRIX spaceToView = xr::math::LoadInvertedXrPose(m_eyePose[k]);
-                xr::math::NearFar nearFar{ depthNear, depthFar };
-                const DirectX::XMMATRIX projectionMatrix = xr::math::ComposeProjectionMatrix(m_eyeFov[k], nearFar);
-
-                // Set view projection matrix for each view, transpose for shader usage.
                 DirectX::XMStoreFloat4x4(&viewProjectionCBufferData.ViewProjection[k],
-                    DirectX::XMMatrixTranspose(spaceToView * projectionMatrix));
+                    DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&m_viewProjection[k])));
             }
-            deferredContext->UpdateSubresource(m_viewProjectionCBuffer.Get(), 0, nullptr, &viewProjectionCBufferData, 0, 0);
         }
         else
         {
-            deferredContext->OMSetRenderTargets(1, &rtv[k], dsv[k]);
-
-            const DirectX::XMMATRIX spaceToView = xr::math::LoadInvertedXrPose(m_eyePose[k]);
-            xr::math::NearFar nearFar{ depthNear, depthFar };
-            const DirectX::XMMATRIX projectionMatrix = xr::math::ComposeProjectionMatrix(m_eyeFov[k], nearFar);
-
             // Set view projection matrix for the first, transpose for shader usage.
             DirectX::XMStoreFloat4x4(&viewProjectionCBufferData.ViewProjection[0],
-                DirectX::XMMatrixTranspose(spaceToView * projectionMatrix));
-            deferredContext->UpdateSubresource(m_viewProjectionCBuffer.Get(), 0, nullptr, &viewProjectionCBufferData, 0, 0);
-
+                DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&m_viewProjection[k])));
         }
+        viewProjectionCBufferData.Color = m_color;
+        viewProjectionCBufferData.ClearDepth = depthNear > depthFar ? 0.f : 1.f;
+        context->UpdateSubresource(m_viewProjectionCBuffer.Get(), 0, nullptr, &viewProjectionCBufferData, 0, 0);
 
+        // There is no scissored clear for depth buffers: draw a triangle covering the viewport at the clear value
+        // instead, so that only the area covered by the hands is cleared.
+        ID3D11DepthStencilView* const depthStencil = dsv[isVPRT ? 0 : k];
         if (clearDepthBuffer)
         {
-            const float depthClearValue = depthNear > depthFar ? 0.f : 1.f;
-            deferredContext->ClearDepthStencilView(dsv[k], D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, depthClearValue, 0);
+            context->OMSetRenderTargets(0, nullptr, depthStencil);
+            context->OMSetDepthStencilState(m_depthClearState.Get(), 0);
+            context->IASetInputLayout(nullptr);
+            context->VSSetShader(m_clearVertexShader.Get(), nullptr, 0);
+            context->PSSetShader(nullptr, nullptr, 0);
+            context->DrawInstanced(3, isVPRT ? 2 : 1, 0, 0);
+
+            context->OMSetDepthStencilState(depthStencilState, 0);
+            context->IASetInputLayout(m_inputLayout.Get());
+            context->VSSetShader(m_vertexShader.Get(), nullptr, 0);
+            context->PSSetShader(m_pixelShader.Get(), nullptr, 0);
         }
+        context->OMSetRenderTargets(1, isVPRT ? rtv : &rtv[k], depthStencil);
 
-        // Render each joint for each hand.
-        for (uint32_t side = 0; side < 2; side++)
-        {
-            if (m_handResult[side] != XR_SUCCESS)
-            {
-                continue;
-            }
-
-            for (uint32_t i = 0; i < XR_HAND_JOINT_COUNT_EXT; i++)
-            {
-                if (!xr::math::Pose::IsPoseValid(m_jointLocations[side][i].locationFlags))
-                {
-                    continue;
-                }
-
-                // Compute and update the model transform for each cube, transpose for shader usage.
-                CubeShader::ModelConstantBuffer model;
-                const DirectX::XMMATRIX scaleMatrix = DirectX::XMMatrixScaling(
-                    m_jointLocations[side][i].radius, min(0.0025f, m_jointLocations[side][i].radius), max(0.015f, m_jointLocations[side][i].radius));
-                DirectX::XMStoreFloat4x4(&model.Model, DirectX::XMMatrixTranspose(scaleMatrix * xr::math::LoadXrPose(m_jointLocations[side][i].pose)));
-                deferredContext->UpdateSubresource(m_modelCBuffer.Get(), 0, nullptr, &model, 0, 0);
-
-                // Draw the cube.
-                deferredContext->DrawIndexedInstanced((UINT)std::size(CubeShader::c_cubeIndices), isVPRT ? 2 : 1, 0, 0, k);
-            }
-        }
+        // Draw the cubes for all the joints, the instances for the 2nd view follow the ones for the 1st view.
+        context->DrawIndexedInstanced((UINT)std::size(CubeShader::c_cubeIndices), CubeShader::JointsCount * (isVPRT ? 2 : 1), 0, 0, 0);
     }
-
-    // Execute the commands now.
-    ComPtr<ID3D11CommandList> commandList;
-    CHECK_HRCMD(deferredContext->FinishCommandList(FALSE, commandList.GetAddressOf()));
-
-    m_deviceContext->ExecuteCommandList(commandList.Get(), TRUE);
 }
@@ -2,36 +2,65 @@
 
 #include "pch.h"
 
+#include "HandBounds.h"
+#include "HandJointsCache.h"
+#include "SeqLock.h"
+
 using Microsoft::WRL::ComPtr;
 
 class HandRenderer
 {
 public:
+	// How the application's pipeline state is preserved while rendering the hands.
+	enum class Isolation
+	{
+		// Record into a deferred context, and execute the command list restoring the application's state. The most robust.
+		DeferredContext = 0,
+
+		// Render with our own state object (ID3DDeviceContextState) swapped in, which keeps our pipeline state across frames.
+		StateObject,
+
+		// Save and restore only the pipeline slots that we use.
+		SaveRestore,
+	};
+
 	HandRenderer()
 	{
 	}
 
+	~HandRenderer()
+	{
+		// Never block on the initialization at process exit.
+		if (m_initializationThread.joinable())
+		{
+			m_initializationThread.detach();
+		}
+	}
+
+	// The resources are created asynchronously, and the hands are not rendered until this completes.
 	void SetDevice(ComPtr<ID3D11Device> device);
 
+	// Whether the resources are created, so that the hands can be rendered.
+	bool IsReady() const
+	{
+		return m_state.load(std::memory_order_acquire) == State::Ready;
+	}
+
+	// The reason why the resources could not be created, or nullptr.
+	const char* GetInitializationError() const
+	{
+		return m_state.load(std::memory_order_acquire) == State::Failed ? m_initializationError.c_str() : nullptr;
+	}
+
+	// The skin tone is 0=bright to 3=darker. The opacity is not implemented yet.
 	void SetProperties(
 		const int skinTone,
-		const float opacity)
+		const float opacity);
+
+	// StateObject falls back to SaveRestore on devices that don't support ID3D11Device1.
+	void SetIsolation(Isolation isolation)
 	{
-		switch (skinTone)
-		{
-		case 0:
-			m_cubeVertexBuffer = m_cubeVertexBufferBright;
-			break;
-		case 1:
-			m_cubeVertexBuffer = m_cubeVertexBufferMedium;
-			break;
-		case 2:
-			m_cubeVertexBuffer = m_cubeVertexBufferDark;
-			break;
-		default:
-			m_cubeVertexBuffer = m_cubeVertexBufferDarker;
-			break;
-		}
+		m_isolation = isolation;
 	}
 
 	void SetEyePoses(
@@ -45,18 +74,34 @@ public:
 		}
 	}
 
+	// Use snapshots located in the space of the projection layer.
 	void SetJointsLocations(
-		const XrResult handResult[2],
-		const XrHandJointLocationEXT jointLocations[2][XR_HAND_JOINT_COUNT_EXT])
+		const HandJointsSnapshot* const hands[2])
 	{
-		for (int side = 0; side < 2; side++)
-		{
-			m_handResult[side] = handResult[side];
-			for (uint32_t i = 0; i < XR_HAND_JOINT_COUNT_EXT; i++)
-			{
-				m_jointLocations[side][i] = jointLocations[side][i];
-			}
-		}
+		ComputeJoints(hands, 0, xr::math::Pose::Identity(), m_joints);
+	}
+
+	// Compute the joints ahead of the frame submission, typically from a worker thread. The snapshots are located in a
+	// base space, whose pose in the space of the projection layer is given. The projection layer space is identified by
+	// a non-zero generation chosen by the caller, so that a space handle being reused cannot match stale joints.
+	void PrepareJoints(
+		const HandJointsSnapshot* const hands[2],
+		uint64_t layerSpaceGeneration,
+		const XrPosef& baseInLayer)
+	{
+		Joints joints;
+		ComputeJoints(hands, layerSpaceGeneration, baseInLayer, joints);
+		m_preparedJoints.Write(joints);
+	}
+
+	// Use the joints from PrepareJoints(), if they were computed for this projection layer space generation and time.
+	// Otherwise SetJointsLocations() must be called.
+	bool UsePreparedJoints(
+		uint64_t layerSpaceGeneration,
+		XrTime time)
+	{
+		return m_preparedJoints.Read(m_joints) && m_joints.layerSpaceGeneration == layerSpaceGeneration &&
+			m_joints.time == time;
 	}
 
 	void RenderHands(
@@ -69,24 +114,78 @@ public:
 		float depthFar);
 
 private:
+	enum class State
+	{
+		Uninitialized,
+		Initializing,
+		Ready,
+		Failed,
+	};
+
+	// The model transforms for all the joints of both hands, transposed for shader usage.
+	struct Joints
+	{
+		uint64_t layerSpaceGeneration;
+		XrTime time;
+		bool isAnyValid;
+
+		DirectX::XMFLOAT4X4 models[2 * XR_HAND_JOINT_COUNT_EXT];
+
+		// The bounds of each hand, in the space of the projection layer.
+		HandBounds::Sphere bounds[2];
+	};
+
+	static void ComputeJoints(
+		const HandJointsSnapshot* const hands[2],
+		uint64_t layerSpaceGeneration,
+		const XrPosef& baseInLayer,
+		Joints& joints);
+
+	void Initialize();
+	void CreateResources();
+
+	// Set all the pipeline state and draw.
+	void RecordHands(
+		ID3D11DeviceContext* context,
+		ID3D11RenderTargetView* const rtv[2],
+		ID3D11DepthStencilView* const dsv[2],
+		XrRect2Di imageRect,
+		bool isVPRT,
+		bool clearDepthBuffer,
+		float depthNear,
+		float depthFar);
+
 	ComPtr<ID3D11Device> m_device;
 	ComPtr<ID3D11DeviceContext> m_deviceContext;
+	ComPtr<ID3D11DeviceContext> m_deferredContext;
+	ComPtr<ID3D11DeviceContext1> m_deviceContext1;
+	ComPtr<ID3DDeviceContextState> m_stateObject;
+	Isolation m_isolation{ Isolation::DeferredContext };
+
+	std::thread m_initializationThread;
+	std::atomic<State> m_state{ State::Uninitialized };
+	std::string m_initializationError;
 
 	ComPtr<ID3D11VertexShader> m_vertexShader;
+	ComPtr<ID3D11VertexShader> m_clearVertexShader;
 	ComPtr<ID3D11PixelShader> m_pixelShader;
-	ComPtr<ID3D11Buffer> m_modelCBuffer;
+	ComPtr<ID3D11Buffer> m_jointsBuffer;
+	ComPtr<ID3D11ShaderResourceView> m_jointsView;
 	ComPtr<ID3D11Buffer> m_viewProjectionCBuffer;
 	ComPtr<ID3D11InputLayout> m_inputLayout;
-	ComPtr<ID3D11Buffer> m_cubeVertexBufferBright;
-	ComPtr<ID3D11Buffer> m_cubeVertexBufferMedium;
-	ComPtr<ID3D11Buffer> m_cubeVertexBufferDark;
-	ComPtr<ID3D11Buffer> m_cubeVertexBufferDarker;
 	ComPtr<ID3D11Buffer> m_cubeVertexBuffer;
 	ComPtr<ID3D11Buffer> m_cubeIndexBuffer;
 	ComPtr<ID3D11DepthStencilState> m_reversedZDepthNoStencilTest;
+	ComPtr<ID3D11DepthStencilState> m_depthClearState;
+	ComPtr<ID3D11RasterizerState> m_scissorRasterizerState;
 
+	XrVector3f m_color{};
 	XrPosef m_eyePose[2];
 	XrFovf m_eyeFov[2];
-	XrResult m_handResult[2];
-	XrHandJointLocationEXT m_jointLocations[2][XR_HAND_JOINT_COUNT_EXT];
+
+	// Computed by RenderHands() for each view.
+	DirectX::XMFLOAT4X4 m_viewProjection[2];
+	XrRect2Di m_viewBounds[2];
+	Joints m_joints{};
+	SeqLock<Joints> m_preparedJoints;
 };
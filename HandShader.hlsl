@@ -0,0 +1,60 @@
+// This is all stolen from https://github.com/microsoft/OpenXR-MixedReality/blob/main/samples/BasicXrApp/CubeGraphics.cpp
+//
+// Original copyright and license:
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Compiled at build time into HandShaderVS.h, HandShaderPS.h and HandShaderClearVS.h, and embedded as a resource for runtime compilation when
+// the device does not accept the prebuilt bytecode (see HandRenderer.cpp).
+
+struct VSOutput {
+    float4 Pos : SV_POSITION;
+    float3 Color : COLOR0;
+    uint viewId : SV_RenderTargetArrayIndex;
+};
+struct VSInput {
+    float3 Pos : POSITION;
+    uint instId : SV_InstanceID;
+};
+// The model transform of each joint, all zeroes for the joints that are not tracked, which collapses their cube.
+StructuredBuffer<float4x4> Joints : register(t0);
+cbuffer ViewProjectionConstantBuffer : register(b0) {
+    float4x4 ViewProjection[2];
+    float3 Color;
+    float ClearDepth;
+};
+
+// Both hands (see CubeShader::JointsCount).
+static const uint JointsCount = 52;
+
+VSOutput MainVS(VSInput input) {
+    const float4x4 model = Joints[input.instId % JointsCount];
+    const uint viewId = input.instId / JointsCount;
+
+    VSOutput output;
+    output.Pos = mul(mul(float4(input.Pos, 1), model), ViewProjection[viewId]);
+    output.Color = Color;
+    output.viewId = viewId;
+    return output;
+}
+
+float4 MainPS(VSOutput input) : SV_TARGET {
+    return float4(input.Color, 1);
+}
+
+// A fullscreen triangle at the depth clear value, one instance per view. There is no scissored clear for depth buffers,
+// so this is drawn without pixel shader under the scissor instead.
+struct ClearVSOutput {
+    float4 Pos : SV_POSITION;
+    uint viewId : SV_RenderTargetArrayIndex;
+};
+
+ClearVSOutput ClearVS(uint vertexId : SV_VertexID, uint instId : SV_InstanceID) {
+    const float2 uv = float2((float)((vertexId << 1) & 2), (float)(vertexId & 2));
+
+    ClearVSOutput output;
+    output.Pos = float4(uv * float2(2, -2) + float2(-1, 1), ClearDepth, 1);
+    output.viewId = instId;
+    return output;
+}
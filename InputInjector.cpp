@@ -0,0 +1,198 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "pch.h"
+
+#include "InputInjector.h"
+
+void SendInputSink::SendKey(
+    uint16_t virtualKey,
+    bool isPressed)
+{
+    INPUT input;
+    ZeroMemory(&input, sizeof(INPUT));
+    input.type = INPUT_KEYBOARD;
+    input.ki.wVk = virtualKey;
+    input.ki.dwFlags = isPressed ? 0 : KEYEVENTF_KEYUP;
+    SendInput(1, &input, sizeof(INPUT));
+}
+
+void InputInjector::Start(InputSink* sink)
+{
+    if (m_thread.joinable())
+    {
+        return;
+    }
+
+    if (!m_wakeUpEvent)
+    {
+        m_wakeUpEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+    }
+    m_sink = sink;
+    m_isStopping = false;
+    m_thread = std::thread(&InputInjector::ThreadProc, this);
+}
+
+void InputInjector::Stop()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+
+    m_isStopping = true;
+    SetEvent(m_wakeUpEvent);
+    m_thread.join();
+}
+
+bool InputInjector::Push(
+    uint16_t virtualKey,
+    bool isPressed)
+{
+    const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+    {
+        m_droppedCount++;
+        return false;
+    }
+
+    m_events[tail % Capacity] = { virtualKey, isPressed };
+    m_tail.store(tail + 1, std::memory_order_release);
+    SetEvent(m_wakeUpEvent);
+
+    return true;
+}
+
+void InputInjector::ThreadProc()
+{
+    DWORD timeout = INFINITE;
+    while (true)
+    {
+        WaitForSingleObject(m_wakeUpEvent, timeout);
+        if (m_isStopping)
+        {
+            break;
+        }
+
+        const uint64_t now = GetTickCount64();
+
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        const uint32_t tail = m_tail.load(std::memory_order_acquire);
+        while (head != tail)
+        {
+            ProcessEvent(m_events[head % Capacity], now);
+            head++;
+        }
+        m_head.store(head, std::memory_order_release);
+
+        timeout = ProcessRepeats(now);
+    }
+
+    // Never leave a key pressed behind us.
+    for (uint32_t virtualKey = 0; virtualKey < KeysCount; virtualKey++)
+    {
+        if (m_isDown[virtualKey])
+        {
+            Send(static_cast<uint16_t>(virtualKey), false);
+        }
+        m_holdCount[virtualKey] = 0;
+    }
+
+    // Discard the transitions that were not processed.
+    m_head.store(m_tail.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+void InputInjector::ProcessEvent(
+    const KeyEvent& event,
+    uint64_t now)
+{
+    const uint16_t virtualKey = event.virtualKey % KeysCount;
+
+    if (event.isPressed)
+    {
+        // Only the first action holding the key presses it.
+        if (m_holdCount[virtualKey]++)
+        {
+            return;
+        }
+
+        if (now / 1000 != m_rateSecond)
+        {
+            m_rateSecond = now / 1000;
+            m_ratePresses = 0;
+        }
+        if (m_ratePresses >= m_maxPressRate.load(std::memory_order_relaxed))
+        {
+            m_rateLimitedCount++;
+            return;
+        }
+        m_ratePresses++;
+
+        Send(virtualKey, true);
+        m_nextRepeat[virtualKey] = now + m_repeatDelayMs.load(std::memory_order_relaxed);
+    }
+    else
+    {
+        // Only the last action holding the key releases it. Releases without a press are ignored.
+        if (!m_holdCount[virtualKey] || --m_holdCount[virtualKey])
+        {
+            return;
+        }
+
+        if (m_isDown[virtualKey])
+        {
+            Send(virtualKey, false);
+        }
+    }
+}
+
+DWORD InputInjector::ProcessRepeats(uint64_t now)
+{
+    const uint32_t delay = m_repeatDelayMs.load(std::memory_order_relaxed);
+    if (!delay)
+    {
+        return INFINITE;
+    }
+    const uint32_t interval = m_repeatIntervalMs.load(std::memory_order_relaxed);
+
+    uint64_t nextRepeat = UINT64_MAX;
+    for (uint32_t virtualKey = 0; virtualKey < KeysCount; virtualKey++)
+    {
+        if (!m_isDown[virtualKey])
+        {
+            continue;
+        }
+
+        if (m_nextRepeat[virtualKey] <= now)
+        {
+            Send(static_cast<uint16_t>(virtualKey), true);
+            m_nextRepeat[virtualKey] = now + interval;
+        }
+        nextRepeat = min(nextRepeat, m_nextRepeat[virtualKey]);
+    }
+
+    return nextRepeat != UINT64_MAX ? static_cast<DWORD>(nextRepeat - now) : INFINITE;
+}
+
+void InputInjector::Send(
+    uint16_t virtualKey,
+    bool isPressed)
+{
+    m_sink->SendKey(virtualKey, isPressed);
+    m_isDown[virtualKey] = isPressed;
+    m_sentCount++;
+}
@@ -0,0 +1,146 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include "pch.h"
+
+// Where the keyboard input is sent to. Tests or tools may substitute their own sink to record the input.
+class InputSink
+{
+public:
+    virtual ~InputSink() = default;
+
+    virtual void SendKey(
+        uint16_t virtualKey,
+        bool isPressed) = 0;
+};
+
+// Send the input to the foreground application with SendInput().
+class SendInputSink : public InputSink
+{
+public:
+    void SendKey(
+        uint16_t virtualKey,
+        bool isPressed) override;
+};
+
+// Inject the keyboard input derived from the actions, without ever blocking the caller on the OS.
+//
+// The key transitions are pushed into a lock-free single-producer/single-consumer queue, and a background thread sends
+// them to the sink. The background thread pairs the presses and releases: a key bound to several actions is pressed by
+// the first one and released by the last one, and all the keys still pressed are released when stopping. It also
+// applies the key repeat and limits the rate of the presses.
+class InputInjector
+{
+public:
+    ~InputInjector()
+    {
+        // Joining is not possible while our DLL is being unloaded.
+        if (m_thread.joinable())
+        {
+            m_thread.detach();
+        }
+    }
+
+    // The background thread must be stopped before our DLL is unloaded.
+    void Start(InputSink* sink);
+    void Stop();
+
+    // A delay of 0 disables the key repeat.
+    void SetRepeat(
+        uint32_t delayMs,
+        uint32_t intervalMs)
+    {
+        m_repeatDelayMs.store(delayMs, std::memory_order_relaxed);
+        m_repeatIntervalMs.store(max(intervalMs, 1u), std::memory_order_relaxed);
+    }
+
+    // The maximum number of key presses per second. The releases are never limited.
+    void SetMaxPressRate(uint32_t pressesPerSecond)
+    {
+        m_maxPressRate.store(pressesPerSecond, std::memory_order_relaxed);
+    }
+
+    // Must always be called from the same thread. Returns false if the queue is full, in which case the caller should
+    // push the transition again later.
+    bool Push(
+        uint16_t virtualKey,
+        bool isPressed);
+
+    uint64_t GetSentCount() const
+    {
+        return m_sentCount.load();
+    }
+
+    uint64_t GetDroppedCount() const
+    {
+        return m_droppedCount.load();
+    }
+
+    uint64_t GetRateLimitedCount() const
+    {
+        return m_rateLimitedCount.load();
+    }
+
+private:
+    static constexpr uint32_t Capacity = 64;
+    static constexpr uint32_t KeysCount = 256;
+
+    struct KeyEvent
+    {
+        uint16_t virtualKey;
+        bool isPressed;
+    };
+
+    void ThreadProc();
+    void ProcessEvent(
+        const KeyEvent& event,
+        uint64_t now);
+
+    // Returns the time until the next repeat is due, or INFINITE.
+    DWORD ProcessRepeats(uint64_t now);
+
+    void Send(
+        uint16_t virtualKey,
+        bool isPressed);
+
+    std::thread m_thread;
+    HANDLE m_wakeUpEvent{ nullptr };
+    std::atomic<bool> m_isStopping{ false };
+    InputSink* m_sink{ nullptr };
+
+    // The queue. m_tail is only written by the producer, m_head only by the background thread.
+    KeyEvent m_events[Capacity];
+    std::atomic<uint32_t> m_head{ 0 };
+    std::atomic<uint32_t> m_tail{ 0 };
+
+    std::atomic<uint32_t> m_repeatDelayMs{ 0 };
+    std::atomic<uint32_t> m_repeatIntervalMs{ 50 };
+    std::atomic<uint32_t> m_maxPressRate{ 20 };
+
+    // Only accessed by the background thread.
+    uint8_t m_holdCount[KeysCount]{};
+    bool m_isDown[KeysCount]{};
+    uint64_t m_nextRepeat[KeysCount]{};
+    uint64_t m_rateSecond{ 0 };
+    uint32_t m_ratePresses{ 0 };
+
+    std::atomic<uint64_t> m_sentCount{ 0 };
+    std::atomic<uint64_t> m_droppedCount{ 0 };
+    std::atomic<uint64_t> m_rateLimitedCount{ 0 };
+};
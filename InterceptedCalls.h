@@ -0,0 +1,59 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pch.h"
+
+#include "ConfigSchema.h"
+
+// The calls handled by our layer, as X(xrCall, requiresConfig). xrDestroyInstance() is always needed to stop our
+// threads, even when the layer is not configured for the application.
+#define INTERCEPTED_CALLS(X)                        \
+    X(xrDestroyInstance, false)                     \
+    X(xrWaitFrame, true)                            \
+    X(xrBeginFrame, true)                           \
+    X(xrCreateSession, true)                        \
+    X(xrDestroySession, true)                       \
+    X(xrPollEvent, true)                            \
+    X(xrGetCurrentInteractionProfile, true)         \
+    X(xrSuggestInteractionProfileBindings, true)    \
+    X(xrCreateActionSpace, true)                    \
+    X(xrDestroySpace, true)                         \
+    X(xrLocateSpace, true)                          \
+    X(xrSyncActions, true)                          \
+    X(xrGetActionStateBoolean, true)                \
+    X(xrGetActionStateFloat, true)                  \
+    X(xrGetActionStatePose, true)                   \
+    X(xrCreateSwapchain, true)                      \
+    X(xrDestroySwapchain, true)                     \
+    X(xrEnumerateSwapchainImages, true)             \
+    X(xrAcquireSwapchainImage, true)                \
+    X(xrEndFrame, true)
+
+#define INTERCEPTED_CALL_NAME(xrCall, requiresConfig) #xrCall,
+inline constexpr std::string_view InterceptedCallNames[] = { INTERCEPTED_CALLS(INTERCEPTED_CALL_NAME) };
+#undef INTERCEPTED_CALL_NAME
+
+// Resolve a name to its index in InterceptedCallNames without any string allocation or comparison loop.
+inline constexpr auto InterceptedCallsHash = ConfigSchema::MakePerfectHash<64>(InterceptedCallNames);
+
+// The index of a call in InterceptedCallNames, or -1 if our layer does not handle it.
+inline int FindInterceptedCall(const char* const name)
+{
+    const int index = InterceptedCallsHash.Lookup(name);
+    return index >= 0 && InterceptedCallNames[index] == name ? index : -1;
+}
@@ -0,0 +1,263 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include "Logger.h"
+
+Logger::Logger()
+{
+    for (uint32_t i = 0; i < Capacity; i++)
+    {
+        m_messages[i].sequence = i;
+    }
+    for (auto& limit : m_rateLimits)
+    {
+        limit.fmt = nullptr;
+        limit.second = 0;
+        limit.count = 0;
+        limit.suppressed = 0;
+    }
+
+#ifdef _DEBUG
+    m_isDebugEnabled = true;
+#endif
+}
+
+void Logger::Open(const std::string& path)
+{
+    std::unique_lock lock(m_streamMutex);
+    m_stream.open(path, std::ios_base::ate);
+}
+
+void Logger::Start()
+{
+    if (m_thread.joinable())
+    {
+        return;
+    }
+
+    if (!m_wakeUpEvent)
+    {
+        m_wakeUpEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+    }
+    m_isStopping = false;
+    m_thread = std::thread(&Logger::ThreadProc, this);
+    m_isRunning = true;
+}
+
+void Logger::Stop()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+
+    // New messages are written synchronously from now on.
+    m_isRunning = false;
+    m_isStopping = true;
+    SetEvent(m_wakeUpEvent);
+    m_thread.join();
+
+    // Pick up the messages enqueued while we were stopping.
+    Drain();
+}
+
+void Logger::Write(
+    const char* fmt,
+    va_list va,
+    bool isRateLimited)
+{
+    const char* suppressedFmt = nullptr;
+    uint32_t suppressedCount = 0;
+    if (isRateLimited && !CheckRateLimit(fmt, suppressedFmt, suppressedCount))
+    {
+        m_suppressedCount++;
+        return;
+    }
+
+    if (!m_isRunning)
+    {
+        char text[sizeof(Message::text)];
+        std::unique_lock lock(m_streamMutex);
+        if (suppressedCount)
+        {
+            snprintf(text, sizeof(text), "Suppressed %u message(s) like: %s", suppressedCount, suppressedFmt);
+            WriteToFile(std::time(nullptr), text);
+        }
+        _vsnprintf_s(text, sizeof(text), sizeof(text) - 1, fmt, va);
+        WriteToFile(std::time(nullptr), text);
+        m_stream.flush();
+        m_writtenCount++;
+        return;
+    }
+
+    if (suppressedCount && !Enqueue("Suppressed %u message(s) like: %s", suppressedCount, suppressedFmt))
+    {
+        m_droppedCount++;
+    }
+    if (!Enqueue(fmt, va))
+    {
+        m_droppedCount++;
+    }
+    SetEvent(m_wakeUpEvent);
+}
+
+Logger::RateLimit& Logger::GetRateLimit(const char* fmt)
+{
+    // The formats are string literals, so we can identify them by address. Each format claims its own slot, probing
+    // from the slot its address hashes to.
+    const uintptr_t address = reinterpret_cast<uintptr_t>(fmt);
+    const uint32_t home = ((address >> 4) ^ (address >> 12)) % RateLimitSlots;
+    for (uint32_t i = 0; i < RateLimitSlots; i++)
+    {
+        RateLimit& limit = m_rateLimits[(home + i) % RateLimitSlots];
+        const char* owner = limit.fmt.load(std::memory_order_relaxed);
+        if (owner == fmt || (!owner && (limit.fmt.compare_exchange_strong(owner, fmt, std::memory_order_relaxed) || owner == fmt)))
+        {
+            return limit;
+        }
+    }
+
+    // All the slots are claimed: share the first one.
+    return m_rateLimits[home];
+}
+
+bool Logger::CheckRateLimit(
+    const char* fmt,
+    const char*& suppressedFmt,
+    uint32_t& suppressedCount)
+{
+    RateLimit& limit = GetRateLimit(fmt);
+
+    // Start a new period every second.
+    suppressedCount = 0;
+    const uint64_t second = GetTickCount64() / 1000;
+    uint64_t previousSecond = limit.second.load(std::memory_order_relaxed);
+    if (previousSecond != second && limit.second.compare_exchange_strong(previousSecond, second, std::memory_order_relaxed))
+    {
+        suppressedFmt = limit.fmt.load(std::memory_order_relaxed);
+        suppressedCount = limit.suppressed.exchange(0, std::memory_order_relaxed);
+        limit.count.store(0, std::memory_order_relaxed);
+    }
+
+    if (limit.count.fetch_add(1, std::memory_order_relaxed) >= MaxMessagesPerSecond)
+    {
+        limit.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+bool Logger::Enqueue(
+    const char* fmt,
+    va_list va)
+{
+    // Claim a message slot. Each slot's sequence tells whether it is free for the position we want to write.
+    uint64_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+    Message* message;
+    while (true)
+    {
+        message = &m_messages[position % Capacity];
+        const int64_t difference = static_cast<int64_t>(message->sequence.load(std::memory_order_acquire) - position);
+        if (difference == 0)
+        {
+            if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // The ring is full.
+            return false;
+        }
+        else
+        {
+            position = m_enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    message->time = std::time(nullptr);
+    _vsnprintf_s(message->text, sizeof(message->text), sizeof(message->text) - 1, fmt, va);
+
+    // Hand over the slot to the background thread.
+    message->sequence.store(position + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool Logger::Enqueue(const char* fmt, ...)
+{
+    va_list va;
+    va_start(va, fmt);
+    const bool result = Enqueue(fmt, va);
+    va_end(va);
+    return result;
+}
+
+void Logger::WriteToFile(
+    std::time_t time,
+    const char* text)
+{
+    char buf[sizeof(Message::text) + 32];
+    const size_t offset = std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S %z: ", std::localtime(&time));
+    snprintf(buf + offset, sizeof(buf) - offset, "%s", text);
+    OutputDebugStringA(buf);
+    if (m_stream.is_open())
+    {
+        m_stream << buf;
+    }
+}
+
+void Logger::ThreadProc()
+{
+    while (!m_isStopping)
+    {
+        WaitForSingleObject(m_wakeUpEvent, INFINITE);
+        Drain();
+    }
+}
+
+void Logger::Drain()
+{
+    std::unique_lock lock(m_streamMutex);
+
+    bool hasWritten = false;
+    while (true)
+    {
+        Message& message = m_messages[m_dequeuePosition % Capacity];
+        if (message.sequence.load(std::memory_order_acquire) != m_dequeuePosition + 1)
+        {
+            break;
+        }
+
+        WriteToFile(message.time, message.text);
+
+        // Give the slot back to the writers, for when they wrap around.
+        message.sequence.store(m_dequeuePosition + Capacity, std::memory_order_release);
+        m_dequeuePosition++;
+        m_writtenCount++;
+        hasWritten = true;
+    }
+
+    // Flush once per batch rather than once per message.
+    if (hasWritten)
+    {
+        m_stream.flush();
+    }
+}
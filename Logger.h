@@ -0,0 +1,145 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pch.h"
+
+// The log file writer. Messages are formatted by the caller into a fixed-size ring, and a background thread adds the
+// timestamps and does all the I/O, so logging never blocks an XR call on the file system.
+//
+// Each message format is rate-limited, to avoid flooding the log with messages emitted every frame. When the ring is
+// full, messages are dropped and counted.
+class Logger
+{
+public:
+    // The number of messages with the same format accepted per second.
+    static constexpr uint32_t MaxMessagesPerSecond = 10;
+
+    Logger();
+
+    ~Logger()
+    {
+        // Joining is not possible while our DLL is being unloaded.
+        if (m_thread.joinable())
+        {
+            m_thread.detach();
+        }
+    }
+
+    void Open(const std::string& path);
+
+    // The background thread must be stopped before our DLL is unloaded. Until it is started, messages are written
+    // synchronously.
+    void Start();
+    void Stop();
+
+    bool IsOpen() const
+    {
+        return m_stream.is_open();
+    }
+
+    // Debug messages are not rate-limited, since they trace every call.
+    void Write(
+        const char* fmt,
+        va_list va,
+        bool isRateLimited = true);
+
+    bool IsDebugEnabled() const
+    {
+        return m_isDebugEnabled.load(std::memory_order_relaxed);
+    }
+
+    void SetDebugEnabled(bool enabled)
+    {
+        m_isDebugEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    uint64_t GetWrittenCount() const
+    {
+        return m_writtenCount.load();
+    }
+
+    uint64_t GetDroppedCount() const
+    {
+        return m_droppedCount.load();
+    }
+
+    uint64_t GetSuppressedCount() const
+    {
+        return m_suppressedCount.load();
+    }
+
+private:
+    static constexpr uint32_t Capacity = 256;
+    static constexpr uint32_t RateLimitSlots = 64;
+
+    struct Message
+    {
+        std::atomic<uint64_t> sequence;
+        std::time_t time;
+        char text[500];
+    };
+
+    // The rate limit of a message format. The slot is claimed by the first format landing on it, and never released.
+    struct RateLimit
+    {
+        std::atomic<const char*> fmt;
+        std::atomic<uint64_t> second;
+        std::atomic<uint32_t> count;
+        std::atomic<uint32_t> suppressed;
+    };
+
+    RateLimit& GetRateLimit(const char* fmt);
+
+    // Returns false if the message must be suppressed. Otherwise, returns the number of messages with the same format
+    // that were suppressed since the last accepted one.
+    bool CheckRateLimit(
+        const char* fmt,
+        const char*& suppressedFmt,
+        uint32_t& suppressedCount);
+
+    bool Enqueue(
+        const char* fmt,
+        va_list va);
+    bool Enqueue(const char* fmt, ...);
+
+    void WriteToFile(
+        std::time_t time,
+        const char* text);
+
+    void ThreadProc();
+    void Drain();
+
+    std::ofstream m_stream;
+    std::mutex m_streamMutex;
+
+    std::thread m_thread;
+    HANDLE m_wakeUpEvent{ nullptr };
+    std::atomic<bool> m_isRunning{ false };
+    std::atomic<bool> m_isStopping{ false };
+
+    Message m_messages[Capacity];
+    std::atomic<uint64_t> m_enqueuePosition{ 0 };
+    uint64_t m_dequeuePosition{ 0 };
+
+    RateLimit m_rateLimits[RateLimitSlots];
+
+    std::atomic<bool> m_isDebugEnabled{ false };
+    std::atomic<uint64_t> m_writtenCount{ 0 };
+    std::atomic<uint64_t> m_droppedCount{ 0 };
+    std::atomic<uint64_t> m_suppressedCount{ 0 };
+};
@@ -0,0 +1,265 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include "ConfigSchema.h"
+#include "ProfileStore.h"
+
+namespace {
+    int64_t GetWriteTime(
+        const std::filesystem::path& path)
+    {
+        std::error_code error;
+        const auto writeTime = std::filesystem::last_write_time(path, error);
+        return error ? -1 : static_cast<int64_t>(writeTime.time_since_epoch().count());
+    }
+
+    // The file system is case-insensitive, so are the profile names.
+    std::string ToLower(
+        std::string name)
+    {
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return name;
+    }
+}
+
+void ProfileStore::Open(
+    const std::filesystem::path& storePath,
+    const std::filesystem::path& sourceDirectory,
+    uint32_t schemaHash,
+    CompileFunction compile)
+{
+    Close();
+
+    m_storePath = storePath;
+    // Like the rest of the layer, fall back to the current working directory.
+    m_sourceDirectory = !sourceDirectory.empty() ? sourceDirectory : std::filesystem::path(".");
+    m_schemaHash = schemaHash;
+    m_compile = std::move(compile);
+
+    if (!Map() || !IsValid())
+    {
+        Rebuild();
+    }
+}
+
+void ProfileStore::Close()
+{
+    Unmap();
+    m_image.clear();
+    m_rebuiltFor.clear();
+}
+
+bool ProfileStore::Find(
+    const std::string& name,
+    std::string_view& data)
+{
+    // The .cfg file remains the reference: a profile without one is not used, even if it is still in the store.
+    const int64_t sourceWriteTime = GetWriteTime(m_sourceDirectory / std::filesystem::path(name + ".cfg"));
+    if (sourceWriteTime < 0)
+    {
+        return false;
+    }
+
+    const std::string foldedName = ToLower(name);
+    const Entry* entry = FindEntry(foldedName);
+    if (!entry || entry->sourceWriteTime != sourceWriteTime)
+    {
+        // Only rebuild once for a given version of the .cfg file, even if the profile still cannot be compiled.
+        const auto rebuilt = m_rebuiltFor.find(foldedName);
+        if (rebuilt == m_rebuiltFor.cend() || rebuilt->second != sourceWriteTime)
+        {
+            Rebuild();
+            m_rebuiltFor.insert_or_assign(foldedName, sourceWriteTime);
+            entry = FindEntry(foldedName);
+        }
+        if (!entry)
+        {
+            return false;
+        }
+    }
+
+    data = std::string_view(reinterpret_cast<const char*>(m_view + entry->dataOffset), entry->dataSize);
+    return true;
+}
+
+bool ProfileStore::Map()
+{
+    Unmap();
+
+    m_file = CreateFileA(m_storePath.string().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size;
+    if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(Header)))
+    {
+        Unmap();
+        return false;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    m_view = m_mapping ? reinterpret_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    if (!m_view)
+    {
+        Unmap();
+        return false;
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+
+    return true;
+}
+
+void ProfileStore::Unmap()
+{
+    // When serving from m_image, there is no mapping.
+    if (m_mapping && m_view)
+    {
+        UnmapViewOfFile(m_view);
+    }
+    m_view = nullptr;
+    m_size = 0;
+    if (m_mapping)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool ProfileStore::IsValid() const
+{
+    const Header* header = reinterpret_cast<const Header*>(m_view);
+    if (header->magic != Magic || header->version != Version || header->schemaHash != m_schemaHash ||
+        m_size < sizeof(Header) + header->profilesCount * sizeof(Entry))
+    {
+        return false;
+    }
+
+    const Entry* entries = reinterpret_cast<const Entry*>(m_view + sizeof(Header));
+    for (uint32_t i = 0; i < header->profilesCount; i++)
+    {
+        if (static_cast<uint64_t>(entries[i].nameOffset) + entries[i].nameSize > m_size ||
+            static_cast<uint64_t>(entries[i].dataOffset) + entries[i].dataSize > m_size)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ProfileStore::Rebuild()
+{
+    struct Profile
+    {
+        std::string name;
+        std::string data;
+        int64_t sourceWriteTime;
+    };
+    std::vector<Profile> profiles;
+
+    std::error_code error;
+    for (const auto& file : std::filesystem::directory_iterator(m_sourceDirectory, error))
+    {
+        if (ToLower(file.path().extension().string()) != ".cfg")
+        {
+            continue;
+        }
+
+        std::ifstream source(file.path());
+        if (source.is_open())
+        {
+            Profile profile;
+            profile.name = ToLower(file.path().stem().string());
+            profile.sourceWriteTime = GetWriteTime(file.path());
+            profile.data = m_compile(profile.name, source);
+            profiles.push_back(std::move(profile));
+        }
+    }
+
+    std::sort(profiles.begin(), profiles.end(), [](const Profile& a, const Profile& b) {
+        return ConfigSchema::Hash(a.name) < ConfigSchema::Hash(b.name);
+    });
+
+    // Lay out the header, the index, then the names and data.
+    std::vector<uint8_t> image(sizeof(Header) + profiles.size() * sizeof(Entry));
+    Header* header = reinterpret_cast<Header*>(image.data());
+    header->magic = Magic;
+    header->version = Version;
+    header->schemaHash = m_schemaHash;
+    header->profilesCount = static_cast<uint32_t>(profiles.size());
+    for (size_t i = 0; i < profiles.size(); i++)
+    {
+        Entry entry{};
+        entry.nameHash = ConfigSchema::Hash(profiles[i].name);
+        entry.sourceWriteTime = profiles[i].sourceWriteTime;
+        entry.nameOffset = static_cast<uint32_t>(image.size());
+        entry.nameSize = static_cast<uint32_t>(profiles[i].name.size());
+        image.insert(image.end(), profiles[i].name.begin(), profiles[i].name.end());
+        entry.dataOffset = static_cast<uint32_t>(image.size());
+        entry.dataSize = static_cast<uint32_t>(profiles[i].data.size());
+        image.insert(image.end(), profiles[i].data.begin(), profiles[i].data.end());
+        memcpy(image.data() + sizeof(Header) + i * sizeof(Entry), &entry, sizeof(entry));
+    }
+
+    // Replace the store atomically, in case another process is reading it.
+    Unmap();
+    const std::filesystem::path temporaryPath = m_storePath.string() + "." + std::to_string(GetCurrentProcessId());
+    {
+        std::ofstream store(temporaryPath, std::ios_base::binary | std::ios_base::trunc);
+        store.write(reinterpret_cast<const char*>(image.data()), image.size());
+    }
+    std::filesystem::rename(temporaryPath, m_storePath, error);
+    if (!error && Map() && IsValid())
+    {
+        m_image.clear();
+        return;
+    }
+
+    std::filesystem::remove(temporaryPath, error);
+    Unmap();
+    m_image = std::move(image);
+    m_view = m_image.data();
+    m_size = m_image.size();
+}
+
+const ProfileStore::Entry* ProfileStore::FindEntry(
+    const std::string& foldedName) const
+{
+    if (!m_view)
+    {
+        return nullptr;
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(m_view);
+    const Entry* begin = reinterpret_cast<const Entry*>(m_view + sizeof(Header));
+    const Entry* end = begin + header->profilesCount;
+
+    const uint32_t nameHash = ConfigSchema::Hash(foldedName);
+    for (const Entry* entry = std::lower_bound(begin, end, nameHash, [](const Entry& entry, uint32_t hash) { return entry.nameHash < hash; });
+        entry < end && entry->nameHash == nameHash; entry++)
+    {
+        if (std::string_view(reinterpret_cast<const char*>(m_view + entry->nameOffset), entry->nameSize) == foldedName)
+        {
+            return entry;
+        }
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pch.h"
+
+// A single file holding the compiled configuration of all the applications and engines, indexed by name and
+// memory-mapped, so that finding a profile does not depend on how many there are.
+//
+// The store is rebuilt from the .cfg files when it is missing, when it was built for a different schema, or when the
+// .cfg file of the profile being looked up changed since it was compiled. Like the file names, the profile names are
+// case-insensitive: they are stored lowercase.
+class ProfileStore
+{
+public:
+    // Turns the text of a .cfg file into the data to store for the profile.
+    using CompileFunction = std::function<std::string(const std::string& name, std::istream& source)>;
+
+    ~ProfileStore()
+    {
+        Close();
+    }
+
+    // The schema hash identifies the format of the compiled data.
+    void Open(
+        const std::filesystem::path& storePath,
+        const std::filesystem::path& sourceDirectory,
+        uint32_t schemaHash,
+        CompileFunction compile);
+
+    void Close();
+
+    // Find the compiled data for a profile. The data remains valid until the next call or until the store is closed.
+    bool Find(
+        const std::string& name,
+        std::string_view& data);
+
+private:
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t schemaHash;
+        uint32_t profilesCount;
+    };
+
+    // Sorted by nameHash. The offsets are from the beginning of the file.
+    struct Entry
+    {
+        uint32_t nameHash;
+        uint32_t nameOffset;
+        uint32_t nameSize;
+        uint32_t dataOffset;
+        uint32_t dataSize;
+        uint32_t reserved;
+
+        // The last write time of the .cfg file that was compiled.
+        int64_t sourceWriteTime;
+    };
+
+    static constexpr uint32_t Magic = 0x53505448; // 'HTPS'
+    static constexpr uint32_t Version = 1;
+
+    bool Map();
+    void Unmap();
+    bool IsValid() const;
+    void Rebuild();
+    const Entry* FindEntry(const std::string& foldedName) const;
+
+    std::filesystem::path m_storePath;
+    std::filesystem::path m_sourceDirectory;
+    uint32_t m_schemaHash{ 0 };
+    CompileFunction m_compile;
+
+    HANDLE m_file{ INVALID_HANDLE_VALUE };
+    HANDLE m_mapping{ nullptr };
+    const uint8_t* m_view{ nullptr };
+    size_t m_size{ 0 };
+
+    // Used instead of the file when the store cannot be written (for example if another process has it mapped).
+    std::vector<uint8_t> m_image;
+
+    // The write time of the .cfg file for which the store was last rebuilt to find a profile.
+    std::unordered_map<std::string, int64_t> m_rebuiltFor;
+};
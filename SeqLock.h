@@ -0,0 +1,92 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include "pch.h"
+
+// Publish a value from one writer thread to any number of reader threads without locks. Readers copy the value and
+// start over if the writer updated it in the meantime, so the value must be trivially copyable and small enough to be
+// copied quickly.
+template <typename T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable_v<T>, "SeqLock values must be trivially copyable");
+
+public:
+    // Must always be called from the same thread (or under the writer's own lock).
+    void Write(const T& value)
+    {
+        const uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        memcpy(&m_value, &value, sizeof(T));
+
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Copy the last value written, and optionally its sequence number. Returns false if no value was ever written.
+    bool Read(T& value, uint32_t* readSequence = nullptr) const
+    {
+        while (true)
+        {
+            const uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+            if (!sequence)
+            {
+                return false;
+            }
+
+            if (!(sequence & 1))
+            {
+                memcpy(&value, &m_value, sizeof(T));
+
+                // Discard the copy if the writer started another update in the meantime.
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (m_sequence.load(std::memory_order_relaxed) == sequence)
+                {
+                    if (readSequence)
+                    {
+                        *readSequence = sequence;
+                    }
+                    return true;
+                }
+            }
+
+            m_retryCount.fetch_add(1, std::memory_order_relaxed);
+            YieldProcessor();
+        }
+    }
+
+    // Changes with each write, so that a reader can tell whether there is anything new to read without copying.
+    uint32_t GetSequence() const
+    {
+        return m_sequence.load(std::memory_order_acquire);
+    }
+
+    // The number of times a reader had to start over because of a concurrent write.
+    uint64_t GetRetryCount() const
+    {
+        return m_retryCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32_t> m_sequence{ 0 };
+    T m_value;
+
+    mutable std::atomic<uint64_t> m_retryCount{ 0 };
+};
@@ -0,0 +1,473 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include "FakeRuntime.h"
+
+// The loader entry point of the layer (see dllmain.cpp).
+extern "C" XrResult XRAPI_CALL HandToController_xrNegotiateLoaderApiLayerInterface(
+    const XrNegotiateLoaderInfo* loaderInfo,
+    const char* apiLayerName,
+    XrNegotiateApiLayerRequest* apiLayerRequest);
+
+namespace {
+
+    const char* const LayerName = "XR_APILAYER_NOVENDOR_hand_to_controller";
+    const char* const ApplicationName = "HandToControllerTests";
+
+    // Handles are never reused.
+    std::atomic<uint64_t> nextHandle{ 1 };
+
+    template <typename Handle>
+    Handle NewHandle()
+    {
+        return reinterpret_cast<Handle>(nextHandle++);
+    }
+
+    // The trackers are identified by their hand.
+    XrHandTrackerEXT GetHandTracker(
+        const XrHandEXT hand)
+    {
+        return reinterpret_cast<XrHandTrackerEXT>(static_cast<uintptr_t>(0x1000 + hand));
+    }
+
+    // Only used while setting up the bindings, never per frame.
+    std::mutex pathsMutex;
+    std::vector<std::string> paths;
+
+    std::atomic<XrTime> predictedDisplayTime{ 0 };
+
+    XrResult XRAPI_CALL Fake_xrEnumerateInstanceExtensionProperties(
+        const char* layerName,
+        uint32_t propertyCapacityInput,
+        uint32_t* propertyCountOutput,
+        XrExtensionProperties* properties)
+    {
+        *propertyCountOutput = 1;
+        if (propertyCapacityInput)
+        {
+            strcpy_s(properties[0].extensionName, "XR_EXT_hand_tracking");
+            properties[0].extensionVersion = 1;
+        }
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrGetInstanceProperties(
+        XrInstance instance,
+        XrInstanceProperties* instanceProperties)
+    {
+        instanceProperties->runtimeVersion = XR_MAKE_VERSION(1, 0, 0);
+        strcpy_s(instanceProperties->runtimeName, "FakeRuntime");
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrDestroyInstance(
+        XrInstance instance)
+    {
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrGetSystem(
+        XrInstance instance,
+        const XrSystemGetInfo* getInfo,
+        XrSystemId* systemId)
+    {
+        *systemId = 1;
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrGetSystemProperties(
+        XrInstance instance,
+        XrSystemId systemId,
+        XrSystemProperties* properties)
+    {
+        XrBaseOutStructure* entry = reinterpret_cast<XrBaseOutStructure*>(properties->next);
+        while (entry)
+        {
+            if (entry->type == XR_TYPE_SYSTEM_HAND_TRACKING_PROPERTIES_EXT)
+            {
+                reinterpret_cast<XrSystemHandTrackingPropertiesEXT*>(entry)->supportsHandTracking = XR_TRUE;
+            }
+            entry = entry->next;
+        }
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrStringToPath(
+        XrInstance instance,
+        const char* pathString,
+        XrPath* path)
+    {
+        std::unique_lock lock(pathsMutex);
+        const auto it = std::find(paths.cbegin(), paths.cend(), pathString);
+        *path = static_cast<XrPath>(it - paths.cbegin()) + 1;
+        if (it == paths.cend())
+        {
+            paths.push_back(pathString);
+        }
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrPathToString(
+        XrInstance instance,
+        XrPath path,
+        uint32_t bufferCapacityInput,
+        uint32_t* bufferCountOutput,
+        char* buffer)
+    {
+        std::unique_lock lock(pathsMutex);
+        if (path == XR_NULL_PATH || path > paths.size())
+        {
+            return XR_ERROR_PATH_INVALID;
+        }
+        const std::string& pathString = paths[path - 1];
+        *bufferCountOutput = static_cast<uint32_t>(pathString.size() + 1);
+        if (bufferCapacityInput < *bufferCountOutput)
+        {
+            return bufferCapacityInput ? XR_ERROR_SIZE_INSUFFICIENT : XR_SUCCESS;
+        }
+        memcpy(buffer, pathString.c_str(), *bufferCountOutput);
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrCreateSession(
+        XrInstance instance,
+        const XrSessionCreateInfo* createInfo,
+        XrSession* session)
+    {
+        *session = NewHandle<XrSession>();
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrDestroySession(
+        XrSession session)
+    {
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrPollEvent(
+        XrInstance instance,
+        XrEventDataBuffer* eventData)
+    {
+        return XR_EVENT_UNAVAILABLE;
+    }
+
+    XrResult XRAPI_CALL Fake_xrGetCurrentInteractionProfile(
+        XrSession session,
+        XrPath topLevelUserPath,
+        XrInteractionProfileState* interactionProfile)
+    {
+        interactionProfile->interactionProfile = XR_NULL_PATH;
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrSuggestInteractionProfileBindings(
+        XrInstance instance,
+        const XrInteractionProfileSuggestedBinding* suggestedBindings)
+    {
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrCreateReferenceSpace(
+        XrSession session,
+        const XrReferenceSpaceCreateInfo* createInfo,
+        XrSpace* space)
+    {
+        *space = NewHandle<XrSpace>();
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrCreateActionSpace(
+        XrSession session,
+        const XrActionSpaceCreateInfo* createInfo,
+        XrSpace* space)
+    {
+        *space = NewHandle<XrSpace>();
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrDestroySpace(
+        XrSpace space)
+    {
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrLocateSpace(
+        XrSpace space,
+        XrSpace baseSpace,
+        XrTime time,
+        XrSpaceLocation* location)
+    {
+        location->locationFlags = XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_VALID_BIT |
+                                  XR_SPACE_LOCATION_POSITION_TRACKED_BIT | XR_SPACE_LOCATION_ORIENTATION_TRACKED_BIT;
+        location->pose = xr::math::Pose::Identity();
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrWaitFrame(
+        XrSession session,
+        const XrFrameWaitInfo* frameWaitInfo,
+        XrFrameState* frameState)
+    {
+        frameState->predictedDisplayTime = ++predictedDisplayTime;
+        frameState->predictedDisplayPeriod = 1;
+        frameState->shouldRender = XR_TRUE;
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrBeginFrame(
+        XrSession session,
+        const XrFrameBeginInfo* frameBeginInfo)
+    {
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrEndFrame(
+        XrSession session,
+        const XrFrameEndInfo* frameEndInfo)
+    {
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrSyncActions(
+        XrSession session,
+        const XrActionsSyncInfo* syncInfo)
+    {
+        return XR_SUCCESS;
+    }
+
+    // The actions not handled by the layer are not bound.
+    XrResult XRAPI_CALL Fake_xrGetActionStateBoolean(
+        XrSession session,
+        const XrActionStateGetInfo* getInfo,
+        XrActionStateBoolean* state)
+    {
+        state->isActive = XR_FALSE;
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrGetActionStateFloat(
+        XrSession session,
+        const XrActionStateGetInfo* getInfo,
+        XrActionStateFloat* state)
+    {
+        state->isActive = XR_FALSE;
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrGetActionStatePose(
+        XrSession session,
+        const XrActionStateGetInfo* getInfo,
+        XrActionStatePose* state)
+    {
+        state->isActive = XR_FALSE;
+        return XR_SUCCESS;
+    }
+
+    // There is no graphics device: the swapchains have no images.
+    XrResult XRAPI_CALL Fake_xrCreateSwapchain(
+        XrSession session,
+        const XrSwapchainCreateInfo* createInfo,
+        XrSwapchain* swapchain)
+    {
+        *swapchain = NewHandle<XrSwapchain>();
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrDestroySwapchain(
+        XrSwapchain swapchain)
+    {
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrEnumerateSwapchainImages(
+        XrSwapchain swapchain,
+        uint32_t imageCapacityInput,
+        uint32_t* imageCountOutput,
+        XrSwapchainImageBaseHeader* images)
+    {
+        *imageCountOutput = 0;
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrAcquireSwapchainImage(
+        XrSwapchain swapchain,
+        const XrSwapchainImageAcquireInfo* acquireInfo,
+        uint32_t* index)
+    {
+        return XR_ERROR_CALL_ORDER_INVALID;
+    }
+
+    XrResult XRAPI_CALL Fake_xrCreateHandTrackerEXT(
+        XrSession session,
+        const XrHandTrackerCreateInfoEXT* createInfo,
+        XrHandTrackerEXT* handTracker)
+    {
+        *handTracker = GetHandTracker(createInfo->hand);
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrDestroyHandTrackerEXT(
+        XrHandTrackerEXT handTracker)
+    {
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Fake_xrLocateHandJointsEXT(
+        XrHandTrackerEXT handTracker,
+        const XrHandJointsLocateInfoEXT* locateInfo,
+        XrHandJointLocationsEXT* locations)
+    {
+        const float side = handTracker == GetHandTracker(XR_HAND_RIGHT_EXT) ? 1.0f : 0.0f;
+
+        locations->isActive = XR_TRUE;
+        for (uint32_t i = 0; i < locations->jointCount; i++)
+        {
+            XrHandJointLocationEXT& joint = locations->jointLocations[i];
+            joint.locationFlags = XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_VALID_BIT |
+                                  XR_SPACE_LOCATION_POSITION_TRACKED_BIT | XR_SPACE_LOCATION_ORIENTATION_TRACKED_BIT;
+            joint.pose.orientation = { 0.0f, 0.0f, 0.0f, 1.0f };
+            joint.pose.position = { static_cast<float>(locateInfo->time), static_cast<float>(i), side };
+            joint.radius = 0.01f;
+        }
+        locations->jointLocations[XR_HAND_JOINT_THUMB_TIP_EXT].pose.position = { 0.0f, 0.0f, side };
+        locations->jointLocations[XR_HAND_JOINT_INDEX_TIP_EXT].pose.position =
+            { FakeRuntime::GetPinchDistance(locateInfo->time), 0.0f, side };
+        return XR_SUCCESS;
+    }
+
+    struct FakeCall
+    {
+        const char* name;
+        PFN_xrVoidFunction function;
+    };
+
+#define FAKE_RUNTIME_CALL(xrCall) { #xrCall, reinterpret_cast<PFN_xrVoidFunction>(static_cast<PFN_##xrCall>(Fake_##xrCall)) },
+    const FakeCall FakeCalls[] = { FAKE_RUNTIME_CALLS(FAKE_RUNTIME_CALL) };
+#undef FAKE_RUNTIME_CALL
+
+    XrResult XRAPI_CALL Fake_xrGetInstanceProcAddr(
+        XrInstance instance,
+        const char* name,
+        PFN_xrVoidFunction* function)
+    {
+        for (const FakeCall& call : FakeCalls)
+        {
+            if (!strcmp(call.name, name))
+            {
+                *function = call.function;
+                return XR_SUCCESS;
+            }
+        }
+
+        *function = nullptr;
+        return XR_ERROR_FUNCTION_UNSUPPORTED;
+    }
+
+    XrResult XRAPI_CALL Fake_xrCreateApiLayerInstance(
+        const XrInstanceCreateInfo* info,
+        const XrApiLayerCreateInfo* apiLayerInfo,
+        XrInstance* instance)
+    {
+        *instance = NewHandle<XrInstance>();
+        return XR_SUCCESS;
+    }
+
+} // namespace
+
+namespace FakeRuntime
+{
+    float GetPinchDistance(
+        const XrTime time)
+    {
+        return (time % 5) * 0.01f;
+    }
+
+    XrResult CreateInstance(
+        const char* configuration,
+        XrInstance& instance,
+        Dispatch& dispatch)
+    {
+        // Keep the layer's files away from the user's, and start without the profiles of a previous run.
+        const std::filesystem::path localAppData = std::filesystem::temp_directory_path() / "HandToControllerTests";
+        std::error_code error;
+        std::filesystem::remove_all(localAppData, error);
+        std::filesystem::create_directories(localAppData);
+        _putenv_s("LOCALAPPDATA", localAppData.string().c_str());
+
+        // The layer is in our executable, so it looks for its configuration files next to it.
+        char executable[_MAX_PATH];
+        GetModuleFileNameA(nullptr, executable, sizeof(executable));
+        {
+            std::ofstream configFile(std::filesystem::path(executable).parent_path() / (std::string(ApplicationName) + ".cfg"));
+            configFile << configuration;
+        }
+
+        XrNegotiateLoaderInfo loaderInfo{ XR_LOADER_INTERFACE_STRUCT_LOADER_INFO };
+        loaderInfo.structVersion = XR_LOADER_INFO_STRUCT_VERSION;
+        loaderInfo.structSize = sizeof(loaderInfo);
+        loaderInfo.minInterfaceVersion = XR_CURRENT_LOADER_API_LAYER_VERSION;
+        loaderInfo.maxInterfaceVersion = XR_CURRENT_LOADER_API_LAYER_VERSION;
+        loaderInfo.minApiVersion = XR_CURRENT_API_VERSION;
+        loaderInfo.maxApiVersion = XR_CURRENT_API_VERSION;
+
+        XrNegotiateApiLayerRequest apiLayerRequest{ XR_LOADER_INTERFACE_STRUCT_API_LAYER_REQUEST };
+        apiLayerRequest.structVersion = XR_API_LAYER_INFO_STRUCT_VERSION;
+        apiLayerRequest.structSize = sizeof(apiLayerRequest);
+
+        XrResult result = HandToController_xrNegotiateLoaderApiLayerInterface(&loaderInfo, LayerName, &apiLayerRequest);
+        if (result != XR_SUCCESS)
+        {
+            return result;
+        }
+
+        XrApiLayerNextInfo nextInfo{ XR_LOADER_INTERFACE_STRUCT_API_LAYER_NEXT_INFO };
+        nextInfo.structVersion = XR_API_LAYER_NEXT_INFO_STRUCT_VERSION;
+        nextInfo.structSize = sizeof(nextInfo);
+        strcpy_s(nextInfo.layerName, LayerName);
+        nextInfo.nextGetInstanceProcAddr = Fake_xrGetInstanceProcAddr;
+        nextInfo.nextCreateApiLayerInstance = Fake_xrCreateApiLayerInstance;
+
+        XrApiLayerCreateInfo apiLayerInfo{ XR_LOADER_INTERFACE_STRUCT_API_LAYER_CREATE_INFO };
+        apiLayerInfo.structVersion = XR_API_LAYER_CREATE_INFO_STRUCT_VERSION;
+        apiLayerInfo.structSize = sizeof(apiLayerInfo);
+        apiLayerInfo.nextInfo = &nextInfo;
+
+        XrInstanceCreateInfo instanceCreateInfo{ XR_TYPE_INSTANCE_CREATE_INFO };
+        strcpy_s(instanceCreateInfo.applicationInfo.applicationName, ApplicationName);
+        instanceCreateInfo.applicationInfo.apiVersion = XR_CURRENT_API_VERSION;
+
+        result = apiLayerRequest.createApiLayerInstance(&instanceCreateInfo, &apiLayerInfo, &instance);
+        if (result != XR_SUCCESS)
+        {
+            return result;
+        }
+
+#define FAKE_RUNTIME_RESOLVE(xrCall)                                                                                \
+        if (result == XR_SUCCESS)                                                                                   \
+        {                                                                                                           \
+            result = apiLayerRequest.getInstanceProcAddr(instance, #xrCall,                                         \
+                reinterpret_cast<PFN_xrVoidFunction*>(&dispatch.xrCall));                                           \
+        }
+
+        FAKE_RUNTIME_CALLS(FAKE_RUNTIME_RESOLVE);
+
+#undef FAKE_RUNTIME_RESOLVE
+
+        return result;
+    }
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pch.h"
+
+// A minimal OpenXR runtime under the layer, so that the tests can drive the layer's hooks like an application does.
+// The layer is compiled into the tests, and the instance is created through its loader entry point.
+//
+// The hand joints are placed where they can be told apart: x is the time, y is the joint and z is the hand. The index
+// tip is the exception, it is placed at GetPinchDistance() from the thumb tip, near the origin. All the spaces are at
+// the origin of each other. The per-frame calls do not allocate, so that the layer's allocations can be counted.
+namespace FakeRuntime
+{
+    // The functions used by the tests, resolved through the layer.
+#define FAKE_RUNTIME_CALLS(X)                       \
+    X(xrEnumerateInstanceExtensionProperties)       \
+    X(xrGetInstanceProperties)                      \
+    X(xrDestroyInstance)                            \
+    X(xrGetSystem)                                  \
+    X(xrGetSystemProperties)                        \
+    X(xrStringToPath)                               \
+    X(xrPathToString)                               \
+    X(xrCreateSession)                              \
+    X(xrDestroySession)                             \
+    X(xrPollEvent)                                  \
+    X(xrGetCurrentInteractionProfile)               \
+    X(xrSuggestInteractionProfileBindings)          \
+    X(xrCreateReferenceSpace)                       \
+    X(xrCreateActionSpace)                          \
+    X(xrDestroySpace)                               \
+    X(xrLocateSpace)                                \
+    X(xrWaitFrame)                                  \
+    X(xrBeginFrame)                                 \
+    X(xrEndFrame)                                   \
+    X(xrSyncActions)                                \
+    X(xrGetActionStateBoolean)                      \
+    X(xrGetActionStateFloat)                        \
+    X(xrGetActionStatePose)                         \
+    X(xrCreateSwapchain)                            \
+    X(xrDestroySwapchain)                           \
+    X(xrEnumerateSwapchainImages)                   \
+    X(xrAcquireSwapchainImage)                      \
+    X(xrCreateHandTrackerEXT)                       \
+    X(xrDestroyHandTrackerEXT)                      \
+    X(xrLocateHandJointsEXT)
+
+#define FAKE_RUNTIME_DISPATCH(xrCall) PFN_##xrCall xrCall;
+    struct Dispatch
+    {
+        FAKE_RUNTIME_CALLS(FAKE_RUNTIME_DISPATCH)
+    };
+#undef FAKE_RUNTIME_DISPATCH
+
+    // The distance between the thumb tip and the index tip of both hands at a given time. It changes every frame.
+    float GetPinchDistance(XrTime time);
+
+    // Create an instance through the layer, for an application whose configuration file has the given content. The
+    // file is written next to the executable, where the layer looks for it. The layer's log and profile store are
+    // kept in a temporary directory.
+    XrResult CreateInstance(
+        const char* configuration,
+        XrInstance& instance,
+        Dispatch& dispatch);
+}
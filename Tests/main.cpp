@@ -0,0 +1,563 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Headless tests for the layer. The frame hooks are driven like an application does, with a fake OpenXR runtime under
+// the layer (see FakeRuntime.h).
+//
+// Usage: Tests
+//
+// Returns 0 if all the tests passed, 1 otherwise.
+
+#include "pch.h"
+
+#include <cstdio>
+
+#include "AllocationTracker.h"
+#include "FakeRuntime.h"
+#include "HandBounds.h"
+#include "SeqLock.h"
+
+namespace {
+
+    uint32_t failuresCount = 0;
+
+#define EXPECT(condition)                                                                                           \
+    if (!(condition))                                                                                               \
+    {                                                                                                               \
+        printf("%s(%d): expected %s\n", __FILE__, __LINE__, #condition);                                            \
+        failuresCount++;                                                                                            \
+    }
+
+    // A value that is much larger than what a single store can write, so that a torn read is likely to be noticed.
+    struct SequencedValue
+    {
+        uint64_t words[64];
+    };
+
+    // One writer updates the value as fast as possible while several readers check that every copy is consistent and
+    // that the values never go back in time.
+    void TestSeqLockStress()
+    {
+        constexpr uint64_t WritesCount = 2000000;
+        constexpr uint32_t ReadersCount = 3;
+
+        SeqLock<SequencedValue> seqLock;
+        std::atomic<bool> isWriting{ true };
+        std::atomic<uint64_t> tornReadsCount{ 0 };
+        std::atomic<uint64_t> backwardReadsCount{ 0 };
+        std::atomic<uint64_t> readsCount{ 0 };
+
+        std::vector<std::thread> readers;
+        for (uint32_t i = 0; i < ReadersCount; i++)
+        {
+            readers.emplace_back([&]() {
+                uint64_t lastValue = 0;
+                while (isWriting.load())
+                {
+                    SequencedValue value;
+                    if (!seqLock.Read(value))
+                    {
+                        continue;
+                    }
+
+                    for (const uint64_t word : value.words)
+                    {
+                        if (word != value.words[0])
+                        {
+                            tornReadsCount++;
+                            break;
+                        }
+                    }
+                    if (value.words[0] < lastValue)
+                    {
+                        backwardReadsCount++;
+                    }
+                    lastValue = value.words[0];
+                    readsCount++;
+                }
+            });
+        }
+
+        for (uint64_t i = 1; i <= WritesCount; i++)
+        {
+            SequencedValue value;
+            for (uint64_t& word : value.words)
+            {
+                word = i;
+            }
+            seqLock.Write(value);
+        }
+        isWriting = false;
+
+        for (auto& reader : readers)
+        {
+            reader.join();
+        }
+
+        SequencedValue value;
+        EXPECT(seqLock.Read(value) && value.words[0] == WritesCount);
+        EXPECT(tornReadsCount == 0);
+        EXPECT(backwardReadsCount == 0);
+        printf("SeqLock: %llu reads, %llu retries\n", readsCount.load(), seqLock.GetRetryCount());
+    }
+
+    // Only the pinch is bound, to the trigger of both hands.
+    const char* const Configuration =
+        "debug_log=false\n"
+        "left.squeeze=\n"
+        "right.squeeze=\n"
+        "left.wrist_tap=\n"
+        "left.index_tip_tap=\n";
+    constexpr float PinchFar = 0.05f;
+    constexpr float ClickThreshold = 0.75f;
+
+    // An application bound to the interaction profile emulated by the layer. The actions are only known to the layer
+    // through the suggested bindings, so they are not created with the runtime.
+    struct Application
+    {
+        FakeRuntime::Dispatch xr{};
+        XrInstance instance{ XR_NULL_HANDLE };
+        XrSession session{ XR_NULL_HANDLE };
+        XrSpace appSpace{ XR_NULL_HANDLE };
+        XrSwapchain swapchain{ XR_NULL_HANDLE };
+        XrPath handPath[2]{ XR_NULL_PATH, XR_NULL_PATH };
+        XrAction triggerAction{ reinterpret_cast<XrAction>(0x2001) };
+        XrAction gripAction{ reinterpret_cast<XrAction>(0x2002) };
+        XrSpace gripSpace[2]{ XR_NULL_HANDLE, XR_NULL_HANDLE };
+    };
+
+    XrPath GetPath(
+        const Application& app,
+        const char* path)
+    {
+        XrPath result = XR_NULL_PATH;
+        app.xr.xrStringToPath(app.instance, path, &result);
+        return result;
+    }
+
+    XrSpace CreateGripSpace(
+        const Application& app,
+        const int side)
+    {
+        XrActionSpaceCreateInfo actionSpaceCreateInfo{ XR_TYPE_ACTION_SPACE_CREATE_INFO };
+        actionSpaceCreateInfo.action = app.gripAction;
+        actionSpaceCreateInfo.subactionPath = app.handPath[side];
+        actionSpaceCreateInfo.poseInActionSpace = xr::math::Pose::Identity();
+        XrSpace space = XR_NULL_HANDLE;
+        app.xr.xrCreateActionSpace(app.session, &actionSpaceCreateInfo, &space);
+        return space;
+    }
+
+    bool CreateApplication(
+        Application& app)
+    {
+        if (FakeRuntime::CreateInstance(Configuration, app.instance, app.xr) != XR_SUCCESS)
+        {
+            return false;
+        }
+
+        XrSystemGetInfo systemGetInfo{ XR_TYPE_SYSTEM_GET_INFO };
+        systemGetInfo.formFactor = XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY;
+        XrSessionCreateInfo sessionCreateInfo{ XR_TYPE_SESSION_CREATE_INFO };
+        XrReferenceSpaceCreateInfo referenceSpaceCreateInfo{ XR_TYPE_REFERENCE_SPACE_CREATE_INFO };
+        referenceSpaceCreateInfo.referenceSpaceType = XR_REFERENCE_SPACE_TYPE_STAGE;
+        referenceSpaceCreateInfo.poseInReferenceSpace = xr::math::Pose::Identity();
+        XrSwapchainCreateInfo swapchainCreateInfo{ XR_TYPE_SWAPCHAIN_CREATE_INFO };
+        swapchainCreateInfo.width = swapchainCreateInfo.height = 1024;
+        swapchainCreateInfo.sampleCount = swapchainCreateInfo.faceCount = swapchainCreateInfo.arraySize = swapchainCreateInfo.mipCount = 1;
+        if (app.xr.xrGetSystem(app.instance, &systemGetInfo, &sessionCreateInfo.systemId) != XR_SUCCESS ||
+            app.xr.xrCreateSession(app.instance, &sessionCreateInfo, &app.session) != XR_SUCCESS ||
+            app.xr.xrCreateReferenceSpace(app.session, &referenceSpaceCreateInfo, &app.appSpace) != XR_SUCCESS ||
+            app.xr.xrCreateSwapchain(app.session, &swapchainCreateInfo, &app.swapchain) != XR_SUCCESS)
+        {
+            return false;
+        }
+
+        app.handPath[0] = GetPath(app, "/user/hand/left");
+        app.handPath[1] = GetPath(app, "/user/hand/right");
+        const XrActionSuggestedBinding bindings[] = {
+            { app.triggerAction, GetPath(app, "/user/hand/left/input/trigger/value") },
+            { app.triggerAction, GetPath(app, "/user/hand/right/input/trigger/value") },
+            { app.gripAction, GetPath(app, "/user/hand/left/input/grip/pose") },
+            { app.gripAction, GetPath(app, "/user/hand/right/input/grip/pose") },
+        };
+        XrInteractionProfileSuggestedBinding suggestedBindings{ XR_TYPE_INTERACTION_PROFILE_SUGGESTED_BINDING };
+        suggestedBindings.interactionProfile = GetPath(app, "/interaction_profiles/hp/mixed_reality_controller");
+        suggestedBindings.countSuggestedBindings = static_cast<uint32_t>(std::size(bindings));
+        suggestedBindings.suggestedBindings = bindings;
+        if (app.xr.xrSuggestInteractionProfileBindings(app.instance, &suggestedBindings) != XR_SUCCESS)
+        {
+            return false;
+        }
+
+        for (int side = 0; side <= 1; side++)
+        {
+            app.gripSpace[side] = CreateGripSpace(app, side);
+        }
+        return app.gripSpace[0] != XR_NULL_HANDLE && app.gripSpace[1] != XR_NULL_HANDLE;
+    }
+
+    void DestroyApplication(
+        const Application& app)
+    {
+        for (int side = 0; side <= 1; side++)
+        {
+            app.xr.xrDestroySpace(app.gripSpace[side]);
+        }
+        app.xr.xrDestroySwapchain(app.swapchain);
+        app.xr.xrDestroySpace(app.appSpace);
+        app.xr.xrDestroySession(app.session);
+        app.xr.xrDestroyInstance(app.instance);
+    }
+
+    // Run the simulation part of a frame, and return its time.
+    XrTime SimulateFrame(
+        const Application& app)
+    {
+        XrFrameState frameState{ XR_TYPE_FRAME_STATE };
+        XrActionsSyncInfo syncInfo{ XR_TYPE_ACTIONS_SYNC_INFO };
+        if (app.xr.xrWaitFrame(app.session, nullptr, &frameState) != XR_SUCCESS ||
+            app.xr.xrBeginFrame(app.session, nullptr) != XR_SUCCESS ||
+            app.xr.xrSyncActions(app.session, &syncInfo) != XR_SUCCESS)
+        {
+            return 0;
+        }
+        return frameState.predictedDisplayTime;
+    }
+
+    // Submit a projection layer. There is no D3D device, so the layer does not render into the swapchains.
+    XrResult SubmitFrame(
+        const Application& app,
+        const XrTime time)
+    {
+        XrCompositionLayerProjectionView views[2];
+        for (int eye = 0; eye <= 1; eye++)
+        {
+            views[eye] = { XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW };
+            views[eye].pose = xr::math::Pose::Identity();
+            views[eye].fov = { -0.8f, 0.8f, 0.8f, -0.8f };
+            views[eye].subImage.swapchain = app.swapchain;
+            views[eye].subImage.imageRect = { { 0, 0 }, { 1024, 1024 } };
+        }
+        XrCompositionLayerProjection layer{ XR_TYPE_COMPOSITION_LAYER_PROJECTION };
+        layer.space = app.appSpace;
+        layer.viewCount = 2;
+        layer.views = views;
+        const XrCompositionLayerBaseHeader* const layers[] = { reinterpret_cast<const XrCompositionLayerBaseHeader*>(&layer) };
+
+        XrFrameEndInfo frameEndInfo{ XR_TYPE_FRAME_END_INFO };
+        frameEndInfo.displayTime = time;
+        frameEndInfo.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
+        frameEndInfo.layerCount = 1;
+        frameEndInfo.layers = layers;
+        return app.xr.xrEndFrame(app.session, &frameEndInfo);
+    }
+
+    // The grip is the palm, which the fake runtime places at (time, 0, side).
+    bool IsGripConsistent(
+        const Application& app,
+        const XrSpace gripSpace,
+        const int side,
+        const XrTime time)
+    {
+        XrSpaceLocation location{ XR_TYPE_SPACE_LOCATION };
+        if (app.xr.xrLocateSpace(gripSpace, app.appSpace, time, &location) != XR_SUCCESS ||
+            !xr::math::Pose::IsPoseValid(location))
+        {
+            return false;
+        }
+        const XrVector3f& position = location.pose.position;
+        return position.x == static_cast<float>(time) && position.y == 0.0f && position.z == static_cast<float>(side);
+    }
+
+    float GetPinchValue(
+        const XrTime time)
+    {
+        return 1.0f - std::clamp(FakeRuntime::GetPinchDistance(time), 0.0f, PinchFar) / PinchFar;
+    }
+
+    // The values are latched, so the float and boolean values of the trigger must be the pinch at the time of their
+    // last change. They are not active until the layer evaluates the pinch, after the first query.
+    bool IsTriggerConsistent(
+        const Application& app,
+        const int side,
+        bool& isActive)
+    {
+        XrActionStateGetInfo getInfo{ XR_TYPE_ACTION_STATE_GET_INFO };
+        getInfo.action = app.triggerAction;
+        getInfo.subactionPath = app.handPath[side];
+        XrActionStateFloat floatState{ XR_TYPE_ACTION_STATE_FLOAT };
+        XrActionStateBoolean booleanState{ XR_TYPE_ACTION_STATE_BOOLEAN };
+        XrActionStatePose poseState{ XR_TYPE_ACTION_STATE_POSE };
+        if (app.xr.xrGetActionStateFloat(app.session, &getInfo, &floatState) != XR_SUCCESS ||
+            app.xr.xrGetActionStateBoolean(app.session, &getInfo, &booleanState) != XR_SUCCESS)
+        {
+            return false;
+        }
+        getInfo.action = app.gripAction;
+        if (app.xr.xrGetActionStatePose(app.session, &getInfo, &poseState) != XR_SUCCESS || !poseState.isActive)
+        {
+            return false;
+        }
+
+        isActive = floatState.isActive;
+        if (!floatState.isActive)
+        {
+            return !booleanState.isActive;
+        }
+        return booleanState.isActive && floatState.lastChangeTime > 0 &&
+               std::abs(floatState.currentState - GetPinchValue(floatState.lastChangeTime)) < 1e-5f &&
+               (booleanState.currentState == XR_TRUE) == (GetPinchValue(booleanState.lastChangeTime) >= ClickThreshold);
+    }
+
+#ifdef HAND_TO_CONTROLLER_TRACK_ALLOCATIONS
+    // Drive the frame hooks like an application does, and count the heap allocations made by the layer once warmed up.
+    // The layer counts the frames since the process started, so this must run before any other test submits frames.
+    void TestFrameHooksAllocations(
+        const Application& app)
+    {
+        constexpr uint64_t FramesCount = 1000;
+
+        uint64_t allocationsCount = 0;
+        uint64_t inconsistentFramesCount = 0;
+        for (uint64_t i = 0; i < AllocationTracker::WarmupFrames + FramesCount; i++)
+        {
+            const uint64_t allocationCount = AllocationTracker::GetThreadAllocationCount();
+
+            const XrTime time = SimulateFrame(app);
+            bool isConsistent = time != 0;
+            for (int side = 0; side <= 1; side++)
+            {
+                bool isActive = false;
+                isConsistent = IsGripConsistent(app, app.gripSpace[side], side, time) &&
+                               IsTriggerConsistent(app, side, isActive) && (isActive || i < AllocationTracker::WarmupFrames) &&
+                               isConsistent;
+
+                XrInteractionProfileState interactionProfile{ XR_TYPE_INTERACTION_PROFILE_STATE };
+                app.xr.xrGetCurrentInteractionProfile(app.session, app.handPath[side], &interactionProfile);
+            }
+            XrEventDataBuffer event{ XR_TYPE_EVENT_DATA_BUFFER };
+            app.xr.xrPollEvent(app.instance, &event);
+            isConsistent = SubmitFrame(app, time) == XR_SUCCESS && isConsistent;
+
+            if (i >= AllocationTracker::WarmupFrames)
+            {
+                allocationsCount += AllocationTracker::GetThreadAllocationCount() - allocationCount;
+            }
+            if (!isConsistent)
+            {
+                inconsistentFramesCount++;
+            }
+        }
+
+        EXPECT(allocationsCount == 0);
+        EXPECT(inconsistentFramesCount == 0);
+        printf("Frame hooks: %llu heap allocation(s) after the first %llu frames\n", allocationsCount, AllocationTracker::WarmupFrames);
+    }
+#endif
+
+    // Mimic an engine: the simulation thread syncs the actions and locates the grips every frame, a render thread
+    // submits the frames, and other threads query the actions and locate the grips, or create and destroy grip spaces,
+    // all at the same time.
+    void TestFrameHooksThreads(
+        const Application& app)
+    {
+        constexpr uint64_t FramesCount = 20000;
+        constexpr uint32_t ReadersCount = 2;
+
+        std::atomic<bool> isSimulating{ true };
+        std::atomic<XrTime> latestTime{ 0 };
+        std::atomic<uint64_t> inconsistentReadsCount{ 0 };
+        std::atomic<uint64_t> activeReadsCount{ 0 };
+        std::atomic<uint64_t> readsCount{ 0 };
+        std::atomic<uint64_t> failedSubmissionsCount{ 0 };
+        std::atomic<uint64_t> submissionsCount{ 0 };
+        std::atomic<uint64_t> churnedSpacesCount{ 0 };
+
+        std::vector<std::thread> threads;
+        threads.emplace_back([&]() {
+            while (isSimulating.load())
+            {
+                const XrTime time = latestTime.load();
+                if (time && SubmitFrame(app, time) != XR_SUCCESS)
+                {
+                    failedSubmissionsCount++;
+                }
+                submissionsCount++;
+            }
+        });
+        for (uint32_t i = 0; i < ReadersCount; i++)
+        {
+            threads.emplace_back([&]() {
+                while (isSimulating.load())
+                {
+                    const XrTime time = latestTime.load();
+                    if (!time)
+                    {
+                        continue;
+                    }
+
+                    for (int side = 0; side <= 1; side++)
+                    {
+                        bool isActive = false;
+                        if (!IsGripConsistent(app, app.gripSpace[side], side, time) || !IsTriggerConsistent(app, side, isActive))
+                        {
+                            inconsistentReadsCount++;
+                        }
+                        if (isActive)
+                        {
+                            activeReadsCount++;
+                        }
+                    }
+                    readsCount++;
+                }
+            });
+        }
+        threads.emplace_back([&]() {
+            int side = 0;
+            while (isSimulating.load())
+            {
+                const XrTime time = latestTime.load();
+                const XrSpace space = CreateGripSpace(app, side);
+                if (space == XR_NULL_HANDLE || (time && !IsGripConsistent(app, space, side, time)))
+                {
+                    inconsistentReadsCount++;
+                }
+                app.xr.xrDestroySpace(space);
+                churnedSpacesCount++;
+                side = 1 - side;
+            }
+        });
+
+        for (uint64_t i = 0; i < FramesCount; i++)
+        {
+            const XrTime time = SimulateFrame(app);
+            EXPECT(time != 0);
+            for (int side = 0; side <= 1; side++)
+            {
+                bool isActive = false;
+                EXPECT(IsGripConsistent(app, app.gripSpace[side], side, time));
+                EXPECT(IsTriggerConsistent(app, side, isActive));
+            }
+            latestTime = time;
+        }
+        isSimulating = false;
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        EXPECT(inconsistentReadsCount == 0);
+        EXPECT(activeReadsCount > 0);
+        EXPECT(failedSubmissionsCount == 0);
+        printf("Frame hooks: %llu reads, %llu submissions, %llu spaces churned\n", readsCount.load(),
+            submissionsCount.load(), churnedSpacesCount.load());
+    }
+
+    bool operator==(const XrRect2Di& a, const XrRect2Di& b)
+    {
+        return a.offset.x == b.offset.x && a.offset.y == b.offset.y && a.extent.width == b.extent.width &&
+               a.extent.height == b.extent.height;
+    }
+
+    void TestHandBoundsEnclose()
+    {
+        const HandBounds::Sphere empty = HandBounds::Enclose(nullptr, 0, 0.1f);
+        EXPECT(empty.radius < 0.0f);
+
+        XrRect2Di bounds{};
+        EXPECT(!HandBounds::Project(empty, DirectX::XMMatrixIdentity(), { { 0, 0 }, { 100, 100 } }, bounds));
+
+        const XrVector3f points[] = { { -1.0f, 2.0f, 0.0f }, { 1.0f, 2.0f, 0.0f }, { 0.0f, 2.0f, 0.0f } };
+        const HandBounds::Sphere sphere = HandBounds::Enclose(points, 3, 0.5f);
+        EXPECT(sphere.center.x == 0.0f && sphere.center.y == 2.0f && sphere.center.z == 0.0f);
+        EXPECT(std::abs(sphere.radius - 1.5f) < 1e-5f);
+    }
+
+    // The eye is at the origin looking down -Z, with a 90 degrees field of view.
+    void TestHandBoundsProject()
+    {
+        const DirectX::XMMATRIX viewProjection = DirectX::XMMatrixPerspectiveOffCenterRH(-0.1f, 0.1f, -0.1f, 0.1f, 0.1f, 100.0f);
+        const XrRect2Di imageRect{ { 100, 50 }, { 1000, 800 } };
+        XrRect2Di bounds{};
+
+        // In front of the eye: the corners closest to the eye span [-1/9, 1/9] of the image, rounded outwards.
+        EXPECT(HandBounds::Project({ { 0.0f, 0.0f, -10.0f }, 1.0f }, viewProjection, imageRect, bounds));
+        EXPECT(bounds == (XrRect2Di{ { 100 + 444, 50 + 355 }, { 112, 90 } }));
+
+        // Fully off one side.
+        EXPECT(!HandBounds::Project({ { 50.0f, 0.0f, -10.0f }, 1.0f }, viewProjection, imageRect, bounds));
+        EXPECT(!HandBounds::Project({ { 0.0f, -50.0f, -10.0f }, 1.0f }, viewProjection, imageRect, bounds));
+
+        // Behind the eye.
+        EXPECT(!HandBounds::Project({ { 0.0f, 0.0f, 10.0f }, 1.0f }, viewProjection, imageRect, bounds));
+
+        // Straddling the near plane: some corners are behind the eye, the whole image is covered.
+        EXPECT(HandBounds::Project({ { 0.0f, 0.0f, 0.0f }, 0.5f }, viewProjection, imageRect, bounds));
+        EXPECT(bounds == imageRect);
+
+        // Partially off the right side: clipped to the image.
+        EXPECT(HandBounds::Project({ { 10.0f, 0.0f, -10.0f }, 1.0f }, viewProjection, imageRect, bounds));
+        EXPECT(bounds.offset.x > imageRect.offset.x);
+        EXPECT(bounds.offset.x + bounds.extent.width == imageRect.offset.x + imageRect.extent.width);
+        EXPECT(bounds.offset.y >= imageRect.offset.y);
+        EXPECT(bounds.offset.y + bounds.extent.height <= imageRect.offset.y + imageRect.extent.height);
+    }
+
+    void TestHandBoundsUnion()
+    {
+        const XrRect2Di empty{ { 10, 10 }, { 0, 20 } };
+        const XrRect2Di a{ { 10, 20 }, { 30, 40 } };
+        const XrRect2Di b{ { 0, 30 }, { 20, 50 } };
+
+        EXPECT(HandBounds::IsEmpty(empty));
+        EXPECT(HandBounds::IsEmpty(HandBounds::Union(empty, empty)));
+        EXPECT(HandBounds::Union(empty, a) == a);
+        EXPECT(HandBounds::Union(a, empty) == a);
+        EXPECT(HandBounds::Union(a, b) == (XrRect2Di{ { 0, 20 }, { 40, 60 } }));
+    }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Application app;
+    const bool isApplicationCreated = CreateApplication(app);
+    EXPECT(isApplicationCreated);
+    if (isApplicationCreated)
+    {
+#ifdef HAND_TO_CONTROLLER_TRACK_ALLOCATIONS
+        TestFrameHooksAllocations(app);
+#endif
+        TestFrameHooksThreads(app);
+        DestroyApplication(app);
+    }
+
+    TestSeqLockStress();
+    TestHandBoundsEnclose();
+    TestHandBoundsProject();
+    TestHandBoundsUnion();
+
+    if (failuresCount)
+    {
+        printf("%u failure(s)\n", failuresCount);
+        return 1;
+    }
+
+    printf("All tests passed\n");
+    return 0;
+}
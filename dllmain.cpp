@@ -16,10 +16,19 @@
 
 #include "pch.h"
 
+#include "AllocationTracker.h"
+#include "ConfigSchema.h"
+#include "ControlChannel.h"
+#include "GestureKernels.h"
+#include "GestureProgram.h"
+#include "HandFeatures.h"
+#include "HandJointsCache.h"
 #include "HandRenderer.h"
-
-#define STRINGIFY(s) XSTRINGIFY(s)
-#define XSTRINGIFY(s) #s
+#include "InputInjector.h"
+#include "InterceptedCalls.h"
+#include "Logger.h"
+#include "ProfileStore.h"
+#include "SeqLock.h"
 
 namespace {
     using Microsoft::WRL::ComPtr;
@@ -34,10 +43,11 @@ namespace {
     std::string dllHome;
 
     // The file logger.
-    std::ofstream logStream;
+    Logger logger;
 
     // Function pointers to chain calls with the next layers and/or the OpenXR runtime.
     PFN_xrGetInstanceProcAddr next_xrGetInstanceProcAddr = nullptr;
+    PFN_xrDestroyInstance next_xrDestroyInstance = nullptr;
     PFN_xrWaitFrame next_xrWaitFrame = nullptr;
     PFN_xrBeginFrame next_xrBeginFrame = nullptr;
     PFN_xrCreateSession next_xrCreateSession = nullptr;
@@ -60,6 +70,7 @@ namespace {
 
     // Function pointers to interact with the runtime.
     PFN_xrCreateReferenceSpace xrCreateReferenceSpace = nullptr;
+    PFN_xrLocateSpace xrLocateSpace = nullptr;
     PFN_xrPathToString xrPathToString = nullptr;
     PFN_xrStringToPath xrStringToPath = nullptr;
 
@@ -68,30 +79,235 @@ namespace {
     PFN_xrDestroyHandTrackerEXT xrDestroyHandTrackerEXT = nullptr;
     PFN_xrLocateHandJointsEXT xrLocateHandJointsEXT = nullptr;
 
-    // Frame state.
-    XrTime waitedFrameTime;
-    XrTime begunFrameTime;
+    // Frame state. xrWaitFrame(), xrBeginFrame() and xrSyncActions() may each be called from a different thread.
+    std::atomic<XrTime> waitedFrameTime{ 0 };
+    std::atomic<XrTime> begunFrameTime{ 0 };
 
     // State of the hand tracker.
     XrInstance instanceId = XR_NULL_HANDLE;
     XrSession sessionId = XR_NULL_HANDLE;
     XrHandTrackerEXT handTracker[2]{ XR_NULL_HANDLE, XR_NULL_HANDLE };
     XrSpace referenceSpace = XR_NULL_HANDLE;
+    HandJointsCache handJointsCache;
+    HandFeatures handFeatures;
+
+    // Engines commonly call xrSyncActions() and xrLocateSpace() from a simulation thread and xrEndFrame() from a render
+    // thread. Every other thread has its own cache of hand joints (see GetHandJointsCache()), seeded with the hands
+    // published by xrSyncActions() for the frame.
+    std::atomic<DWORD> simulationThreadId{ 0 };
+    std::atomic<DWORD> renderThreadId{ 0 };
+    HandJointsCache renderHandJointsCache;
+    uint32_t renderHandJointsSequence = 0;
+
+    // Bumped with each session, for the other threads to set their cache up again.
+    std::atomic<uint64_t> sessionGeneration{ 0 };
+
+    // Bumped when a space is destroyed from another thread than the simulation thread, since only the simulation thread
+    // may touch its cache. It drops all its snapshots upon its next call instead (see GetHandJointsCache()).
+    std::atomic<uint64_t> destroyedSpacesCount{ 0 };
+    uint64_t simulationDestroyedSpacesCount = 0;
+
+    struct PublishedHands
+    {
+        HandJointsSnapshot hands[2];
+    };
+    SeqLock<PublishedHands> publishedHands;
+
+    // The worker thread preparing the joints to render as soon as the hands are published, so that xrEndFrame() does
+    // not have to locate anything. The joints are expressed in the space of the last projection layer rendered. The
+    // generation changes (under the mutex) with the space, and the prepared joints are tagged with it: joints prepared
+    // for a space that was replaced or destroyed in the meantime are never used.
+    std::thread renderPreparationThread;
+    HANDLE renderPreparationEvent = nullptr;
+    HANDLE renderPreparationStopEvent = nullptr;
+    std::atomic<XrSpace> lastLayerSpace{ XR_NULL_HANDLE };
+    std::atomic<uint64_t> lastLayerSpaceGeneration{ 0 };
+    std::mutex lastLayerSpaceMutex;
+    uint64_t preparedJointsUsedCount = 0;
+    uint64_t preparedJointsMissedCount = 0;
+
+    // Interning of the full paths for the hands (eg: /user/hand/left/input/trigger/value) into dense slots. Paths are
+    // only interned during setup (bindings) and by the configuration thread (see ResolveConfiguration()), so that the
+    // per-frame code only deals with slot indices. The slots are allocated upfront: the per-frame code never sees the
+    // storage move, and a slot is published by actionSlotsCount once its path is written.
+    constexpr int MaxActionSlots = 256;
+    std::mutex actionSlotsMutex;
+    std::unordered_map<std::string, int> actionPathSlots;
+    std::vector<std::string> actionSlotPaths;
+    std::atomic<int> actionSlotsCount{ 0 };
+    XrPath handSubactionPath[2]{ XR_NULL_PATH, XR_NULL_PATH };
+
+    // The slot written by a gesture, and the slot for the click derived from a value (if any).
+    struct ActionTarget
+    {
+        int valueSlot = -1;
+        int clickSlot = -1;
+    };
+
+    // A suggested binding for one of the hands.
+    struct ActionBinding
+    {
+        int side;
+        int slot;
+    };
+
+    // An action space for one of the hands. The joint and the transform to simulate it are described by the
+    // configuration (see Config::simulatedSpaces).
+    struct ActionSpace
+    {
+        int side;
+        bool isGrip;
+        bool isAim;
+        XrPosef poseInActionSpace;
+
+        // Resolved for each configuration snapshot (see ResolveActionSpace()), so that xrLocateSpace() only composes
+        // the joint pose with a single transform.
+        bool isSimulated;
+        int joint;
+        XrPosef transform;
+    };
+
+    // The snapshot of a published value to use on the calling thread, or nullptr if none is published. The thread keeps
+    // a reference on the snapshot it last read, and only takes a new one once the generation changed, so that the frame
+    // hooks only load the generation. The snapshot remains valid until the thread reads the same value again. There is
+    // only one published value of each type.
+    template <typename T>
+    const T* GetThreadSnapshot(
+        const std::shared_ptr<const T>& published,
+        const std::atomic<uint64_t>& generation)
+    {
+        thread_local std::shared_ptr<const T> threadSnapshot;
+        thread_local uint64_t threadSnapshotGeneration = 0;
+
+        const uint64_t latestGeneration = generation.load(std::memory_order_acquire);
+        if (threadSnapshotGeneration != latestGeneration)
+        {
+            threadSnapshot = std::atomic_load(&published);
+            threadSnapshotGeneration = latestGeneration;
+        }
+        return threadSnapshot.get();
+    }
+
+    // Mapping of XrAction and XrSpace. The frame hooks look them up from any thread, while the application may create
+    // more actions spaces meanwhile. So they are published as immutable snapshots like the configuration: the hooks
+    // modifying them (which are not called per frame) modify a copy of the latest snapshot, then swap it in (see
+    // UpdateBindings()).
+    struct Bindings
+    {
+        std::unordered_map<XrAction, std::vector<ActionBinding>> actions;
+        std::unordered_map<XrSpace, ActionSpace> spaces;
+    };
+    std::mutex bindingsMutex;
+    std::shared_ptr<const Bindings> publishedBindings;
+    std::atomic<uint64_t> bindingsGeneration{ 0 };
+
+    // The snapshot remains valid until the calling thread calls GetBindings() again.
+    const Bindings& GetBindings()
+    {
+        return *GetThreadSnapshot(publishedBindings, bindingsGeneration);
+    }
+
+    template <typename Function>
+    void UpdateBindings(
+        Function&& update)
+    {
+        std::unique_lock lock(bindingsMutex);
+
+        const auto current = std::atomic_load(&publishedBindings);
+        auto bindings = current ? std::make_shared<Bindings>(*current) : std::make_shared<Bindings>();
+        update(*bindings);
 
-    // Mapping of XrAction and XrSpace.
-    std::unordered_map<XrAction, std::vector<std::string>> actionsMap;
-    std::unordered_map<XrSpace, std::pair<std::string, XrPosef>> spacesMap;
+        std::atomic_store(&publishedBindings, std::shared_ptr<const Bindings>(std::move(bindings)));
+        bindingsGeneration.fetch_add(1, std::memory_order_release);
+    }
 
     // State of the API.
     bool needAdvertiseProfile;
-    std::unordered_map<std::string, float> actionsState;
-    std::unordered_map<std::string, std::pair<bool, XrTime>> lastBooleanChange;
-    std::unordered_map<std::string, std::pair<float, XrTime>> lastFloatChange;
+    // The action values are double-buffered: the gestures write the pending values during xrSyncActions(), which then
+    // commits them into the state observed by xrGetActionState*() until the next sync. The simulation thread works on
+    // its own copy of the states, and publishes each state through a seqlock, since the application may query them from
+    // any thread.
+    struct ActionState
+    {
+        // Whether a gesture ever recorded a value.
+        bool hasValue = false;
+
+        float value;
+        bool changedSinceLastSync;
+        XrTime lastChangeTime;
+
+        bool booleanValue;
+        bool booleanChangedSinceLastSync;
+        XrTime booleanLastChangeTime;
+    };
+    std::vector<float> pendingActionsValue;
+    std::vector<ActionState> actionsState;
+    SeqLock<ActionState> publishedActionsState[MaxActionSlots];
+
+    // Whether the application ever queried the state of an action. Only the gestures feeding these are evaluated. Set
+    // by the xrGetActionState*() hooks from any thread, which then bump polledActionsCount for the simulation thread to
+    // pick them up with the next xrSyncActions() (see RefreshSimulationConfiguration()).
+    std::atomic<bool> isActionPolled[MaxActionSlots];
+    std::atomic<uint32_t> polledActionsCount{ 0 };
+
+    // The keyboard input for the key bindings.
+    SendInputSink sendInputSink;
+    InputInjector inputInjector;
+
+    void Log(const char* fmt, ...);
+
+    // Get the slot for a full path, allocating a new one if needed. Returns -1 if all the slots are taken.
+    int InternActionPath(
+        const std::string& fullPath)
+    {
+        std::unique_lock lock(actionSlotsMutex);
+
+        const auto it = actionPathSlots.find(fullPath);
+        if (it != actionPathSlots.cend())
+        {
+            return it->second;
+        }
+
+        const int slot = actionSlotsCount.load(std::memory_order_relaxed);
+        if (slot == MaxActionSlots)
+        {
+            Log("Too many action paths, ignoring %s\n", fullPath.c_str());
+            return -1;
+        }
+        actionPathSlots.insert_or_assign(fullPath, slot);
+        actionSlotPaths[slot] = fullPath;
+        actionSlotsCount.store(slot + 1, std::memory_order_release);
+        return slot;
+    }
+
+    // Resolve the slots for an action path relative to a hand (eg: /input/trigger/value).
+    ActionTarget ResolveActionTarget(
+        const int side,
+        const std::string& actionPath)
+    {
+        ActionTarget target;
+        if (!actionPath.empty())
+        {
+            const std::string fullPath = std::string(side ? "/user/hand/right" : "/user/hand/left") + actionPath;
+            target.valueSlot = InternActionPath(fullPath);
+
+            // Create click from value for convenience (but not the other way around).
+            if (target.valueSlot >= 0 && fullPath.rfind("/value") != std::string::npos)
+            {
+                target.clickSlot = InternActionPath(fullPath.substr(0, fullPath.length() - 6) + "/click");
+            }
+        }
+        return target;
+    }
 
     // Hands visualization.
     ComPtr<ID3D11Device> d3d11Device = nullptr;
     HandRenderer handRenderer;
+    bool isHandRendererErrorLogged = false;
     // TODO: Group the maps together to reduce lookup.
+    // The application may call the swapchain functions from another thread than xrEndFrame(), so the maps below are
+    // only accessed under swapchainsMutex. xrEndFrame() only holds it to look up the views to render to.
+    std::mutex swapchainsMutex;
     std::unordered_map<XrSwapchain, XrSwapchainCreateInfo> swapchainInfo;
     struct SwapchainResources
     {
@@ -106,9 +322,8 @@ namespace {
     // Socket for remote configuraion.
     SOCKET configSocket = -1;
 
-    void Log(const char* fmt, ...);
-
-    struct {
+    struct Config
+    {
         bool loaded;
         std::string rawInteractionProfile;
         XrPath interactionProfile;
@@ -128,30 +343,1386 @@ namespace {
         // Which projection layer to use for drawing the hands.
         int projLayerIndex;
 
-        // The index of the joint (see enum XrHandJointEXT) to use for the aim pose.
-        int aimJointIndex;
+        // How to preserve the application's pipeline state when drawing the hands, 0=deferred context, 1=state object,
+        // 2=save/restore (see HandRenderer::Isolation).
+        int renderIsolation;
+
+        // The index of the joint (see enum XrHandJointEXT) to use for the aim pose.
+        int aimJointIndex;
+
+        // The index of the joint (see enum XrHandJointEXT) to use for the grip pose.
+        int gripJointIndex;
+
+        // The threshold (between 0 and 1) when converting a float action into a boolean action and the action is true.
+        float clickThreshold;
+
+        // The delay before a held key repeats (0 to disable), and the interval between repeats, in milliseconds.
+        int keyRepeatDelay;
+        int keyRepeatInterval;
+
+        // The maximum number of keys pressed per second.
+        int keyRateLimit;
+
+        // Whether to log every call (very verbose).
+        bool debugLogEnabled;
+
+
+        // The transformation to apply to the aim and grip poses.
+        XrPosef transform[2];
+
+        // The index of the 1st joint (see enum XrHandJointEXT) to use for 1st custom gesture.
+        int custom1Joint1Index;
+
+        // The index of the 2nd joint (see enum XrHandJointEXT) to use for 1st custom gesture.
+        int custom1Joint2Index;
+
+        // The target XrAction path for a given gesture, and the near/far threshold to map the float action too (near maps to 1, far maps to 0).
+        // The target slots are resolved by ResolveConfiguration().
+#define DEFINE_ACTION(configName)           \
+        std::string configName##Action[2];  \
+        ActionTarget configName##Target[2]; \
+        float configName##Near;             \
+        float configName##Far;
+
+        DEFINE_ACTION(pinch);
+        DEFINE_ACTION(thumbPress);
+        DEFINE_ACTION(indexBend);
+        DEFINE_ACTION(fingerGun);
+        DEFINE_ACTION(squeeze);
+        DEFINE_ACTION(palmTap);
+        DEFINE_ACTION(wristTap);
+        DEFINE_ACTION(indexTipTap);
+        DEFINE_ACTION(custom1);
+
+#undef DEFINE_ACTION
+
+        // The gestures defined with the gesture.<name>.* options, in addition to the built-in ones above.
+        struct Gesture
+        {
+            std::string name;
+
+            // The pairs of joints (see enum XrHandJointEXT) to measure. With isTwoHanded, the 2nd joint is on the other hand.
+            std::vector<std::pair<int, int>> joints;
+            bool isTwoHanded = false;
+
+            float nearDistance = 0.0f;
+            float farDistance = 0.1f;
+            GestureReduce reduce = GestureReduce::Average;
+
+            std::string action[2];
+            ActionTarget target[2];
+        };
+        std::vector<Gesture> gestures;
+
+        // The keyboard keys held while an action is true, defined with the left.key.<name> and right.key.<name> options.
+        // The target slot is resolved by ResolveConfiguration().
+        struct KeyBinding
+        {
+            int side;
+            std::string keyName;
+            uint16_t virtualKey;
+            std::string action;
+            int slot = -1;
+        };
+        std::vector<KeyBinding> keyBindings;
+
+        // How to simulate the controller spaces of each hand, for the aim (0) and grip (1) poses. Resolved by
+        // ResolveConfiguration(), then for each action space by ResolveActionSpace().
+        struct SimulatedSpace
+        {
+            bool isSimulated;
+            int joint;
+            XrPosef transform;
+        };
+        SimulatedSpace simulatedSpaces[2][2];
+
+        // Set upon publication, to tell snapshots apart (see PublishConfiguration()).
+        uint64_t generation = 0;
+
+        // Log the configuration.
+        void Dump();
+
+        // Set all the options to their default value.
+        void Reset();
+    };
+
+    using ConfigKey = ConfigSchema::Key<Config>;
+
+    // All the options, except for the gesture.<name>.* ones (see ParseGestureStatement()).
+    // NOTE: The ConfigUI must maintain parity with the defaults below (see ResetDefaults() in Form1.cs). The table is
+    // also exported next to the log file (see ExportConfigurationSchema()).
+#define CONFIG_FIELD(member) [](Config& target) -> void* { return &target.member; }
+#define ACTION_KEYS(configString, configName, leftDefault, rightDefault, nearDefault, farDefault)                          \
+        { "left." configString, ConfigSchema::Type::String, CONFIG_FIELD(configName##Action[0]), leftDefault },           \
+        { "right." configString, ConfigSchema::Type::String, CONFIG_FIELD(configName##Action[1]), rightDefault },         \
+        { configString ".near", ConfigSchema::Type::Float, CONFIG_FIELD(configName##Near), nearDefault, 0.0f, 1.0f },     \
+        { configString ".far", ConfigSchema::Type::Float, CONFIG_FIELD(configName##Far), farDefault, 0.0f, 1.0f },
+
+#ifdef _DEBUG
+    constexpr const char* DebugLogDefault = "true";
+#else
+    constexpr const char* DebugLogDefault = "false";
+#endif
+
+    constexpr ConfigKey ConfigKeys[] = {
+        { "interaction_profile", ConfigSchema::Type::String, CONFIG_FIELD(rawInteractionProfile), "/interaction_profiles/hp/mixed_reality_controller" },
+        { "left.enabled", ConfigSchema::Type::Bool, CONFIG_FIELD(leftHandEnabled), "true" },
+        { "right.enabled", ConfigSchema::Type::Bool, CONFIG_FIELD(rightHandEnabled), "true" },
+        { "display.enabled", ConfigSchema::Type::Bool, CONFIG_FIELD(displayEnabled), "true" },
+        { "force_own_depth_buffer", ConfigSchema::Type::Bool, CONFIG_FIELD(useOwnDepthBuffer), "false" },
+        { "skin_tone", ConfigSchema::Type::Int, CONFIG_FIELD(skinTone), "1" /* Medium */, 0, 2 },
+        { "opacity", ConfigSchema::Type::Float, CONFIG_FIELD(opacity), "1", 0.0f, 1.0f },
+        { "proj_layer_index", ConfigSchema::Type::Int, CONFIG_FIELD(projLayerIndex), "0", 0 },
+        { "render_isolation", ConfigSchema::Type::Int, CONFIG_FIELD(renderIsolation), "0" /* DeferredContext */, 0, 2 },
+        { "aim_joint", ConfigSchema::Type::Int, CONFIG_FIELD(aimJointIndex), "8" /* XR_HAND_JOINT_INDEX_INTERMEDIATE_EXT */, 0, XR_HAND_JOINT_COUNT_EXT - 1 },
+        { "grip_joint", ConfigSchema::Type::Int, CONFIG_FIELD(gripJointIndex), "0" /* XR_HAND_JOINT_PALM_EXT */, 0, XR_HAND_JOINT_COUNT_EXT - 1 },
+        { "click_threshold", ConfigSchema::Type::Float, CONFIG_FIELD(clickThreshold), "0.75", 0.0f, 1.0f },
+        { "key_repeat_delay", ConfigSchema::Type::Int, CONFIG_FIELD(keyRepeatDelay), "0", 0, 5000 },
+        { "key_repeat_interval", ConfigSchema::Type::Int, CONFIG_FIELD(keyRepeatInterval), "50", 10, 1000 },
+        { "key_rate_limit", ConfigSchema::Type::Int, CONFIG_FIELD(keyRateLimit), "20", 1, 1000 },
+        { "debug_log", ConfigSchema::Type::Bool, CONFIG_FIELD(debugLogEnabled), DebugLogDefault },
+        { "left.transform.vec", ConfigSchema::Type::Vector3, CONFIG_FIELD(transform[0].position), "0 0 0" },
+        { "left.transform.quat", ConfigSchema::Type::Quaternion, CONFIG_FIELD(transform[0].orientation), "0 0 0 1" },
+        { "left.transform.euler", ConfigSchema::Type::Ignored, nullptr, "0 0 0" },
+        { "right.transform.vec", ConfigSchema::Type::Vector3, CONFIG_FIELD(transform[1].position), "0 0 0" },
+        { "right.transform.quat", ConfigSchema::Type::Quaternion, CONFIG_FIELD(transform[1].orientation), "0 0 0 1" },
+        { "right.transform.euler", ConfigSchema::Type::Ignored, nullptr, "0 0 0" },
+        ACTION_KEYS("pinch", pinch, "/input/trigger/value", "/input/trigger/value", "0", "0.05")
+        ACTION_KEYS("thumb_press", thumbPress, "", "", "0", "0.05")
+        ACTION_KEYS("index_bend", indexBend, "", "", "0.045", "0.07")
+        ACTION_KEYS("finger_gun", fingerGun, "", "", "0.01", "0.03")
+        ACTION_KEYS("squeeze", squeeze, "/input/squeeze/value", "/input/squeeze/value", "0.035", "0.07")
+        ACTION_KEYS("palm_tap", palmTap, "", "", "0.02", "0.06")
+        ACTION_KEYS("wrist_tap", wristTap, "/input/menu/click", "", "0.04", "0.05")
+        // This gesture only makes sense for one hand, but we leave it symmetrical for simplicity.
+        ACTION_KEYS("index_tip_tap", indexTipTap, "/input/b/click", "", "0", "0.07")
+        // Custom gesture is unconfigured.
+        ACTION_KEYS("custom1", custom1, "", "", "0", "0.1")
+        { "custom1_joint1", ConfigSchema::Type::Int, CONFIG_FIELD(custom1Joint1Index), "-1", -1, XR_HAND_JOINT_COUNT_EXT - 1 },
+        { "custom1_joint2", ConfigSchema::Type::Int, CONFIG_FIELD(custom1Joint2Index), "-1", -1, XR_HAND_JOINT_COUNT_EXT - 1 },
+    };
+
+#undef ACTION_KEYS
+#undef CONFIG_FIELD
+
+    constexpr auto ConfigKeysHash = ConfigSchema::MakePerfectHash<512>(ConfigKeys);
+
+    const ConfigKey* FindConfigKey(
+        const std::string& name)
+    {
+        const int index = ConfigKeysHash.Lookup(name);
+        return index >= 0 && name == ConfigKeys[index].name ? &ConfigKeys[index] : nullptr;
+    }
+
+    // Parse a value into its field. Returns false if the value is out of range, and throws if the value is malformed.
+    bool ParseConfigurationValue(
+        Config& target,
+        const ConfigKey& key,
+        const std::string& value)
+    {
+        std::stringstream ss(value);
+        std::string component;
+        const auto nextComponent = [&]() {
+            std::getline(ss, component, ' ');
+            return std::stof(component);
+        };
+
+        switch (key.type)
+        {
+        case ConfigSchema::Type::Bool:
+            *static_cast<bool*>(key.field(target)) = value == "1" || value == "true";
+            break;
+
+        case ConfigSchema::Type::Int:
+        {
+            const int intValue = std::stoi(value);
+            if (intValue < key.minValue || intValue > key.maxValue)
+            {
+                return false;
+            }
+            *static_cast<int*>(key.field(target)) = intValue;
+            break;
+        }
+
+        case ConfigSchema::Type::Float:
+        {
+            const float floatValue = std::stof(value);
+            if (!(floatValue >= key.minValue && floatValue <= key.maxValue))
+            {
+                return false;
+            }
+            *static_cast<float*>(key.field(target)) = floatValue;
+            break;
+        }
+
+        case ConfigSchema::Type::String:
+            *static_cast<std::string*>(key.field(target)) = value;
+            break;
+
+        case ConfigSchema::Type::Vector3:
+        {
+            XrVector3f vector;
+            vector.x = nextComponent();
+            vector.y = nextComponent();
+            vector.z = nextComponent();
+            *static_cast<XrVector3f*>(key.field(target)) = vector;
+            break;
+        }
+
+        case ConfigSchema::Type::Quaternion:
+        {
+            XrQuaternionf quaternion;
+            quaternion.x = nextComponent();
+            quaternion.y = nextComponent();
+            quaternion.z = nextComponent();
+            quaternion.w = nextComponent();
+            *static_cast<XrQuaternionf*>(key.field(target)) = quaternion;
+            break;
+        }
+
+        case ConfigSchema::Type::Ignored:
+            break;
+        }
+
+        return true;
+    }
+
+    // Format a value the same way as in the configuration files.
+    std::string FormatConfigurationValue(
+        const Config& source,
+        const ConfigKey& key)
+    {
+        char buffer[128] = {};
+        switch (key.type)
+        {
+        case ConfigSchema::Type::Bool:
+            return *static_cast<bool*>(key.field(const_cast<Config&>(source))) ? "true" : "false";
+
+        case ConfigSchema::Type::Int:
+            return std::to_string(*static_cast<int*>(key.field(const_cast<Config&>(source))));
+
+        case ConfigSchema::Type::Float:
+            snprintf(buffer, sizeof(buffer), "%g", *static_cast<float*>(key.field(const_cast<Config&>(source))));
+            break;
+
+        case ConfigSchema::Type::String:
+            return *static_cast<std::string*>(key.field(const_cast<Config&>(source)));
+
+        case ConfigSchema::Type::Vector3:
+        {
+            const XrVector3f& vector = *static_cast<XrVector3f*>(key.field(const_cast<Config&>(source)));
+            snprintf(buffer, sizeof(buffer), "%g %g %g", vector.x, vector.y, vector.z);
+            break;
+        }
+
+        case ConfigSchema::Type::Quaternion:
+        {
+            const XrQuaternionf& quaternion = *static_cast<XrQuaternionf*>(key.field(const_cast<Config&>(source)));
+            snprintf(buffer, sizeof(buffer), "%g %g %g %g", quaternion.x, quaternion.y, quaternion.z, quaternion.w);
+            break;
+        }
+
+        case ConfigSchema::Type::Ignored:
+            break;
+        }
+
+        return buffer;
+    }
+
+    void Config::Dump()
+    {
+        if (loaded)
+        {
+            for (const auto& key : ConfigKeys)
+            {
+                if (key.type != ConfigSchema::Type::Ignored)
+                {
+                    Log("  %s=%s\n", key.name, FormatConfigurationValue(*this, key).c_str());
+                }
+            }
+
+            for (const auto& gesture : gestures)
+            {
+                Log("  gesture %s (%u joint pair(s)%s, near: %.3f, far: %.3f) translates to: %s / %s\n",
+                    gesture.name.c_str(), (uint32_t)gesture.joints.size(), gesture.isTwoHanded ? " with other hand" : "",
+                    gesture.nearDistance, gesture.farDistance, gesture.action[0].c_str(), gesture.action[1].c_str());
+            }
+
+            for (const auto& binding : keyBindings)
+            {
+                Log("  key %s is held by: %s on %s hand\n", binding.keyName.c_str(), binding.action.c_str(), binding.side ? "right" : "left");
+            }
+        }
+    }
+
+    void Config::Reset()
+    {
+        loaded = false;
+        interactionProfile = XR_NULL_PATH;
+        for (const auto& key : ConfigKeys)
+        {
+            ParseConfigurationValue(*this, key, key.defaultValue);
+        }
+        gestures.clear();
+
+        // The system button opens the Start menu.
+        keyBindings = {
+            { 0, "lwin", VK_LWIN, "/input/system/click" },
+            { 1, "lwin", VK_LWIN, "/input/system/click" },
+        };
+    }
+
+    // Write the description of all the options, for use by external tools.
+    void ExportConfigurationSchema(
+        const std::filesystem::path& path)
+    {
+        static const char* const typeNames[] = { "bool", "int", "float", "string", "vector3", "quaternion", "ignored" };
+
+        std::ofstream schemaFile(path);
+        schemaFile << "[\n";
+        for (size_t i = 0; i < std::size(ConfigKeys); i++)
+        {
+            const ConfigKey& key = ConfigKeys[i];
+            schemaFile << "  { \"name\": \"" << key.name << "\", \"type\": \"" << typeNames[static_cast<int>(key.type)]
+                << "\", \"default\": \"" << key.defaultValue << "\"";
+            if (key.type == ConfigSchema::Type::Int || key.type == ConfigSchema::Type::Float)
+            {
+                if (key.minValue != -FLT_MAX)
+                {
+                    schemaFile << ", \"min\": " << key.minValue;
+                }
+                if (key.maxValue != FLT_MAX)
+                {
+                    schemaFile << ", \"max\": " << key.maxValue;
+                }
+            }
+            schemaFile << " }" << (i + 1 < std::size(ConfigKeys) ? "," : "") << "\n";
+        }
+        schemaFile << "]\n";
+    }
+
+    // The latest configuration snapshot, with everything derived from the options resolved. Snapshots are immutable
+    // once published: updates are parsed into a new copy, then swapped in (see PublishConfiguration()). Each thread
+    // holds a reference on the snapshot it last read, so a replaced snapshot is only freed once no thread uses it
+    // anymore.
+    std::shared_ptr<const Config> publishedConfig;
+
+    // The generation of the latest snapshot, so that the threads can check for a new snapshot without taking a
+    // reference. Bumped for each snapshot, including when the snapshot is reset upon instance creation.
+    std::atomic<uint64_t> configGeneration{ 0 };
+
+    // The snapshot remains valid until the calling thread calls GetConfiguration() again.
+    const Config* GetConfiguration()
+    {
+        return GetThreadSnapshot(publishedConfig, configGeneration);
+    }
+
+    bool IsConfigurationLoaded()
+    {
+        const Config* const snapshot = GetConfiguration();
+        return snapshot && snapshot->loaded;
+    }
+
+    // The compiled configuration files.
+    ProfileStore profileStore;
+
+    // The name of the configuration file that was loaded, if any.
+    std::string activeProfileName;
+
+    // The shared memory block for local tools to push a complete configuration.
+    ControlChannel controlChannel;
+
+    // The thread receiving the updates from the config socket and the control block.
+    std::thread configThread;
+    HANDLE configThreadStopEvent = nullptr;
+
+    // If the application exits without destroying its instance, the thread is already gone: never join it then.
+    struct DetachThreadsOnExit
+    {
+        ~DetachThreadsOnExit()
+        {
+            if (configThread.joinable())
+            {
+                configThread.detach();
+            }
+            if (renderPreparationThread.joinable())
+            {
+                renderPreparationThread.detach();
+            }
+        }
+    } detachThreadsOnExit;
+
+    // General logging function.
+    void Log(
+        const char* fmt,
+        ...)
+    {
+        va_list va;
+        va_start(va, fmt);
+        logger.Write(fmt, va);
+        va_end(va);
+    }
+
+    // Debug logging function. Can make things very slow (enabled on Debug builds, or with the debug_log option).
+    void DebugLog(
+        const char* fmt,
+        ...)
+    {
+        if (logger.IsDebugEnabled())
+        {
+            va_list va;
+            va_start(va, fmt);
+            logger.Write(fmt, va, false /* isRateLimited */);
+            va_end(va);
+        }
+    }
+
+#ifdef HAND_TO_CONTROLLER_TRACK_ALLOCATIONS
+    uint64_t framesCount = 0;
+    uint64_t frameAllocationsCount = 0;
+
+    // The heap allocations made by the calling thread while rebuilding its state after a configuration change.
+    thread_local uint64_t expectedAllocationsCount = 0;
+
+    // Fail on the heap allocations made by a frame hook during its scope, once the warm-up frames have elapsed.
+    class FrameAllocationScope
+    {
+    public:
+        FrameAllocationScope(const char* name)
+            : m_name(name), m_allocationCount(AllocationTracker::GetThreadAllocationCount()),
+              m_expectedAllocationsCount(expectedAllocationsCount)
+        {
+        }
+
+        ~FrameAllocationScope()
+        {
+            const uint64_t count = AllocationTracker::GetThreadAllocationCount() - m_allocationCount -
+                                   (expectedAllocationsCount - m_expectedAllocationsCount);
+            if (count && framesCount >= AllocationTracker::WarmupFrames)
+            {
+                Log("%llu heap allocation(s) in %s during frame %llu\n", count, m_name, framesCount);
+                frameAllocationsCount += count;
+                DebugBreak();
+            }
+        }
+
+    private:
+        const char* const m_name;
+        const uint64_t m_allocationCount;
+        const uint64_t m_expectedAllocationsCount;
+    };
+
+    // Exclude the heap allocations made during its scope from the frame hook's count. Only for the rare events that
+    // rebuild some state, like a configuration change or the first query of an action.
+    class ExpectedAllocationScope
+    {
+    public:
+        ExpectedAllocationScope()
+            : m_allocationCount(AllocationTracker::GetThreadAllocationCount())
+        {
+        }
+
+        ~ExpectedAllocationScope()
+        {
+            expectedAllocationsCount += AllocationTracker::GetThreadAllocationCount() - m_allocationCount;
+        }
+
+    private:
+        const uint64_t m_allocationCount;
+    };
+
+#define TRACK_FRAME_ALLOCATIONS(name) FrameAllocationScope frameAllocationScope(name)
+#define EXPECT_FRAME_ALLOCATIONS() ExpectedAllocationScope expectedAllocationScope
+#else
+#define TRACK_FRAME_ALLOCATIONS(name)
+#define EXPECT_FRAME_ALLOCATIONS()
+#endif
+
+    // Parse an option for a gesture defined in the configuration (the gesture. prefix is already removed):
+    //   gesture.<name>.joints=<joint1>,<joint2> [<joint1>,<joint2>...]
+    //   gesture.<name>.two_handed=<true|false>
+    //   gesture.<name>.near=<distance>
+    //   gesture.<name>.far=<distance>
+    //   gesture.<name>.reduce=<avg|min|max|drop_lowest>
+    //   left.gesture.<name>=<action path>
+    //   right.gesture.<name>=<action path>
+    bool ParseGestureStatement(
+        Config& target,
+        const int side,
+        const std::string& option,
+        const std::string& value)
+    {
+        const auto offset = option.find('.');
+        const std::string gestureName = option.substr(0, offset);
+        const std::string property = offset != std::string::npos ? option.substr(offset + 1) : "";
+        if (gestureName.empty() || (side >= 0) != property.empty())
+        {
+            return false;
+        }
+
+        // Only look up or create the gesture once the statement parsed, so that a bad statement leaves no trace.
+        const auto findGesture = [&]() -> Config::Gesture& {
+            auto gesture = std::find_if(target.gestures.begin(), target.gestures.end(),
+                [&](const auto& entry) { return entry.name == gestureName; });
+            if (gesture == target.gestures.end())
+            {
+                target.gestures.push_back({});
+                gesture = target.gestures.end() - 1;
+                gesture->name = gestureName;
+            }
+            return *gesture;
+        };
+
+        if (side >= 0)
+        {
+            findGesture().action[side] = value;
+        }
+        else if (property == "joints")
+        {
+            std::vector<std::pair<int, int>> joints;
+            std::stringstream ss(value);
+            std::string pair;
+            while (std::getline(ss, pair, ' '))
+            {
+                if (pair.empty())
+                {
+                    continue;
+                }
+
+                const auto comma = pair.find(',');
+                if (comma == std::string::npos || joints.size() == GestureProgram::MaxTerms)
+                {
+                    throw std::out_of_range(pair);
+                }
+                const int joint1 = std::stoi(pair.substr(0, comma));
+                const int joint2 = std::stoi(pair.substr(comma + 1));
+                if (joint1 < 0 || joint1 >= XR_HAND_JOINT_COUNT_EXT || joint2 < 0 || joint2 >= XR_HAND_JOINT_COUNT_EXT)
+                {
+                    throw std::out_of_range(pair);
+                }
+                joints.push_back(std::make_pair(joint1, joint2));
+            }
+            findGesture().joints = joints;
+        }
+        else if (property == "two_handed")
+        {
+            findGesture().isTwoHanded = value == "1" || value == "true";
+        }
+        else if (property == "near")
+        {
+            const float nearDistance = std::stof(value);
+            findGesture().nearDistance = nearDistance;
+        }
+        else if (property == "far")
+        {
+            const float farDistance = std::stof(value);
+            findGesture().farDistance = farDistance;
+        }
+        else if (property == "reduce")
+        {
+            GestureReduce reduce;
+            if (value == "avg")
+            {
+                reduce = GestureReduce::Average;
+            }
+            else if (value == "min")
+            {
+                reduce = GestureReduce::Min;
+            }
+            else if (value == "max")
+            {
+                reduce = GestureReduce::Max;
+            }
+            else if (value == "drop_lowest")
+            {
+                reduce = GestureReduce::DropLowest;
+            }
+            else
+            {
+                throw std::invalid_argument(value);
+            }
+            findGesture().reduce = reduce;
+        }
+        else
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+    // Parse a key name (a-z, 0-9, f1-f24 or one of the names below) or a virtual-key code (eg: 0x5b). Returns 0 if the
+    // key is not recognized.
+    uint16_t ParseVirtualKey(
+        const std::string& name)
+    {
+        static const std::pair<const char*, uint16_t> namedKeys[] = {
+            { "lwin", VK_LWIN }, { "rwin", VK_RWIN }, { "space", VK_SPACE }, { "enter", VK_RETURN },
+            { "escape", VK_ESCAPE }, { "tab", VK_TAB }, { "backspace", VK_BACK }, { "shift", VK_SHIFT },
+            { "control", VK_CONTROL }, { "alt", VK_MENU }, { "left", VK_LEFT }, { "right", VK_RIGHT },
+            { "up", VK_UP }, { "down", VK_DOWN }, { "volume_up", VK_VOLUME_UP }, { "volume_down", VK_VOLUME_DOWN },
+            { "volume_mute", VK_VOLUME_MUTE }, { "media_play_pause", VK_MEDIA_PLAY_PAUSE },
+        };
+        for (const auto& namedKey : namedKeys)
+        {
+            if (name == namedKey.first)
+            {
+                return namedKey.second;
+            }
+        }
+
+        // The virtual-key codes of the letters and digits are their uppercase ASCII code.
+        if (name.size() == 1 && ((name[0] >= 'a' && name[0] <= 'z') || (name[0] >= '0' && name[0] <= '9')))
+        {
+            return static_cast<uint16_t>(toupper(name[0]));
+        }
+
+        if (name.size() >= 2 && name.size() <= 3 && name[0] == 'f' && isdigit(name[1]) && isdigit(name.back()))
+        {
+            const int number = std::stoi(name.substr(1));
+            return number >= 1 && number <= 24 ? static_cast<uint16_t>(VK_F1 + number - 1) : 0;
+        }
+
+        if (name.size() > 2 && name.substr(0, 2) == "0x")
+        {
+            const unsigned long code = std::stoul(name.substr(2), nullptr, 16);
+            return code < 256 ? static_cast<uint16_t>(code) : 0;
+        }
+
+        return 0;
+    }
+
+    // Parse an option binding a keyboard key to an action (the key. prefix is already removed):
+    //   left.key.<key name>=<action path>
+    //   right.key.<key name>=<action path>
+    // An empty action path removes the binding (eg: left.key.lwin= to unbind the system button).
+    bool ParseKeyStatement(
+        Config& target,
+        const int side,
+        const std::string& keyName,
+        const std::string& value)
+    {
+        const uint16_t virtualKey = ParseVirtualKey(keyName);
+        if (side < 0 || !virtualKey)
+        {
+            return false;
+        }
+
+        auto binding = std::find_if(target.keyBindings.begin(), target.keyBindings.end(),
+            [&](const auto& entry) { return entry.side == side && entry.virtualKey == virtualKey; });
+        if (value.empty())
+        {
+            if (binding != target.keyBindings.end())
+            {
+                target.keyBindings.erase(binding);
+            }
+            return true;
+        }
+
+        if (binding == target.keyBindings.end())
+        {
+            target.keyBindings.push_back({ side, keyName, virtualKey });
+            binding = target.keyBindings.end() - 1;
+        }
+        binding->action = value;
+
+        return true;
+    }
+
+    void ParseConfigurationStatement(
+        Config& target,
+        const std::string line,
+        unsigned int lineNumber = 1)
+    {
+        try
+        {
+            // TODO: Usability: handle comments, white spaces, blank lines...
+            const auto offset = line.find('=');
+            if (offset != std::string::npos)
+            {
+                const std::string name = line.substr(0, offset);
+                const std::string value = line.substr(offset + 1);
+                std::string subName;
+                int side = -1;
+
+                if (line.substr(0, 5) == "left.")
+                {
+                    side = 0;
+                    subName = name.substr(5);
+                }
+                else if (line.substr(0, 6) == "right.")
+                {
+                    side = 1;
+                    subName = name.substr(6);
+                }
+
+                const ConfigKey* const key = FindConfigKey(name);
+                if (key)
+                {
+                    if (!ParseConfigurationValue(target, *key, value))
+                    {
+                        Log("L%u: Value out of range\n", lineNumber);
+                    }
+                }
+                else if ((side < 0 ? name : subName).substr(0, 8) == "gesture.")
+                {
+                    if (!ParseGestureStatement(target, side, (side < 0 ? name : subName).substr(8), value))
+                    {
+                        Log("L%u: Unrecognized option\n", lineNumber);
+                    }
+                }
+                else if (side >= 0 && subName.substr(0, 4) == "key.")
+                {
+                    if (!ParseKeyStatement(target, side, subName.substr(4), value))
+                    {
+                        Log("L%u: Unrecognized key\n", lineNumber);
+                    }
+                }
+                else
+                {
+                    Log("L%u: Unrecognized option\n", lineNumber);
+                }
+            }
+            else
+            {
+                Log("L%u: Improperly formatted option\n", lineNumber);
+            }
+        }
+        catch (...)
+        {
+            Log("L%u: Parsing error\n", lineNumber);
+        }
+    }
+
+    // The records of a compiled configuration file. Options from ConfigKeys are stored as the binary value of their field
+    // (or the characters of the string), anything else is stored as a statement to parse.
+    struct CompiledRecord
+    {
+        uint16_t keyIndex;
+        uint16_t size;
+    };
+    constexpr uint16_t StatementRecord = 0xffff;
+
+    // Identifies the format of the compiled configuration. The last value must be incremented when the records change.
+    constexpr uint32_t CompiledConfigurationVersion = ConfigSchema::Mix(ConfigSchema::Fingerprint(ConfigKeys), 1);
+
+    size_t GetConfigurationValueSize(
+        ConfigSchema::Type type)
+    {
+        switch (type)
+        {
+        case ConfigSchema::Type::Bool:
+            return sizeof(bool);
+        case ConfigSchema::Type::Int:
+            return sizeof(int);
+        case ConfigSchema::Type::Float:
+            return sizeof(float);
+        case ConfigSchema::Type::Vector3:
+            return sizeof(XrVector3f);
+        case ConfigSchema::Type::Quaternion:
+            return sizeof(XrQuaternionf);
+        default:
+            return 0;
+        }
+    }
+
+    void AppendCompiledRecord(
+        std::string& records,
+        uint16_t keyIndex,
+        const void* data,
+        size_t size)
+    {
+        const CompiledRecord record{ keyIndex, static_cast<uint16_t>(min(size, (size_t)UINT16_MAX)) };
+        records.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        records.append(reinterpret_cast<const char*>(data), record.size);
+    }
+
+    // Compile a configuration file for the profile store. The values are validated here, so loading the profile does not
+    // need to parse them again.
+    std::string CompileConfiguration(
+        const std::string& configName,
+        std::istream& source)
+    {
+        std::string records;
+
+        Config scratch;
+        scratch.Reset();
+
+        unsigned int lineNumber = 0;
+        std::string line;
+        while (std::getline(source, line))
+        {
+            lineNumber++;
+
+            const auto offset = line.find('=');
+            const ConfigKey* const key = offset != std::string::npos ? FindConfigKey(line.substr(0, offset)) : nullptr;
+            if (!key)
+            {
+                // Errors are reported when loading the profile.
+                if (!line.empty())
+                {
+                    AppendCompiledRecord(records, StatementRecord, line.data(), line.size());
+                }
+                continue;
+            }
+            else if (key->type == ConfigSchema::Type::Ignored)
+            {
+                continue;
+            }
+
+            try
+            {
+                if (!ParseConfigurationValue(scratch, *key, line.substr(offset + 1)))
+                {
+                    Log("%s L%u: Value out of range\n", configName.c_str(), lineNumber);
+                    continue;
+                }
+            }
+            catch (...)
+            {
+                Log("%s L%u: Parsing error\n", configName.c_str(), lineNumber);
+                continue;
+            }
+
+            const uint16_t keyIndex = static_cast<uint16_t>(key - ConfigKeys);
+            const void* const field = key->field(scratch);
+            if (key->type == ConfigSchema::Type::String)
+            {
+                const std::string& value = *static_cast<const std::string*>(field);
+                AppendCompiledRecord(records, keyIndex, value.data(), value.size());
+            }
+            else
+            {
+                AppendCompiledRecord(records, keyIndex, field, GetConfigurationValueSize(key->type));
+            }
+        }
+
+        return records;
+    }
+
+    void ApplyCompiledConfiguration(
+        Config& target,
+        std::string_view records)
+    {
+        while (records.size() >= sizeof(CompiledRecord))
+        {
+            CompiledRecord record;
+            memcpy(&record, records.data(), sizeof(record));
+            const std::string_view data = records.substr(sizeof(record), record.size);
+            records.remove_prefix(sizeof(record) + data.size());
+
+            if (record.keyIndex == StatementRecord)
+            {
+                ParseConfigurationStatement(target, std::string(data));
+            }
+            else if (record.keyIndex < std::size(ConfigKeys))
+            {
+                const ConfigKey& key = ConfigKeys[record.keyIndex];
+                void* const field = key.field(target);
+                if (key.type == ConfigSchema::Type::String)
+                {
+                    static_cast<std::string*>(field)->assign(data);
+                }
+                else if (data.size() == GetConfigurationValueSize(key.type))
+                {
+                    memcpy(field, data.data(), data.size());
+                }
+            }
+        }
+    }
+
+    // Load configuration for our layer.
+    bool LoadConfiguration(
+        Config& target,
+        const std::string configName)
+    {
+        if (configName.empty())
+        {
+            return false;
+        }
+
+        std::string_view records;
+        if (profileStore.Find(configName, records))
+        {
+            Log("Loading config for \"%s\"\n", configName.c_str());
+
+            ApplyCompiledConfiguration(target, records);
+
+            target.loaded = true;
+            activeProfileName = configName;
+
+            return true;
+        }
+
+        Log("Could not load config for \"%s\"\n", configName.c_str());
+
+        return false;
+    }
+
+    // Resolve everything derived from the options of a snapshot, before it is published.
+    void ResolveConfiguration(
+        Config& snapshot)
+    {
+        for (int side = 0; side <= 1; side++)
+        {
+#define RESOLVE_ACTION(configName) \
+            snapshot.configName##Target[side] = ResolveActionTarget(side, snapshot.configName##Action[side]);
+
+            RESOLVE_ACTION(pinch);
+            RESOLVE_ACTION(thumbPress);
+            RESOLVE_ACTION(indexBend);
+            RESOLVE_ACTION(fingerGun);
+            RESOLVE_ACTION(squeeze);
+            RESOLVE_ACTION(palmTap);
+            RESOLVE_ACTION(wristTap);
+            RESOLVE_ACTION(indexTipTap);
+            RESOLVE_ACTION(custom1);
+
+#undef RESOLVE_ACTION
+
+            for (auto& gesture : snapshot.gestures)
+            {
+                gesture.target[side] = ResolveActionTarget(side, gesture.action[side]);
+            }
+
+            const bool isHandEnabled = side == 0 ? snapshot.leftHandEnabled : snapshot.rightHandEnabled;
+            for (int isGrip = 0; isGrip <= 1; isGrip++)
+            {
+                Config::SimulatedSpace& simulatedSpace = snapshot.simulatedSpaces[side][isGrip];
+                simulatedSpace.isSimulated = isHandEnabled;
+                simulatedSpace.joint = isGrip ? snapshot.gripJointIndex : snapshot.aimJointIndex;
+                simulatedSpace.transform = snapshot.transform[side];
+            }
+        }
+
+        // Keys follow the boolean view of the action.
+        for (auto& binding : snapshot.keyBindings)
+        {
+            const ActionTarget target = ResolveActionTarget(binding.side, binding.action);
+            binding.slot = target.clickSlot >= 0 ? target.clickSlot : target.valueSlot;
+        }
+    }
+
+    // Check the values against the schema, and the options that depend on each other. The values are range-checked
+    // when parsed, but the compiled profiles are not parsed again.
+    bool ValidateConfiguration(
+        const Config& candidate)
+    {
+        bool isValid = true;
+
+        for (const auto& key : ConfigKeys)
+        {
+            if (key.type != ConfigSchema::Type::Int && key.type != ConfigSchema::Type::Float)
+            {
+                continue;
+            }
+
+            const void* const field = key.field(const_cast<Config&>(candidate));
+            if ((key.type == ConfigSchema::Type::Int &&
+                    !(*static_cast<const int*>(field) >= key.minValue && *static_cast<const int*>(field) <= key.maxValue)) ||
+                (key.type == ConfigSchema::Type::Float &&
+                    !(*static_cast<const float*>(field) >= key.minValue && *static_cast<const float*>(field) <= key.maxValue)))
+            {
+                Log("%s is out of range\n", key.name);
+                isValid = false;
+            }
+        }
+
+#define VALIDATE_ACTION(configString, configName)                                                   \
+        if (!(candidate.configName##Near < candidate.configName##Far))                              \
+        {                                                                                           \
+            Log(configString ".near must be less than " configString ".far\n");                     \
+            isValid = false;                                                                        \
+        }
+
+        VALIDATE_ACTION("pinch", pinch);
+        VALIDATE_ACTION("thumb_press", thumbPress);
+        VALIDATE_ACTION("index_bend", indexBend);
+        VALIDATE_ACTION("finger_gun", fingerGun);
+        VALIDATE_ACTION("squeeze", squeeze);
+        VALIDATE_ACTION("palm_tap", palmTap);
+        VALIDATE_ACTION("wrist_tap", wristTap);
+        VALIDATE_ACTION("index_tip_tap", indexTipTap);
+        VALIDATE_ACTION("custom1", custom1);
+
+#undef VALIDATE_ACTION
+
+        for (const auto& gesture : candidate.gestures)
+        {
+            if (!(gesture.nearDistance < gesture.farDistance))
+            {
+                Log("gesture.%s.near must be less than gesture.%s.far\n", gesture.name.c_str(), gesture.name.c_str());
+                isValid = false;
+            }
+
+            bool isJointValid = gesture.joints.size() <= GestureProgram::MaxTerms;
+            for (const auto& joints : gesture.joints)
+            {
+                isJointValid = isJointValid && joints.first >= 0 && joints.first < XR_HAND_JOINT_COUNT_EXT &&
+                    joints.second >= 0 && joints.second < XR_HAND_JOINT_COUNT_EXT;
+            }
+            if (!isJointValid)
+            {
+                Log("gesture.%s.joints is out of range\n", gesture.name.c_str());
+                isValid = false;
+            }
+        }
+
+        return isValid;
+    }
+
+    // Log the options that differ between two configurations.
+    void LogConfigurationChanges(
+        const Config& before,
+        const Config& after)
+    {
+        for (const auto& key : ConfigKeys)
+        {
+            if (key.type == ConfigSchema::Type::Ignored)
+            {
+                continue;
+            }
+
+            const std::string beforeValue = FormatConfigurationValue(before, key);
+            const std::string afterValue = FormatConfigurationValue(after, key);
+            if (beforeValue != afterValue)
+            {
+                Log("  %s: %s -> %s\n", key.name, beforeValue.c_str(), afterValue.c_str());
+            }
+        }
+
+        const auto findGesture = [](const Config& source, const std::string& name) -> const Config::Gesture* {
+            for (const auto& gesture : source.gestures)
+            {
+                if (gesture.name == name)
+                {
+                    return &gesture;
+                }
+            }
+            return nullptr;
+        };
+        for (const auto& gesture : after.gestures)
+        {
+            const Config::Gesture* const previous = findGesture(before, gesture.name);
+            if (!previous)
+            {
+                Log("  gesture %s: added\n", gesture.name.c_str());
+            }
+            else if (previous->joints != gesture.joints || previous->isTwoHanded != gesture.isTwoHanded ||
+                previous->nearDistance != gesture.nearDistance || previous->farDistance != gesture.farDistance ||
+                previous->reduce != gesture.reduce || previous->action[0] != gesture.action[0] || previous->action[1] != gesture.action[1])
+            {
+                Log("  gesture %s: changed\n", gesture.name.c_str());
+            }
+        }
+        for (const auto& gesture : before.gestures)
+        {
+            if (!findGesture(after, gesture.name))
+            {
+                Log("  gesture %s: removed\n", gesture.name.c_str());
+            }
+        }
+
+        bool keyBindingsChanged = before.keyBindings.size() != after.keyBindings.size();
+        for (size_t i = 0; !keyBindingsChanged && i < after.keyBindings.size(); i++)
+        {
+            keyBindingsChanged = before.keyBindings[i].side != after.keyBindings[i].side ||
+                before.keyBindings[i].virtualKey != after.keyBindings[i].virtualKey ||
+                before.keyBindings[i].action != after.keyBindings[i].action;
+        }
+        if (keyBindingsChanged)
+        {
+            Log("  key bindings: changed\n");
+        }
+    }
+
+    // Resolve how to simulate an action space for a configuration snapshot: poseInActionSpace is pre-composed with the
+    // configured transform.
+    void ResolveActionSpace(
+        ActionSpace& actionSpace,
+        const Config& snapshot)
+    {
+        const Config::SimulatedSpace& simulatedSpace = snapshot.simulatedSpaces[actionSpace.side][actionSpace.isGrip ? 1 : 0];
+        actionSpace.isSimulated = (actionSpace.isGrip || actionSpace.isAim) && simulatedSpace.isSimulated;
+        actionSpace.joint = simulatedSpace.joint;
+        actionSpace.transform = Pose::Multiply(actionSpace.poseInActionSpace, simulatedSpace.transform);
+    }
+
+    // Make a new configuration snapshot visible to the hooks, unless it is not valid. Only called by the configuration
+    // thread, or upon instance creation before that thread starts.
+    bool PublishConfiguration(
+        std::unique_ptr<Config> snapshot)
+    {
+        if (!ValidateConfiguration(*snapshot))
+        {
+            Log("Ignoring the configuration update, since it is not valid\n");
+            return false;
+        }
+        if (const Config* const current = GetConfiguration())
+        {
+            LogConfigurationChanges(*current, *snapshot);
+        }
+
+        ResolveConfiguration(*snapshot);
+        const uint64_t generation = configGeneration.load(std::memory_order_relaxed) + 1;
+        snapshot->generation = generation;
+
+        logger.SetDebugEnabled(snapshot->debugLogEnabled);
+        inputInjector.SetRepeat(snapshot->keyRepeatDelay, snapshot->keyRepeatInterval);
+        inputInjector.SetMaxPressRate(snapshot->keyRateLimit);
+
+        const std::shared_ptr<const Config> published(std::move(snapshot));
+        std::atomic_store(&publishedConfig, published);
+        configGeneration.store(generation, std::memory_order_release);
+
+        // The action spaces created meanwhile are resolved for the new snapshot already.
+        UpdateBindings([&](Bindings& bindings) {
+            for (auto& actionSpace : bindings.spaces)
+            {
+                ResolveActionSpace(actionSpace.second, *published);
+            }
+        });
+
+        return true;
+    }
+
+    // Carry over the options that cannot change after instance creation into a snapshot built from a complete
+    // configuration.
+    void KeepInstanceConfiguration(
+        Config& snapshot)
+    {
+        // The interaction profile is only resolved upon instance creation.
+        const Config* const current = GetConfiguration();
+        snapshot.loaded = current->loaded;
+        snapshot.rawInteractionProfile = current->rawInteractionProfile;
+        snapshot.interactionProfile = current->interactionProfile;
+    }
+
+    // Build a snapshot from a complete configuration received through the control block.
+    std::unique_ptr<Config> ParseControlBlock(
+        const std::string& payload)
+    {
+        auto snapshot = std::make_unique<Config>();
+        snapshot->Reset();
+
+        unsigned int lineNumber = 0;
+        std::stringstream ss(payload);
+        std::string line;
+        while (std::getline(ss, line))
+        {
+            lineNumber++;
+            if (!line.empty())
+            {
+                ParseConfigurationStatement(*snapshot, line, lineNumber);
+            }
+        }
+        KeepInstanceConfiguration(*snapshot);
+
+        Log("Applying config from the control block\n");
+
+        return snapshot;
+    }
+
+    // Recompile the active configuration file if it was modified. Returns nothing if the file did not change.
+    std::unique_ptr<Config> ReloadConfiguration(
+        const std::filesystem::path& configFile,
+        std::filesystem::file_time_type& lastWriteTime)
+    {
+        std::error_code error;
+        const auto writeTime = std::filesystem::last_write_time(configFile, error);
+        if (error || writeTime == lastWriteTime)
+        {
+            return nullptr;
+        }
+        lastWriteTime = writeTime;
+
+        std::string_view records;
+        if (!profileStore.Find(activeProfileName, records))
+        {
+            return nullptr;
+        }
+
+        auto snapshot = std::make_unique<Config>();
+        snapshot->Reset();
+        ApplyCompiledConfiguration(*snapshot, records);
+        KeepInstanceConfiguration(*snapshot);
+
+        Log("Reloading config for \"%s\"\n", activeProfileName.c_str());
+
+        return snapshot;
+    }
+
+    // Receive the configuration updates (typically from the ConfigUI, from a local tool through the control block, or
+    // from changes to the configuration file) and publish them as new snapshots, so that the frame hooks never have to
+    // poll anything, read anything or parse anything.
+    void ConfigurationThread()
+    {
+        HANDLE events[4];
+        DWORD eventsCount = 0;
+        events[eventsCount++] = configThreadStopEvent;
+
+        // Watch the directory of the configuration files. The profile store tells us whether the active one changed.
+        const std::filesystem::path configDirectory = !dllHome.empty() ? std::filesystem::path(dllHome) : std::filesystem::path(".");
+        const std::filesystem::path configFile = configDirectory / std::filesystem::path(activeProfileName + ".cfg");
+        std::error_code error;
+        auto configFileWriteTime = std::filesystem::last_write_time(configFile, error);
+        HANDLE fileChanges = INVALID_HANDLE_VALUE;
+        DWORD fileChangesStatus = WAIT_FAILED;
+        if (!activeProfileName.empty())
+        {
+            fileChanges = FindFirstChangeNotificationA(configDirectory.string().c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+            if (fileChanges != INVALID_HANDLE_VALUE)
+            {
+                fileChangesStatus = WAIT_OBJECT_0 + eventsCount;
+                events[eventsCount++] = fileChanges;
+            }
+        }
+
+        WSAEVENT socketEvent = WSA_INVALID_EVENT;
+        if (configSocket != INVALID_SOCKET)
+        {
+            socketEvent = WSACreateEvent();
+            WSAEventSelect(configSocket, socketEvent, FD_READ);
+            events[eventsCount++] = socketEvent;
+        }
+        if (controlChannel.IsOpen())
+        {
+            events[eventsCount++] = controlChannel.GetUpdateEvent();
+        }
+
+        std::string payload;
+        DWORD status = WAIT_TIMEOUT;
+        while (true)
+        {
+            std::unique_ptr<Config> snapshot;
+            if (status == fileChangesStatus)
+            {
+                FindNextChangeNotification(fileChanges);
+
+                // Let the editor finish writing the file.
+                if (WaitForSingleObject(configThreadStopEvent, 200) == WAIT_OBJECT_0)
+                {
+                    break;
+                }
+                snapshot = ReloadConfiguration(configFile, configFileWriteTime);
+            }
+
+            // A complete configuration from the control block replaces the current one.
+            if (controlChannel.Read(payload))
+            {
+                if (auto parsed = ParseControlBlock(payload))
+                {
+                    snapshot = std::move(parsed);
+                }
+            }
+
+            // Coalesce all the pending updates from the socket into a single snapshot.
+            if (socketEvent != WSA_INVALID_EVENT)
+            {
+                WSAResetEvent(socketEvent);
+                while (true)
+                {
+                    struct sockaddr_in saddr;
+                    char buffer[100];
+                    int slen = sizeof(saddr);
+                    const int len = recvfrom(configSocket, buffer, sizeof(buffer), 0, (struct sockaddr*)&saddr, &slen);
+                    if (len <= 0)
+                    {
+                        break;
+                    }
+
+                    if (!snapshot)
+                    {
+                        snapshot = std::make_unique<Config>(*GetConfiguration());
+                    }
+
+                    const std::string line(buffer, len);
+                    ParseConfigurationStatement(*snapshot, line);
+                }
+            }
+
+            if (snapshot)
+            {
+                PublishConfiguration(std::move(snapshot));
+            }
+
+            status = WaitForMultipleObjects(eventsCount, events, FALSE, INFINITE);
+            if (status == WAIT_OBJECT_0 || status == WAIT_FAILED)
+            {
+                break;
+            }
+        }
+
+        if (fileChanges != INVALID_HANDLE_VALUE)
+        {
+            FindCloseChangeNotification(fileChanges);
+        }
+
+        if (socketEvent != WSA_INVALID_EVENT)
+        {
+            WSAEventSelect(configSocket, nullptr, 0);
+            WSACloseEvent(socketEvent);
+        }
+    }
+
+    // The configuration that the gesture evaluation is derived from. Only used by the simulation thread, which picks up
+    // the new snapshots in xrSyncActions() (see RefreshSimulationConfiguration()).
+    std::shared_ptr<const Config> simulationConfig;
 
-        // The index of the joint (see enum XrHandJointEXT) to use for the grip pose.
-        int gripJointIndex;
+    // The polledActionsCount that the gesture evaluation was last derived from.
+    uint32_t simulationPolledActionsCount = 0;
 
-        // The threshold (between 0 and 1) when converting a float action into a boolean action and the action is true.
-        float clickThreshold;
+    // Whether the press of each key binding of the simulation configuration was pushed to the input injector.
+    std::vector<bool> isKeyPressed;
 
+    // The releases for the keys of the previous key bindings that did not fit in the input injector queue yet.
+    std::vector<uint16_t> pendingKeyReleases;
 
-        // The transformation to apply to the aim and grip poses.
-        XrPosef transform[2];
+    // Whether the value of a slot is observed, either by the application or by the layer itself.
+    bool IsActionLive(
+        const int slot)
+    {
+        if (slot < 0)
+        {
+            return false;
+        }
+        if (isActionPolled[slot].load(std::memory_order_relaxed))
+        {
+            return true;
+        }
+        for (const auto& binding : simulationConfig->keyBindings)
+        {
+            if (binding.slot == slot)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
 
-        // The index of the 1st joint (see enum XrHandJointEXT) to use for 1st custom gesture.
-        int custom1Joint1Index;
+    void RecordActionValue(
+        const float value,
+        const ActionTarget& target);
 
-        // The index of the 2nd joint (see enum XrHandJointEXT) to use for 1st custom gesture.
-        int custom1Joint2Index;
+    // Where the gesture kernels (see GestureKernels.h) record the action values.
+    struct ActionRecorder
+    {
+        static void Record(
+            const float value,
+            const int valueSlot,
+            const int clickSlot)
+        {
+            RecordActionValue(value, { valueSlot, clickSlot });
+        }
+    };
 
-        // The target XrAction path for a given gesture, and the near/far threshold to map the float action too (near maps to 1, far maps to 0).
+    // Whether each built-in gesture needs to be evaluated, and the index of the distance it measures. These depend on
+    // the actions observed, so they are resolved by UpdateGestureDependencies() on the simulation thread.
+    struct GestureDependencies
+    {
 #define DEFINE_ACTION(configName)           \
-        std::string configName##Action[2];  \
-        float configName##Near;             \
-        float configName##Far;
+        bool configName##IsLive[2]{};       \
+        int configName##Distance = -1;
 
         DEFINE_ACTION(pinch);
         DEFINE_ACTION(thumbPress);
@@ -164,345 +1735,348 @@ namespace {
         DEFINE_ACTION(custom1);
 
 #undef DEFINE_ACTION
+    };
+    GestureDependencies gestureDependencies;
+
+    uint32_t gestureMask[2]{ 0, 0 };
+    GestureKernel<ActionRecorder> gestureKernel[2]{ nullptr, nullptr };
+
+    // The built-in gestures resolved for each hand, for the gesture kernels.
+    BuiltinGestures builtinGestures[2]{};
+
+    // The gestures from the configuration, compiled for each hand.
+    GestureProgram gestureProgram[2];
+
+    // Determine which gestures feed an observed action, and register the distances that these gestures need. Must be
+    // called whenever the simulation configuration changes or an action is polled for the first time.
+    void UpdateGestureDependencies()
+    {
+        if (!simulationConfig)
+        {
+            return;
+        }
+        const Config& cfg = *simulationConfig;
+        GestureDependencies& dependencies = gestureDependencies;
+
+        uint32_t liveCount = 0;
+        for (int side = 0; side <= 1; side++)
+        {
+            const bool isHandEnabled = side == 0 ? cfg.leftHandEnabled : cfg.rightHandEnabled;
+
+#define UPDATE_ACTION(configName)                                                                                   \
+            dependencies.configName##IsLive[side] = isHandEnabled &&                                                \
+                (IsActionLive(cfg.configName##Target[side].valueSlot) || IsActionLive(cfg.configName##Target[side].clickSlot)); \
+            liveCount += dependencies.configName##IsLive[side] ? 1 : 0;
+
+            UPDATE_ACTION(pinch);
+            UPDATE_ACTION(thumbPress);
+            UPDATE_ACTION(indexBend);
+            UPDATE_ACTION(fingerGun);
+            UPDATE_ACTION(squeeze);
+            UPDATE_ACTION(palmTap);
+            UPDATE_ACTION(wristTap);
+            UPDATE_ACTION(indexTipTap);
+            UPDATE_ACTION(custom1);
+
+#undef UPDATE_ACTION
+        }
 
-        void Dump()
+        // Only measure the distances needed by the live gestures.
+        handFeatures.ClearDistances();
+
+#define ADD_DISTANCE(configName, joint1, joint2, isTwoHanded)                                                       \
+        dependencies.configName##Distance = (dependencies.configName##IsLive[0] || dependencies.configName##IsLive[1]) ? \
+            handFeatures.AddDistance(joint1, joint2, isTwoHanded) : -1;
+
+        ADD_DISTANCE(pinch, XR_HAND_JOINT_THUMB_TIP_EXT, XR_HAND_JOINT_INDEX_TIP_EXT, false);
+        ADD_DISTANCE(thumbPress, XR_HAND_JOINT_INDEX_INTERMEDIATE_EXT, XR_HAND_JOINT_THUMB_TIP_EXT, false);
+        ADD_DISTANCE(indexBend, XR_HAND_JOINT_INDEX_PROXIMAL_EXT, XR_HAND_JOINT_INDEX_TIP_EXT, false);
+        ADD_DISTANCE(fingerGun, XR_HAND_JOINT_THUMB_TIP_EXT, XR_HAND_JOINT_MIDDLE_INTERMEDIATE_EXT, false);
+        ADD_DISTANCE(custom1, cfg.custom1Joint1Index, cfg.custom1Joint2Index, false);
+        ADD_DISTANCE(palmTap, XR_HAND_JOINT_PALM_EXT, XR_HAND_JOINT_INDEX_TIP_EXT, true);
+        ADD_DISTANCE(wristTap, XR_HAND_JOINT_WRIST_EXT, XR_HAND_JOINT_INDEX_TIP_EXT, true);
+        ADD_DISTANCE(indexTipTap, XR_HAND_JOINT_INDEX_TIP_EXT, XR_HAND_JOINT_INDEX_TIP_EXT, true);
+
+#undef ADD_DISTANCE
+
+        // Compile the programs for the live gestures from the configuration.
+        for (int side = 0; side <= 1; side++)
         {
-            if (loaded)
+            const bool isHandEnabled = side == 0 ? cfg.leftHandEnabled : cfg.rightHandEnabled;
+
+            gestureProgram[side].Clear();
+            for (const auto& gesture : cfg.gestures)
             {
-                Log("Emulating interaction profile: %s\n", rawInteractionProfile.c_str());
-                if (displayEnabled)
-                {
-                    Log("Hands display is enabled in projection layer %d with %s depth buffer\n", projLayerIndex, useOwnDepthBuffer ? "own" : "app (if available)");
-                    Log("Using %s skin tone and %.3f opacity\n", skinTone == 0 ? "bright" : skinTone == 1 ? "medium" : "dark", opacity);
-                }
-                if (leftHandEnabled)
-                {
-                    Log("Left transform: (%.3f, %.3f, %.3f) (%.3f, %.3f, %.3f, %.3f)\n",
-                        transform[0].position.x, transform[0].position.y, transform[0].position.z,
-                        transform[0].orientation.x, transform[0].orientation.y, transform[0].orientation.z, transform[0].orientation.w);
-                }
-                if (rightHandEnabled)
+                const bool isLive = isHandEnabled && !gesture.joints.empty() &&
+                    (IsActionLive(gesture.target[side].valueSlot) || IsActionLive(gesture.target[side].clickSlot));
+                if (!isLive)
                 {
-                    Log("Right transform: (%.3f, %.3f, %.3f) (%.3f, %.3f, %.3f, %.3f)\n",
-                        transform[1].position.x, transform[1].position.y, transform[1].position.z,
-                        transform[1].orientation.x, transform[1].orientation.y, transform[1].orientation.z, transform[1].orientation.w);
+                    continue;
                 }
-                if (leftHandEnabled || rightHandEnabled)
+                liveCount++;
+
+                int distances[GestureProgram::MaxTerms];
+                uint32_t count = 0;
+                for (const auto& joints : gesture.joints)
                 {
-                    Log("Grip pose uses joint: %d\n", gripJointIndex);
-                    Log("Aim pose uses joint: %d\n", aimJointIndex);
-                    Log("Click threshold: %.3f\n", clickThreshold);
+                    distances[count] = handFeatures.AddDistance(joints.first, joints.second, gesture.isTwoHanded);
+                    if (distances[count] < 0)
+                    {
+                        break;
+                    }
+                    count++;
                 }
-                if (custom1Joint1Index >= 0 && custom1Joint2Index >= 0)
+
+                if (count != gesture.joints.size())
                 {
-                    Log("Custom gesture uses joints: %d %d\n", custom1Joint1Index, custom1Joint2Index);
+                    Log("Too many joint pairs to measure, ignoring gesture %s\n", gesture.name.c_str());
+                    continue;
                 }
-                for (int side = 0; side <= 1; side++)
-                {
-                    if ((side == 0 && !leftHandEnabled) || (side == 1 && !rightHandEnabled))
-                    {
-                        continue;
-                    }
 
-#define LOG_IF_SET(actionName, configName)                                                                          \
-                    if (!configName##Action[side].empty())                                                          \
-                    {                                                                                               \
-                        Log("%s hand " #actionName " translates to: %s (near: %.3f, far: %.3f)\n", side ? "Right" : "Left",    \
-                            configName##Action[side].c_str(), configName##Near, configName##Far);                   \
-                    }
+                gestureProgram[side].AddGesture(distances, count, gesture.isTwoHanded, gesture.nearDistance, gesture.farDistance, gesture.reduce,
+                    gesture.target[side].valueSlot, gesture.target[side].clickSlot);
+            }
+        }
 
-                    LOG_IF_SET("pinch", pinch);
-                    LOG_IF_SET("thumb press", thumbPress);
-                    LOG_IF_SET("index bend", indexBend);
-                    LOG_IF_SET("finger gun", fingerGun);
-                    LOG_IF_SET("squeeze", squeeze);
-                    LOG_IF_SET("palm tap", palmTap);
-                    LOG_IF_SET("wrist tap", wristTap);
-                    LOG_IF_SET("index tip tap", indexTipTap);
-                    LOG_IF_SET("custom gesture", custom1);
-
-#undef LOG_IF_SET
-                }
+        // Select the specialized evaluation for each hand.
+        for (int side = 0; side <= 1; side++)
+        {
+            uint32_t mask = 0;
+
+#define SET_BIT(configName, bit)                                                                                    \
+            if (dependencies.configName##IsLive[side] && dependencies.configName##Distance >= 0)                    \
+            {                                                                                                       \
+                mask |= bit;                                                                                        \
+            }
+
+            SET_BIT(pinch, PinchBit);
+            SET_BIT(thumbPress, ThumbPressBit);
+            SET_BIT(indexBend, IndexBendBit);
+            SET_BIT(fingerGun, FingerGunBit);
+            SET_BIT(custom1, Custom1Bit);
+            SET_BIT(palmTap, PalmTapBit);
+            SET_BIT(wristTap, WristTapBit);
+            SET_BIT(indexTipTap, IndexTipTapBit);
+
+#undef SET_BIT
+
+            if (dependencies.squeezeIsLive[side])
+            {
+                mask |= SqueezeBit;
             }
+
+#define RESOLVE_GESTURE(configName)                                                                                 \
+            builtinGestures[side].configName = { dependencies.configName##Distance, cfg.configName##Near, cfg.configName##Far, \
+                cfg.configName##Target[side].valueSlot, cfg.configName##Target[side].clickSlot };
+
+            RESOLVE_GESTURE(pinch);
+            RESOLVE_GESTURE(thumbPress);
+            RESOLVE_GESTURE(indexBend);
+            RESOLVE_GESTURE(fingerGun);
+            RESOLVE_GESTURE(squeeze);
+            RESOLVE_GESTURE(palmTap);
+            RESOLVE_GESTURE(wristTap);
+            RESOLVE_GESTURE(indexTipTap);
+            RESOLVE_GESTURE(custom1);
+
+#undef RESOLVE_GESTURE
+
+            gestureMask[side] = mask;
+            gestureKernel[side] = SelectGestureKernel<ActionRecorder>(mask);
         }
 
-        void Reset()
-        {
-            loaded = false;
-            // NOTE: Have to maintain parity with Form1 ctor in Form1.cs.
-            rawInteractionProfile = "/interaction_profiles/hp/mixed_reality_controller";
-            interactionProfile = XR_NULL_PATH;
-            leftHandEnabled = true;
-            rightHandEnabled = true;
-            displayEnabled = true;
-            useOwnDepthBuffer = false;
-            skinTone = 1; // Medium
-            opacity = 1.0f;
-            projLayerIndex = 0;
-            aimJointIndex = XR_HAND_JOINT_INDEX_INTERMEDIATE_EXT;
-            gripJointIndex = XR_HAND_JOINT_PALM_EXT;
-            clickThreshold = 0.75f;
-            transform[0] = transform[1] = Pose::Identity();
-            pinchAction[0] = pinchAction[1] = "/input/trigger/value";
-            pinchNear = 0.0f;
-            pinchFar = 0.05f;
-            thumbPressAction[0] = thumbPressAction[1] = "";
-            thumbPressNear = 0.0f;
-            thumbPressFar = 0.05f;
-            indexBendAction[0] = indexBendAction[1] = "";
-            indexBendNear = 0.045f;
-            indexBendFar = 0.07f;
-            fingerGunAction[0] = fingerGunAction[1] = "";
-            fingerGunNear = 0.01f;
-            fingerGunFar = 0.03f;
-            squeezeAction[0] = squeezeAction[1] = "/input/squeeze/value";
-            squeezeNear = 0.035f;
-            squeezeFar = 0.07f;
-            palmTapAction[0] = palmTapAction[1] = "";
-            palmTapNear = 0.02f;
-            palmTapFar = 0.06f;
-            wristTapAction[0] = "/input/menu/click";
-            wristTapAction[1] = "";
-            wristTapNear = 0.04f;
-            wristTapFar = 0.05f;
-            // This gesture only makes sense for one hand, but we leave it symmetrical for simplicity.
-            indexTipTapAction[0] = "/input/b/click";
-            indexTipTapAction[1] = "";
-            indexTipTapNear = 0.0f;
-            indexTipTapFar = 0.07f;
-            // Custom gesture is unconfigured.
-            custom1Action[0] = custom1Action[1] = "";
-            custom1Joint1Index = -1;
-            custom1Joint2Index = -1;
-            custom1Near = 0.0f;
-            custom1Far = 0.1f;
-        }
-    } config;
-
-    // Utility logging function.
-    void InternalLog(
-        const char* fmt,
-        va_list va)
-    {
-        const std::time_t now = std::time(nullptr);
+        DebugLog("%u gesture(s) are live, masks are 0x%x 0x%x\n", liveCount, gestureMask[0], gestureMask[1]);
+    }
 
-        char buf[1024];
-        size_t offset = std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S %z: ", std::localtime(&now));
-        _vsnprintf_s(buf + offset, sizeof(buf) - offset, sizeof(buf) - offset, fmt, va);
-        OutputDebugStringA(buf);
-        if (logStream.is_open())
+    // Queue the releases for the keys pressed for the key bindings of the simulation configuration. They are pushed by
+    // PushPendingKeyReleases().
+    void ReleaseBoundKeys()
+    {
+        for (size_t i = 0; i < isKeyPressed.size(); i++)
         {
-            logStream << buf;
-            logStream.flush();
+            if (isKeyPressed[i])
+            {
+                pendingKeyReleases.push_back(simulationConfig->keyBindings[i].virtualKey);
+                isKeyPressed[i] = false;
+            }
         }
     }
 
-    // General logging function.
-    void Log(
-        const char* fmt,
-        ...)
+    // Push the queued key releases to the input injector. Returns false if some did not fit in the queue, in which case
+    // they are pushed again with the next sync.
+    bool PushPendingKeyReleases()
     {
-        va_list va;
-        va_start(va, fmt);
-        InternalLog(fmt, va);
-        va_end(va);
+        size_t pushedCount = 0;
+        while (pushedCount < pendingKeyReleases.size() && inputInjector.Push(pendingKeyReleases[pushedCount], false))
+        {
+            pushedCount++;
+        }
+        pendingKeyReleases.erase(pendingKeyReleases.begin(), pendingKeyReleases.begin() + pushedCount);
+        return pendingKeyReleases.empty();
     }
 
-    // Debug logging function. Can make things very slow (only enabled on Debug builds).
-    void DebugLog(
-        const char* fmt,
-        ...)
+    // Pick up the latest configuration snapshot and the newly polled actions on the simulation thread, and refresh the
+    // gesture evaluation for them.
+    void RefreshSimulationConfiguration()
     {
-#ifdef _DEBUG
-        va_list va;
-        va_start(va, fmt);
-        InternalLog(fmt, va);
-        va_end(va);
-#endif
+        const bool isConfigurationChanged =
+            !simulationConfig || simulationConfig->generation != configGeneration.load(std::memory_order_acquire);
+        const uint32_t polledCount = polledActionsCount.load(std::memory_order_acquire);
+        if (!isConfigurationChanged && polledCount == simulationPolledActionsCount)
+        {
+            return;
+        }
+
+        EXPECT_FRAME_ALLOCATIONS();
+
+        if (isConfigurationChanged)
+        {
+            ReleaseBoundKeys();
+
+            simulationConfig = std::atomic_load(&publishedConfig);
+            isKeyPressed.assign(simulationConfig->keyBindings.size(), false);
+        }
+        simulationPolledActionsCount = polledCount;
+        UpdateGestureDependencies();
     }
 
-    void ParseConfigurationStatement(
-        const std::string line,
-        unsigned int lineNumber = 1)
+    // Called by xrSyncActions() once the hands are located in the reference space.
+    void PublishHands(const HandJointsSnapshot* const hands[2])
     {
-        try
+        PublishedHands published;
+        published.hands[0] = *hands[0];
+        published.hands[1] = *hands[1];
+        publishedHands.Write(published);
+
+        if (renderPreparationEvent)
         {
-            // TODO: Usability: handle comments, white spaces, blank lines...
-            const auto offset = line.find('=');
-            if (offset != std::string::npos)
-            {
-                const std::string name = line.substr(0, offset);
-                const std::string value = line.substr(offset + 1);
-                std::string subName;
-                int side = -1;
+            SetEvent(renderPreparationEvent);
+        }
+    }
 
-                if (line.substr(0, 5) == "left.")
-                {
-                    side = 0;
-                    subName = name.substr(5);
-                }
-                else if (line.substr(0, 6) == "right.")
-                {
-                    side = 1;
-                    subName = name.substr(6);
-                }
+    // Seed the cache of a thread other than the simulation thread with the hands published for the frame, so that only
+    // the hands not located yet for this frame are located. The cache is only seeded again once new hands are published.
+    void SeedHandJointsCache(
+        HandJointsCache& cache,
+        uint32_t& seededSequence)
+    {
+        if (publishedHands.GetSequence() == seededSequence)
+        {
+            return;
+        }
 
-                if (name == "interaction_profile")
-                {
-                    config.rawInteractionProfile = value;
-                }
-                else if (name == "display.enabled")
-                {
-                    config.displayEnabled = value == "1" || value == "true";
-                }
-                else if (name == "force_own_depth_buffer")
-                {
-                    config.useOwnDepthBuffer = value == "1" || value == "true";
-                }
-                else if (name == "skin_tone")
-                {
-                    config.skinTone = std::stoi(value);
-                }
-                else if (name == "opacity")
-                {
-                    config.opacity = std::stof(value);
-                }
-                else if (name == "proj_layer_index")
-                {
-                    config.projLayerIndex = std::stoi(value);
-                }
-                else if (name == "aim_joint")
-                {
-                    config.aimJointIndex = std::stoi(value);
-                }
-                else if (name == "grip_joint")
-                {
-                    config.gripJointIndex = std::stoi(value);
-                }
-                else if (name == "custom1_joint1")
-                {
-                    config.custom1Joint1Index = std::stoi(value);
-                }
-                else if (name == "custom1_joint2")
-                {
-                    config.custom1Joint2Index = std::stoi(value);
-                }
-                else if (name == "click_threshold")
-                {
-                    config.clickThreshold = std::stof(value);
-                }
-                else if (side >= 0 && subName == "enabled")
-                {
-                    const bool boolValue = value == "1" || value == "true";
-                    if (side == 0)
-                    {
-                        config.leftHandEnabled = boolValue;
-                    }
-                    else
-                    {
-                        config.rightHandEnabled = boolValue;
-                    }
-                }
-                else if (side >= 0 && subName == "transform.vec")
-                {
-                    std::stringstream ss(value);
-                    std::string component;
-                    std::getline(ss, component, ' ');
-                    config.transform[side].position.x = std::stof(component);
-                    std::getline(ss, component, ' ');
-                    config.transform[side].position.y = std::stof(component);
-                    std::getline(ss, component, ' ');
-                    config.transform[side].position.z = std::stof(component);
-                }
-                else if (side >= 0 && subName == "transform.quat")
-                {
-                    std::stringstream ss(value);
-                    std::string component;
-                    std::getline(ss, component, ' ');
-                    config.transform[side].orientation.x = std::stof(component);
-                    std::getline(ss, component, ' ');
-                    config.transform[side].orientation.y = std::stof(component);
-                    std::getline(ss, component, ' ');
-                    config.transform[side].orientation.z = std::stof(component);
-                    std::getline(ss, component, ' ');
-                    config.transform[side].orientation.w = std::stof(component);
-                }
-                else if (side >= 0 && subName == "transform.euler")
-                {
-                    // For UI use only.
-                }
-#define PARSE_ACTION(configString, configName)                          \
-                        else if (side >= 0 && subName == configString)   \
-                        {                                               \
-                            config.configName##Action[side] = value;    \
-                        }                                               \
-                        else if (name == configString ".near")          \
-                        {                                               \
-                            config.configName##Near = std::stof(value); \
-                        }                                               \
-                        else if (name == configString ".far")           \
-                        {                                               \
-                            config.configName##Far = std::stof(value);  \
-                        }
+        PublishedHands published;
+        if (!publishedHands.Read(published, &seededSequence))
+        {
+            return;
+        }
 
-                PARSE_ACTION("pinch", pinch)
-                PARSE_ACTION("thumb_press", thumbPress)
-                PARSE_ACTION("index_bend", indexBend)
-                PARSE_ACTION("finger_gun", fingerGun)
-                PARSE_ACTION("squeeze", squeeze)
-                PARSE_ACTION("palm_tap", palmTap)
-                PARSE_ACTION("wrist_tap", wristTap)
-                PARSE_ACTION("index_tip_tap", indexTipTap)
-                PARSE_ACTION("custom1", custom1)
-
-#undef PARSE_ACTION
-                else
-                {
-                    Log("L%u: Unrecognized option\n", lineNumber);
-                }
-            }
-            else
+        for (int side = 0; side <= 1; side++)
+        {
+            if (published.hands[side].tracker != XR_NULL_HANDLE)
             {
-                Log("L%u: Improperly formatted option\n", lineNumber);
+                cache.Insert(published.hands[side]);
             }
         }
-        catch (...)
-        {
-            Log("L%u: Parsing error\n", lineNumber);
-        }
     }
 
-    // Load configuration for our layer.
-    bool LoadConfiguration(
-        const std::string configName)
+    // Get the cache of hand joints for the calling thread. Only the simulation thread uses the cache filled by
+    // xrSyncActions(). The render thread's cache is seeded by xrEndFrame() and kept for the frame, and any other thread
+    // gets a cache of its own, set up once per session and seeded with the hands published since its last call.
+    HandJointsCache& GetHandJointsCache()
     {
-        if (configName.empty())
+        const DWORD threadId = GetCurrentThreadId();
+        if (threadId == simulationThreadId.load(std::memory_order_relaxed))
         {
-            return false;
+            const uint64_t count = destroyedSpacesCount.load(std::memory_order_acquire);
+            if (count != simulationDestroyedSpacesCount)
+            {
+                handJointsCache.Clear();
+                simulationDestroyedSpacesCount = count;
+            }
+            return handJointsCache;
+        }
+        if (threadId == renderThreadId.load(std::memory_order_relaxed))
+        {
+            return renderHandJointsCache;
         }
 
-        std::ifstream configFile(std::filesystem::path(dllHome) / std::filesystem::path(configName + ".cfg"));
-        if (configFile.is_open())
+        struct ThreadHandJointsCache
         {
-            Log("Loading config for \"%s\"\n", configName.c_str());
+            HandJointsCache cache;
+            uint64_t sessionGeneration = 0;
+            uint32_t seededSequence = 0;
+        };
+        thread_local ThreadHandJointsCache threadCache;
+
+        const uint64_t generation = sessionGeneration.load(std::memory_order_acquire);
+        if (threadCache.sessionGeneration != generation)
+        {
+            threadCache.cache.SetLocateFunctions(xrLocateHandJointsEXT, xrLocateSpace);
+            threadCache.cache.SetReferenceSpace(referenceSpace);
+            threadCache.sessionGeneration = generation;
+            threadCache.seededSequence = 0;
+        }
+        SeedHandJointsCache(threadCache.cache, threadCache.seededSequence);
+        return threadCache.cache;
+    }
 
-            unsigned int lineNumber = 0;
-            std::string line;
-            while (std::getline(configFile, line))
+    // Re-express the published hands in the last projection layer space and compute the joints to render, ahead of
+    // xrEndFrame().
+    void RenderPreparationThread()
+    {
+        const HANDLE events[] = { renderPreparationStopEvent, renderPreparationEvent };
+        while (WaitForMultipleObjects((DWORD)std::size(events), events, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+        {
+            PublishedHands published;
+            if (!publishedHands.Read(published))
             {
-                lineNumber++;
-                ParseConfigurationStatement(line, lineNumber);
+                continue;
             }
-            configFile.close();
 
-            config.loaded = true;
+            // Only hold the lock to copy the space, so that xrEndFrame() and xrDestroySpace() never wait on the runtime.
+            XrSpace layerSpace;
+            uint64_t layerSpaceGeneration;
+            {
+                std::unique_lock lock(lastLayerSpaceMutex);
+                layerSpace = lastLayerSpace.load();
+                layerSpaceGeneration = lastLayerSpaceGeneration.load();
+            }
+            if (layerSpace == XR_NULL_HANDLE)
+            {
+                continue;
+            }
 
-            return true;
+            XrSpaceLocation location{ XR_TYPE_SPACE_LOCATION };
+            if (next_xrLocateSpace(referenceSpace, layerSpace, published.hands[0].time, &location) == XR_SUCCESS &&
+                xr::math::Pose::IsPoseValid(location) && layerSpaceGeneration == lastLayerSpaceGeneration.load())
+            {
+                const HandJointsSnapshot* const hands[2] = { &published.hands[0], &published.hands[1] };
+                handRenderer.PrepareJoints(hands, layerSpaceGeneration, location.pose);
+            }
         }
+    }
 
-        Log("Could not load config for \"%s\"\n", configName.c_str());
+    void StartRenderPreparation()
+    {
+        if (!renderPreparationEvent)
+        {
+            renderPreparationEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+            renderPreparationStopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        }
+        ResetEvent(renderPreparationStopEvent);
+        renderPreparationThread = std::thread(RenderPreparationThread);
+    }
 
-        return false;
+    void StopRenderPreparation()
+    {
+        if (renderPreparationThread.joinable())
+        {
+            SetEvent(renderPreparationStopEvent);
+            renderPreparationThread.join();
+        }
+        lastLayerSpace = XR_NULL_HANDLE;
+        lastLayerSpaceGeneration++;
     }
 
     XrResult HandToController_xrWaitFrame(
@@ -511,25 +2085,7 @@ namespace {
         XrFrameState* const frameState)
     {
         DebugLog("--> HandToController_xrWaitFrame\n");
-
-        // Arbitrarily choose this place to handle configuration input.
-        if (configSocket != INVALID_SOCKET)
-        {
-            struct sockaddr_in saddr;
-            while (true)
-            {
-                char buffer[100] = {};
-                int slen = sizeof(saddr);
-                const int len = recvfrom(configSocket, buffer, sizeof(buffer), 0, (struct sockaddr*)&saddr, &slen);
-                if (len <= 0)
-                {
-                    break;
-                }
-
-                std::string line(buffer);
-                ParseConfigurationStatement(line);
-            }
-        }
+        TRACK_FRAME_ALLOCATIONS("xrWaitFrame");
 
         // Call the chain to perform the actual operation.
         const XrResult result = next_xrWaitFrame(session, frameWaitInfo, frameState);
@@ -549,13 +2105,14 @@ namespace {
         const XrFrameBeginInfo* const frameBeginInfo)
     {
         DebugLog("--> HandToController_xrBeginFrame\n");
+        TRACK_FRAME_ALLOCATIONS("xrBeginFrame");
 
         // Call the chain to perform the actual operation.
         const XrResult result = next_xrBeginFrame(session, frameBeginInfo);
         if (result == XR_SUCCESS)
         {
             // Record the predicted display time, as we will need it to query hand poses in for xrSyncActions().
-            begunFrameTime = waitedFrameTime;
+            begunFrameTime.store(waitedFrameTime.load());
         }
 
         DebugLog("<-- HandToController_xrBeginFrame %d\n", result);
@@ -598,7 +2155,12 @@ namespace {
                 sessionId = *session;
                 needAdvertiseProfile = true;
 
-                if (config.displayEnabled)
+                // All hand joints are located in the reference space, then re-expressed in the other spaces.
+                handJointsCache.SetReferenceSpace(referenceSpace);
+                renderHandJointsCache.SetReferenceSpace(referenceSpace);
+                sessionGeneration++;
+
+                if (GetConfiguration()->displayEnabled)
                 {
                     // Get the D3D device so we can draw the hands.
                     const XrBaseInStructure* entry = reinterpret_cast<const XrBaseInStructure*>(createInfo->next);
@@ -610,6 +2172,7 @@ namespace {
                             const XrGraphicsBindingD3D11KHR* d3dBindings = reinterpret_cast<const XrGraphicsBindingD3D11KHR*>(entry);
                             d3d11Device = d3dBindings->device;
                             handRenderer.SetDevice(d3d11Device);
+                            isHandRendererErrorLogged = false;
                         }
                         else if (entry->type == XR_TYPE_GRAPHICS_BINDING_D3D12_KHR)
                         {
@@ -619,6 +2182,11 @@ namespace {
 
                         entry = entry->next;
                     }
+
+                    if (d3d11Device)
+                    {
+                        StartRenderPreparation();
+                    }
                 }
             }
         }
@@ -633,6 +2201,9 @@ namespace {
     {
         DebugLog("--> HandToController_xrDestroySession\n");
 
+        // The worker thread uses the session's spaces.
+        StopRenderPreparation();
+
         // Call the chain to perform the actual operation.
         const XrResult result = next_xrDestroySession(session);
         if (result == XR_SUCCESS)
@@ -654,9 +2225,31 @@ namespace {
                 handTracker[1] = XR_NULL_HANDLE;
             }
 
+            Log("Input injection: %llu key event(s) sent, %llu dropped, %llu rate-limited\n",
+                inputInjector.GetSentCount(), inputInjector.GetDroppedCount(), inputInjector.GetRateLimitedCount());
+            Log("Log: %llu message(s) written, %llu dropped, %llu suppressed\n",
+                logger.GetWrittenCount(), logger.GetDroppedCount(), logger.GetSuppressedCount());
+            Log("Hand joints cache: %llu hits, %llu misses, %llu hand locates, %llu space locates\n",
+                handJointsCache.GetHitCount(), handJointsCache.GetMissCount(),
+                handJointsCache.GetHandLocateCount(), handJointsCache.GetSpaceLocateCount());
+            Log("Prepared hand joints: %llu used, %llu missed\n", preparedJointsUsedCount, preparedJointsMissedCount);
+            Log("Render hand joints cache: %llu hits, %llu misses, %llu hand locates, %llu space locates, %llu read retries\n",
+                renderHandJointsCache.GetHitCount(), renderHandJointsCache.GetMissCount(),
+                renderHandJointsCache.GetHandLocateCount(), renderHandJointsCache.GetSpaceLocateCount(),
+                publishedHands.GetRetryCount());
+            handJointsCache.SetReferenceSpace(XR_NULL_HANDLE);
+            renderHandJointsCache.SetReferenceSpace(XR_NULL_HANDLE);
+            sessionGeneration++;
+#ifdef HAND_TO_CONTROLLER_TRACK_ALLOCATIONS
+            Log("Frame hooks made %llu heap allocation(s) after the first %llu frames\n", frameAllocationsCount, AllocationTracker::WarmupFrames);
+#endif
+
             // Destroy the graphics resources.
-            ownDsv.clear();
-            ownDepthBuffer.clear();
+            {
+                std::unique_lock lock(swapchainsMutex);
+                ownDsv.clear();
+                ownDepthBuffer.clear();
+            }
             handRenderer.SetDevice(nullptr);
             d3d11Device = nullptr;
 
@@ -679,33 +2272,31 @@ namespace {
         return buf;
     }
 
-    // Get the binding for a specific action/subaction path.
-    std::string GetXrActionFullPath(
+    // Get the slot of the binding for a specific action/subaction path, or -1 if the action is not bound to the hands.
+    int GetXrActionSlot(
+        const Bindings& bindingsSnapshot,
         XrAction action,
         XrPath subactionPath)
     {
-        std::string fullPath;
-        const auto actionPath = actionsMap.find(action);
-        if (actionPath != actionsMap.cend())
+        const auto bindings = bindingsSnapshot.actions.find(action);
+        if (bindings != bindingsSnapshot.actions.cend())
         {
             if (subactionPath != XR_NULL_PATH)
             {
-                std::string subPath = GetXrPath(subactionPath);
-                for (auto path : actionPath->second)
+                for (const auto& binding : bindings->second)
                 {
-                    if (path.find(subPath) == 0)
+                    if (handSubactionPath[binding.side] == subactionPath)
                     {
-                        fullPath = path;
-                        break;
+                        return binding.slot;
                     }
                 }
             }
             else
             {
-                fullPath = actionPath->second[0];
+                return bindings->second[0].slot;
             }
         }
-        return fullPath;
+        return -1;
     }
 
     XrResult HandToController_xrPollEvent(
@@ -713,6 +2304,7 @@ namespace {
         XrEventDataBuffer* const eventData)
     {
         DebugLog("--> HandToController_xrPollEvent\n");
+        TRACK_FRAME_ALLOCATIONS("xrPollEvent");
 
         XrResult result;
 
@@ -743,14 +2335,14 @@ namespace {
         XrInteractionProfileState* const interactionProfile)
     {
         DebugLog("--> HandToController_xrGetCurrentInteractionProfile\n");
+        TRACK_FRAME_ALLOCATIONS("xrGetCurrentInteractionProfile");
 
         XrResult result;
 
-        std::string path = topLevelUserPath != XR_NULL_PATH ? GetXrPath(topLevelUserPath) : "";
-        if (path.empty() || path == "/user/hand/left" || path == "/user/hand/right")
+        if (topLevelUserPath == XR_NULL_PATH || topLevelUserPath == handSubactionPath[0] || topLevelUserPath == handSubactionPath[1])
         {
             // Return our emulated interaction profile for the hands.
-            interactionProfile->interactionProfile = config.interactionProfile;
+            interactionProfile->interactionProfile = GetConfiguration()->interactionProfile;
             result = XR_SUCCESS;
         }
         else
@@ -778,23 +2370,20 @@ namespace {
             Log("Application is suggesting bindings for interaction profile: %s\n", interactionProfile.c_str());
 
             // Look for controller bindings.
-            if (interactionProfile == config.rawInteractionProfile)
+            if (interactionProfile == GetConfiguration()->rawInteractionProfile)
             {
-                for (unsigned int i = 0; i < suggestedBindings->countSuggestedBindings; i++)
-                {
-                    // Keep track of the XrAction for the controllers, so we can override the behavior for them.
-                    // TODO: Optimization: only store grip/aim and the actions actually bound by the config file.
-                    std::string fullPath = GetXrPath(suggestedBindings->suggestedBindings[i].binding);
-                    if (fullPath.find("/user/hand/right") == 0 || fullPath.find("/user/hand/left") == 0)
+                UpdateBindings([&](Bindings& bindings) {
+                    for (unsigned int i = 0; i < suggestedBindings->countSuggestedBindings; i++)
                     {
-                        auto actionPath = actionsMap.find(suggestedBindings->suggestedBindings[i].action);
-                        if (actionPath == actionsMap.cend())
+                        // Keep track of the XrAction for the controllers, so we can override the behavior for them.
+                        std::string fullPath = GetXrPath(suggestedBindings->suggestedBindings[i].binding);
+                        const bool isRight = fullPath.find("/user/hand/right") == 0;
+                        if (isRight || fullPath.find("/user/hand/left") == 0)
                         {
-                            actionPath = actionsMap.insert(std::make_pair(suggestedBindings->suggestedBindings[i].action, std::vector<std::string>())).first;
+                            bindings.actions[suggestedBindings->suggestedBindings[i].action].push_back({ isRight ? 1 : 0, InternActionPath(fullPath) });
                         }
-                        actionPath->second.push_back(fullPath);
                     }
-                }
+                });
 
                 Log("Binding to this interaction profile!\n");
             }
@@ -818,10 +2407,21 @@ namespace {
         {
             // Keep track of the XrSpace for controllers, so we can override the behavior for them.
             // TODO: Optimization: only store grip/aim.
-            const std::string fullPath = GetXrActionFullPath(createInfo->action, createInfo->subactionPath);
-            if (fullPath.find("/user/hand/right") == 0 || fullPath.find("/user/hand/left") == 0)
+            const int slot = GetXrActionSlot(GetBindings(), createInfo->action, createInfo->subactionPath);
+            if (slot >= 0)
             {
-                spacesMap.insert(std::make_pair(*space, std::make_pair(fullPath, createInfo->poseInActionSpace)));
+                const std::string& fullPath = actionSlotPaths[slot];
+
+                ActionSpace actionSpace;
+                actionSpace.side = fullPath.find("/user/hand/right") != std::string::npos ? 1 : 0;
+                actionSpace.isAim = fullPath.find("/input/aim/pose") != std::string::npos;
+                actionSpace.isGrip = fullPath.find("/input/grip/pose") != std::string::npos;
+                actionSpace.poseInActionSpace = createInfo->poseInActionSpace;
+
+                UpdateBindings([&](Bindings& bindings) {
+                    ResolveActionSpace(actionSpace, *GetConfiguration());
+                    bindings.spaces.insert_or_assign(*space, actionSpace);
+                });
             }
         }
 
@@ -835,12 +2435,34 @@ namespace {
     {
         DebugLog("--> HandToController_xrDestroySpace\n");
 
+        // Make sure the worker thread does not pick up the space again, and that the joints it might be preparing for
+        // it are discarded.
+        if (space == lastLayerSpace.load())
+        {
+            std::unique_lock lock(lastLayerSpaceMutex);
+            lastLayerSpace = XR_NULL_HANDLE;
+            lastLayerSpaceGeneration++;
+        }
+
         // Call the chain to perform the actual operation.
         const XrResult result = next_xrDestroySpace(space);
         if (result == XR_SUCCESS)
         {
             // Update our bookkeeping.
-            spacesMap.erase(space);
+            if (GetBindings().spaces.count(space))
+            {
+                UpdateBindings([&](Bindings& bindings) { bindings.spaces.erase(space); });
+            }
+            if (GetCurrentThreadId() == simulationThreadId.load(std::memory_order_relaxed))
+            {
+                handJointsCache.Invalidate(space);
+            }
+            else
+            {
+                destroyedSpacesCount.fetch_add(1, std::memory_order_release);
+            }
+
+            // The render thread's cache is cleared after each frame instead.
         }
 
         DebugLog("<-- HandToController_xrDestroySpace %d\n", result);
@@ -855,53 +2477,39 @@ namespace {
         XrSpaceLocation* const location)
     {
         DebugLog("--> HandToController_xrLocateSpace\n");
+        TRACK_FRAME_ALLOCATIONS("xrLocateSpace");
 
         bool located = false;
         XrResult result;
 
-        const auto actionSpace = spacesMap.find(space);
-        if (actionSpace != spacesMap.cend())
+        const Bindings& bindings = GetBindings();
+        const auto actionSpace = bindings.spaces.find(space);
+        if (actionSpace != bindings.spaces.cend() && actionSpace->second.isSimulated)
         {
             // Override tracking behavior for the hands.
-            const std::string fullPath = actionSpace->second.first;
-            const XrPosef transform = actionSpace->second.second;
-
-            const int side = fullPath.find("/user/hand/right") != std::string::npos ? 1 : 0;
-            const bool isAim = fullPath.find("/input/aim/pose") != std::string::npos;
-            const bool isGrip = fullPath.find("/input/grip/pose") != std::string::npos;
-
-            if (((side == 0 && config.leftHandEnabled) || (side == 1 && config.rightHandEnabled)) && (isGrip || isAim))
-            {
-
-                DebugLog("Simulating %s controller %s\n", side ? "right" : "left", isGrip ? "grip" : "aim");
-
-                // TODO: Compliance: need to perform validation of structs.
-
-                XrHandJointsLocateInfoEXT locateInfo{ XR_TYPE_HAND_JOINTS_LOCATE_INFO_EXT };
-                locateInfo.baseSpace = baseSpace;
-                locateInfo.time = time;
+            const ActionSpace& descriptor = actionSpace->second;
+            const int side = descriptor.side;
 
-                XrHandJointLocationEXT jointLocations[XR_HAND_JOINT_COUNT_EXT];
-                XrHandJointLocationsEXT locations{ XR_TYPE_HAND_JOINT_LOCATIONS_EXT };
-                locations.jointCount = XR_HAND_JOINT_COUNT_EXT;
-                locations.jointLocations = jointLocations;
+            DebugLog("Simulating %s controller %s\n", side ? "right" : "left", descriptor.isGrip ? "grip" : "aim");
 
-                // Translate the hand poses for the requested joint to a controller pose (XrActionSpace).
-                result = xrLocateHandJointsEXT(handTracker[side], &locateInfo, &locations);
-                if (result == XR_SUCCESS)
-                {
-                    const int joint = isGrip ? config.gripJointIndex : config.aimJointIndex;
-
-                    location->locationFlags = locations.jointLocations[joint].locationFlags;
-                    DebugLog("locationFlags %d\n", location->locationFlags);
-                    location->pose = Pose::Multiply(transform, Pose::Multiply(config.transform[side], locations.jointLocations[joint].pose));
-                    DebugLog("p %.3f %.3f %.3f o %.3f %.3f %.3f %.3f\n",
-                        location->pose.position.x, location->pose.position.y, location->pose.position.z,
-                        location->pose.orientation.x, location->pose.orientation.y, location->pose.orientation.z, location->pose.orientation.w);
-                }
+            // TODO: Compliance: need to perform validation of structs.
 
-                located = true;
+            // Translate the hand poses for the requested joint to a controller pose (XrActionSpace).
+            const HandJointsSnapshot& hand = GetHandJointsCache().Locate(handTracker[side], baseSpace, time);
+            result = hand.result;
+            if (result == XR_SUCCESS)
+            {
+                const XrHandJointLocationEXT& joint = hand.jointLocations[descriptor.joint];
+
+                location->locationFlags = joint.locationFlags;
+                DebugLog("locationFlags %d\n", location->locationFlags);
+                location->pose = Pose::Multiply(descriptor.transform, joint.pose);
+                DebugLog("p %.3f %.3f %.3f o %.3f %.3f %.3f %.3f\n",
+                    location->pose.position.x, location->pose.position.y, location->pose.position.z,
+                    location->pose.orientation.x, location->pose.orientation.y, location->pose.orientation.z, location->pose.orientation.w);
             }
+
+            located = true;
         }
 
         if (!located)
@@ -915,62 +2523,59 @@ namespace {
         return result;
     }
 
-    // Compute the scaled action value based on the distance between 2 joints.
-    float ComputeJointActionValue(
-        const XrHandJointLocationEXT jointLocations[2][XR_HAND_JOINT_COUNT_EXT],
-        const int side1,
-        const int joint1,
-        const int side2,
-        const int joint2,
-        const float nearDistance,
-        const float farDistance)
-    {
-        if (Pose::IsPoseValid(jointLocations[side1][joint1].locationFlags) &&
-            Pose::IsPoseValid(jointLocations[side2][joint2].locationFlags))
-        {
-            // We ignore joints radius and assume the near/far distance are configured to account for them.
-            const float distance = max(Length(jointLocations[side1][joint1].pose.position - jointLocations[side2][joint2].pose.position), 0.f);
-
-            return 1.f - (std::clamp(distance, nearDistance, farDistance) - nearDistance) / (farDistance - nearDistance);
-        }
-        return NAN;
-    }
-
     void RecordActionValue(
         const float value,
-        const std::string& path)
+        const ActionTarget& target)
     {
         // TODO: Robustness: do we need to debounce actions to avoid false-triggering?
 
-        DebugLog("Action %s -> %.3f\n", path.c_str(), value);
-        actionsState.insert_or_assign(path, value);
+        DebugLog("Action %s -> %.3f\n", actionSlotPaths[target.valueSlot].c_str(), value);
+        pendingActionsValue[target.valueSlot] = value;
 
-        // Create click from value for convenience (but not the other way around).
-        if (path.rfind("/value") != std::string::npos)
+        if (target.clickSlot >= 0)
         {
-            actionsState.insert_or_assign(path.substr(0, path.length() - 6) + "/click", value);
+            pendingActionsValue[target.clickSlot] = value;
         }
     }
 
-    // Compute an action state based on the distance between 2 joints.
-    void ComputeJointAction(
-        const XrHandJointLocationEXT jointLocations[2][XR_HAND_JOINT_COUNT_EXT],
-        const int side1,
-        const int joint1,
-        const int side2,
-        const int joint2,
-        const std::string& sidePath,
-        const std::string& actionPath,
-        const float nearDistance,
-        const float farDistance)
+    // Commit the values recorded by the gestures, and compute the change state for the boolean and float views of each
+    // action. Values are latched: an action keeps its value until a gesture records a new one.
+    void CommitActionsState(
+        const XrTime time)
     {
-        if (!actionPath.empty())
+        const int slotsCount = actionSlotsCount.load(std::memory_order_acquire);
+        for (int slot = 0; slot < slotsCount; slot++)
         {
-            const float value = ComputeJointActionValue(jointLocations, side1, joint1, side2, joint2, nearDistance, farDistance);
-            if (!isnan(value))
+            const float value = pendingActionsValue[slot];
+            if (isnan(value))
+            {
+                continue;
+            }
+
+            ActionState& actionState = actionsState[slot];
+            const bool booleanValue = value >= simulationConfig->clickThreshold;
+            if (actionState.hasValue)
+            {
+                actionState.changedSinceLastSync = value != actionState.value;
+                if (actionState.changedSinceLastSync)
+                {
+                    actionState.lastChangeTime = time;
+                }
+                actionState.booleanChangedSinceLastSync = booleanValue != actionState.booleanValue;
+                if (actionState.booleanChangedSinceLastSync)
+                {
+                    actionState.booleanLastChangeTime = time;
+                }
+            }
+            else
             {
-                RecordActionValue(value, sidePath + actionPath);
+                actionState.hasValue = true;
+                actionState.changedSinceLastSync = actionState.booleanChangedSinceLastSync = false;
+                actionState.lastChangeTime = actionState.booleanLastChangeTime = time;
             }
+            actionState.value = value;
+            actionState.booleanValue = booleanValue;
+            publishedActionsState[slot].Write(actionState);
         }
     }
 
@@ -979,6 +2584,7 @@ namespace {
         const XrActionsSyncInfo* const syncInfo)
     {
         DebugLog("--> HandToController_xrSyncActions\n");
+        TRACK_FRAME_ALLOCATIONS("xrSyncActions");
 
         // TODO: Compliance: we must handle XrActionSet.
 
@@ -986,127 +2592,58 @@ namespace {
         const XrResult result = next_xrSyncActions(session, syncInfo);
         if (result == XR_SUCCESS)
         {
-            // TODO: Optimization: add caching of the hand pose between this API and xrLocateSpace() above.
+            simulationThreadId.store(GetCurrentThreadId(), std::memory_order_relaxed);
+            const XrTime frameTime = begunFrameTime.load();
+
+            // Arbitrarily choose this place to pick up configuration updates.
+            RefreshSimulationConfiguration();
 
             // Latch gesture state for both hands.
             // We do this regardless of whether a hand is enabled or not, in order to still handle 2-handed gestures.
-            XrHandJointsLocateInfoEXT locateInfo{ XR_TYPE_HAND_JOINTS_LOCATE_INFO_EXT };
-            locateInfo.baseSpace = referenceSpace;
-            locateInfo.time = begunFrameTime;
-
-            XrHandJointLocationEXT jointLocations[2][XR_HAND_JOINT_COUNT_EXT];
-            XrResult handResult[2];
-
+            HandJointsCache& cache = GetHandJointsCache();
+            const HandJointsSnapshot* hands[2];
             for (int side = 0; side <= 1; side++)
             {
-                const std::string sidePath = side ? "/user/hand/right" : "/user/hand/left";
-
-                XrHandJointLocationsEXT locations{ XR_TYPE_HAND_JOINT_LOCATIONS_EXT };
-                locations.jointCount = XR_HAND_JOINT_COUNT_EXT;
-                locations.jointLocations = jointLocations[side];
-
-                handResult[side] = xrLocateHandJointsEXT(handTracker[side], &locateInfo, &locations);
-                if (handResult[side] != XR_SUCCESS)
+                hands[side] = &cache.Locate(handTracker[side], referenceSpace, frameTime);
+                if (hands[side]->result != XR_SUCCESS)
                 {
-                    Log("Failed to get hand pose: %d\n", handResult);
+                    Log("Failed to get hand pose: %d\n", hands[side]->result);
                 }
+            }
+            handFeatures.Update(hands);
+            PublishHands(hands);
 
-                for (int side = 0; side <= 1; side++)
+            for (int side = 0; side <= 1; side++)
+            {
+                // Disabled hands have an empty mask (see UpdateGestureDependencies()).
+                if (handFeatures.IsValid(side))
                 {
-                    // Skip actions for disabled hands.
-                    if ((side == 0 && !config.leftHandEnabled) || (side == 1 && !config.rightHandEnabled))
-                    {
-                        continue;
-                    }
-
-                    const std::string sidePath = side ? "/user/hand/right" : "/user/hand/left";
-                    const int other_side = side ? 0 : 1;
-
-                    if (handResult[side] == XR_SUCCESS)
-                    {
-                        // Handle gestures made up from one hand.
-
-#define ACTION_PARAMS(configName) config.configName##Action[side], config.configName##Near, config.configName##Far
-
-                        ComputeJointAction(jointLocations, side, XR_HAND_JOINT_THUMB_TIP_EXT, side, XR_HAND_JOINT_INDEX_TIP_EXT, sidePath, ACTION_PARAMS(pinch));
-                        ComputeJointAction(jointLocations, side, XR_HAND_JOINT_INDEX_INTERMEDIATE_EXT, side, XR_HAND_JOINT_THUMB_TIP_EXT, sidePath, ACTION_PARAMS(thumbPress));
-                        ComputeJointAction(jointLocations, side, XR_HAND_JOINT_INDEX_PROXIMAL_EXT, side, XR_HAND_JOINT_INDEX_TIP_EXT, sidePath, ACTION_PARAMS(indexBend));
-                        ComputeJointAction(jointLocations, side, XR_HAND_JOINT_THUMB_TIP_EXT, side, XR_HAND_JOINT_MIDDLE_INTERMEDIATE_EXT, sidePath, ACTION_PARAMS(fingerGun));
-                        if (config.custom1Joint1Index >= 0 && config.custom1Joint2Index >= 0)
-                        {
-                            ComputeJointAction(jointLocations, side, config.custom1Joint1Index, side, config.custom1Joint2Index, sidePath, ACTION_PARAMS(custom1));
-                        }
-
-                        if (!config.squeezeAction[side].empty())
-                        {
-                            // Squeeze requires to look at 3 fingers.
-                            float squeeze[3] = {
-                                ComputeJointActionValue(jointLocations, side, XR_HAND_JOINT_MIDDLE_TIP_EXT, side, XR_HAND_JOINT_MIDDLE_METACARPAL_EXT, config.squeezeNear, config.squeezeFar),
-                                ComputeJointActionValue(jointLocations, side, XR_HAND_JOINT_RING_TIP_EXT, side, XR_HAND_JOINT_RING_METACARPAL_EXT, config.squeezeNear, config.squeezeFar),
-                                ComputeJointActionValue(jointLocations, side, XR_HAND_JOINT_LITTLE_TIP_EXT, side, XR_HAND_JOINT_LITTLE_METACARPAL_EXT, config.squeezeNear, config.squeezeFar)
-                            };
-
-                            // Quickly bubble sort.
-                            if (squeeze[0] > squeeze[1])
-                            {
-                                std::swap(squeeze[0], squeeze[1]);
-                            }
-                            if (squeeze[0] > squeeze[2])
-                            {
-                                std::swap(squeeze[0], squeeze[2]);
-                            }
-                            if (squeeze[1] > squeeze[2])
-                            {
-                                std::swap(squeeze[1], squeeze[2]);
-                            }
-
-                            // Ignore the lowest value, average the other ones.
-                            const float value = (squeeze[1] + squeeze[2]) / 2.f;
-                            RecordActionValue(value, sidePath + config.squeezeAction[side]);
-                        }
-
-                        if (handResult[other_side] == XR_SUCCESS)
-                        {
-                            // Handle gestures made up using both hands.
-
-                            ComputeJointAction(jointLocations, side, XR_HAND_JOINT_PALM_EXT, other_side, XR_HAND_JOINT_INDEX_TIP_EXT, sidePath, ACTION_PARAMS(palmTap));
-                            ComputeJointAction(jointLocations, side, XR_HAND_JOINT_WRIST_EXT, other_side, XR_HAND_JOINT_INDEX_TIP_EXT, sidePath, ACTION_PARAMS(wristTap));
-                            ComputeJointAction(jointLocations, side, XR_HAND_JOINT_INDEX_TIP_EXT, other_side, XR_HAND_JOINT_INDEX_TIP_EXT, sidePath, ACTION_PARAMS(indexTipTap));
-                        }
-
-                        // TODO: Feature: add more gesture recognition here.
-#undef ACTION_PARAMS
-                    }
+                    gestureKernel[side](handFeatures, side, builtinGestures[side]);
+                    gestureProgram[side].Run(handFeatures, side, [](const float value, const int valueSlot, const int clickSlot) {
+                        RecordActionValue(value, { valueSlot, clickSlot });
+                    });
                 }
             }
 
-            // Special handling for Windows key.
-            for (int side = 0; side <= 1; side++)
+            CommitActionsState(frameTime);
+
+            // Hold the keys bound to the actions. The input is sent from another thread, and a transition that does not fit
+            // in the queue is pushed again with the next sync. The keys of the previous bindings are released first.
+            const auto& keyBindings = simulationConfig->keyBindings;
+            const bool canPushKeys = PushPendingKeyReleases();
+            for (size_t i = 0; canPushKeys && i < keyBindings.size(); i++)
             {
-                const std::string fullPath = std::string((side == 0 ? "/user/hand/left" : "/user/hand/right")) + "/input/system/click";
-                const auto stateVar = actionsState.find(fullPath);
-                if (stateVar != actionsState.cend())
+                const auto& binding = keyBindings[i];
+                if (binding.slot < 0)
                 {
-                    auto lastState = lastBooleanChange.find(fullPath);
-                    const bool value = stateVar->second >= config.clickThreshold;
-
-                    const bool didChange = lastState != lastBooleanChange.end() && value != lastState->second.first;
-                    if (lastState == lastBooleanChange.end() || didChange)
-                    {
-                        lastBooleanChange.insert_or_assign(fullPath, std::make_pair(value, begunFrameTime));
-                    }
+                    continue;
+                }
 
-                    if (didChange && value)
-                    {
-                        INPUT input[2];
-                        ZeroMemory(&input, sizeof(INPUT));
-                        input[0].type = INPUT_KEYBOARD;
-                        input[0].ki.wVk = VK_LWIN;
-                        input[1].type = INPUT_KEYBOARD;
-                        input[1].ki.wVk = VK_LWIN;
-                        input[1].ki.dwFlags = KEYEVENTF_KEYUP;
-                        SendInput(2, input, sizeof(INPUT));
-                    }
+                const ActionState& actionState = actionsState[binding.slot];
+                const bool isPressed = actionState.hasValue && actionState.booleanValue;
+                if (isPressed != isKeyPressed[i] && inputInjector.Push(binding.virtualKey, isPressed))
+                {
+                    isKeyPressed[i] = isPressed;
                 }
             }
         }
@@ -1116,45 +2653,41 @@ namespace {
         return result;
     }
 
+    // Start evaluating the gestures feeding an action upon its first query. The value becomes available after the next
+    // xrSyncActions(), which rebuilds the gesture evaluation on the simulation thread.
+    void MarkActionPolled(
+        const int slot)
+    {
+        if (!isActionPolled[slot].load(std::memory_order_relaxed) && !isActionPolled[slot].exchange(true, std::memory_order_relaxed))
+        {
+            polledActionsCount.fetch_add(1, std::memory_order_release);
+        }
+    }
+
     XrResult HandToController_xrGetActionStateBoolean(
         const XrSession session,
         const XrActionStateGetInfo* const getInfo,
         XrActionStateBoolean* const state)
     {
         DebugLog("--> HandToController_xrGetActionStateBoolean\n");
+        TRACK_FRAME_ALLOCATIONS("xrGetActionStateBoolean");
 
         bool handled = false;
         XrResult result;
 
         // Translate inputs for the controllers.
-        const std::string fullPath = GetXrActionFullPath(getInfo->action, getInfo->subactionPath);
-        if (!fullPath.empty())
+        const int slot = GetXrActionSlot(GetBindings(), getInfo->action, getInfo->subactionPath);
+        if (slot >= 0)
         {
-            const auto stateVar = actionsState.find(fullPath);
-            if (stateVar != actionsState.cend())
-            {
-                auto lastState = lastBooleanChange.find(fullPath);
-                const bool value = stateVar->second >= config.clickThreshold;
-
-                // TODO: Cleanliness: refactor common code with xrGetActionStateFloat() below.
-                if (lastState != lastBooleanChange.end())
-                {
-                    const bool lastValue = lastState->second.first;
-                    const XrTime lastChange = lastState->second.second;
+            MarkActionPolled(slot);
 
-                    // TODO: Compliance: this is technically incorrect, this value needs to be computed based on xrSyncActions() calls, not xrGetActionState*().
-                    state->changedSinceLastSync = (value != lastValue) ? XR_TRUE : XR_FALSE;
-                    state->lastChangeTime = (value != lastValue) ? begunFrameTime : lastChange;
-                }
-                else
-                {
-                    state->changedSinceLastSync = XR_FALSE;
-                    state->lastChangeTime = begunFrameTime;
-                }
+            ActionState actionState;
+            if (publishedActionsState[slot].Read(actionState) && actionState.hasValue)
+            {
                 state->isActive = XR_TRUE;
-                state->currentState = value ? XR_TRUE : XR_FALSE;
-
-                lastBooleanChange.insert_or_assign(fullPath, std::make_pair(value, state->lastChangeTime));
+                state->currentState = actionState.booleanValue ? XR_TRUE : XR_FALSE;
+                state->changedSinceLastSync = actionState.booleanChangedSinceLastSync ? XR_TRUE : XR_FALSE;
+                state->lastChangeTime = actionState.booleanLastChangeTime;
 
                 handled = true;
                 result = XR_SUCCESS;
@@ -1179,37 +2712,24 @@ namespace {
         XrActionStateFloat* const state)
     {
         DebugLog("--> HandToController_xrGetActionStateFloat\n");
+        TRACK_FRAME_ALLOCATIONS("xrGetActionStateFloat");
 
         bool handled = false;
         XrResult result;
 
         // Translate inputs for the controllers.
-        const std::string fullPath = GetXrActionFullPath(getInfo->action, getInfo->subactionPath);
-        if (!fullPath.empty())
+        const int slot = GetXrActionSlot(GetBindings(), getInfo->action, getInfo->subactionPath);
+        if (slot >= 0)
         {
-            const auto stateVar = actionsState.find(fullPath);
-            if (stateVar != actionsState.cend())
-            {
-                auto lastState = lastFloatChange.find(fullPath);
-                const float value = stateVar->second;
+            MarkActionPolled(slot);
 
-                if (lastState != lastFloatChange.end())
-                {
-                    const float lastValue = lastState->second.first;
-                    const XrTime lastChange = lastState->second.second;
-
-                    state->changedSinceLastSync = (value != lastValue) ? XR_TRUE : XR_FALSE;
-                    state->lastChangeTime = (value != lastValue) ? begunFrameTime : lastChange;
-                }
-                else
-                {
-                    state->changedSinceLastSync = XR_FALSE;
-                    state->lastChangeTime = begunFrameTime;
-                }
+            ActionState actionState;
+            if (publishedActionsState[slot].Read(actionState) && actionState.hasValue)
+            {
                 state->isActive = XR_TRUE;
-                state->currentState = value;
-
-                lastFloatChange.insert_or_assign(fullPath, std::make_pair(value, state->lastChangeTime));
+                state->currentState = actionState.value;
+                state->changedSinceLastSync = actionState.changedSinceLastSync ? XR_TRUE : XR_FALSE;
+                state->lastChangeTime = actionState.lastChangeTime;
 
                 handled = true;
                 result = XR_SUCCESS;
@@ -1233,11 +2753,11 @@ namespace {
         XrActionStatePose* const state)
     {
         DebugLog("--> HandToController_xrGetActionStatePose\n");
+        TRACK_FRAME_ALLOCATIONS("xrGetActionStatePose");
 
         XrResult result;
 
-        const std::string fullPath = GetXrActionFullPath(getInfo->action, getInfo->subactionPath);
-        if (!fullPath.empty())
+        if (GetXrActionSlot(GetBindings(), getInfo->action, getInfo->subactionPath) >= 0)
         {
             // Always make the hands active.
             state->isActive = XR_TRUE;
@@ -1274,6 +2794,7 @@ namespace {
             if (createInfo->arraySize <= 2 && createInfo->faceCount == 1)
             {
                 // We keep track of the swapchain info for when we intercept the textures in xrEnumerateSwapchainImages().
+                std::unique_lock lock(swapchainsMutex);
                 swapchainInfo.insert_or_assign(*swapchain, *createInfo);
             }
             else
@@ -1294,6 +2815,7 @@ namespace {
 
         // Call the chain to perform the actual operation.
         const XrResult result = next_xrDestroySwapchain(swapchain);
+        std::unique_lock lock(swapchainsMutex);
         if (result == XR_SUCCESS && IsSwapchainHandled(swapchain))
         {
             // Cleanup the resource views.
@@ -1366,6 +2888,7 @@ namespace {
 
         // Call the chain to perform the actual operation.
         const XrResult result = next_xrEnumerateSwapchainImages(swapchain, imageCapacityInput, imageCountOutput, images);
+        std::unique_lock lock(swapchainsMutex);
         if (result == XR_SUCCESS && IsSwapchainHandled(swapchain) && imageCapacityInput > 0)
         {
             XrSwapchainImageD3D11KHR* d3dImages = reinterpret_cast<XrSwapchainImageD3D11KHR*>(images);
@@ -1412,9 +2935,11 @@ namespace {
         uint32_t* const index)
     {
         DebugLog("--> HandToController_xrAcquireSwapchainImage\n");
+        TRACK_FRAME_ALLOCATIONS("xrAcquireSwapchainImage");
 
         // Call the chain to perform the actual operation.
         const XrResult result = next_xrAcquireSwapchainImage(swapchain, acquireInfo, index);
+        std::unique_lock lock(swapchainsMutex);
         if (result == XR_SUCCESS && IsSwapchainHandled(swapchain))
         {
             // Keep track of the current texture index.
@@ -1431,15 +2956,31 @@ namespace {
         const XrFrameEndInfo* const frameEndInfo)
     {
         DebugLog("--> HandToController_xrEndFrame\n");
+        TRACK_FRAME_ALLOCATIONS("xrEndFrame");
+
+        // The snapshot remains the same until the submission is done, even if a new one is published meanwhile.
+        const Config& displayConfig = *GetConfiguration();
+
+        renderThreadId.store(GetCurrentThreadId(), std::memory_order_relaxed);
+
+        // The renderer is initialized asynchronously, report any failure once it is known.
+        if (!isHandRendererErrorLogged)
+        {
+            if (const char* const error = handRenderer.GetInitializationError())
+            {
+                Log("Failed to initialize the hands rendering: %s\n", error);
+                isHandRendererErrorLogged = true;
+            }
+        }
+        const XrTime frameTime = begunFrameTime.load();
 
-        std::vector<const XrCompositionLayerBaseHeader*> layers(frameEndInfo->layerCount);
         int projLayerIndex = 0;
-        for (uint32_t i = 0; config.displayEnabled && i < frameEndInfo->layerCount; i++)
+        for (uint32_t i = 0; displayConfig.displayEnabled && i < frameEndInfo->layerCount; i++)
         {
             // Render the hands in the desired projection layer.
             if (frameEndInfo->layers[i]->type == XR_TYPE_COMPOSITION_LAYER_PROJECTION)
             {
-                if (projLayerIndex++ != config.projLayerIndex)
+                if (projLayerIndex++ != displayConfig.projLayerIndex)
                 {
                     continue;
                 }
@@ -1453,15 +2994,18 @@ namespace {
 
                 // TODO: Compliance: can't really figure out the correct logic for imageArrayIndex... For now always assume left==0 and right==0 (non-VPRT) or 1 (VPRT)
 
-                if (!IsSwapchainHandled(colorSwapchain[0]) || !IsSwapchainHandled(colorSwapchain[1]))
                 {
-                    break;
+                    std::unique_lock lock(swapchainsMutex);
+                    if (!IsSwapchainHandled(colorSwapchain[0]) || !IsSwapchainHandled(colorSwapchain[1]))
+                    {
+                        break;
+                    }
                 }
 
                 // Search for the depth buffers.
                 XrSwapchain depthSwapchain[2] = { XR_NULL_HANDLE, XR_NULL_HANDLE };
                 float depthNear = 0.001f, depthFar = 100.0f;
-                for (uint32_t j = 0; !config.useOwnDepthBuffer && j < proj->viewCount; j++)
+                for (uint32_t j = 0; !displayConfig.useOwnDepthBuffer && j < proj->viewCount; j++)
                 {
                     const auto view = proj->views[j];
                     const XrBaseInStructure* entry = reinterpret_cast<const XrBaseInStructure*>(view.next);
@@ -1483,24 +3027,34 @@ namespace {
                     }
                 }
 
-                // Get the hand joints poses.
-                // TODO: Optimization: add caching of the hand pose between this API and xrSyncActions() above.
-                XrHandJointsLocateInfoEXT locateInfo{ XR_TYPE_HAND_JOINTS_LOCATE_INFO_EXT };
-                locateInfo.baseSpace = proj->space;
-                locateInfo.time = begunFrameTime;
-
-                XrHandJointLocationEXT jointLocations[2][XR_HAND_JOINT_COUNT_EXT];
-                XrResult handResult[2];
-                for (int side = 0; side <= 1; side++)
+                // Get the hand joints poses, preferably prepared ahead by the worker thread. Otherwise locate them now.
+                if (proj->space != lastLayerSpace.load())
                 {
-                    XrHandJointLocationsEXT locations{ XR_TYPE_HAND_JOINT_LOCATIONS_EXT };
-                    locations.jointCount = XR_HAND_JOINT_COUNT_EXT;
-                    locations.jointLocations = jointLocations[side];
-
-                    handResult[side] = xrLocateHandJointsEXT(handTracker[side], &locateInfo, &locations);
+                    std::unique_lock lock(lastLayerSpaceMutex);
+                    lastLayerSpace = proj->space;
+                    lastLayerSpaceGeneration++;
+                }
+                if (handRenderer.UsePreparedJoints(lastLayerSpaceGeneration.load(), frameTime))
+                {
+                    preparedJointsUsedCount++;
+                }
+                else
+                {
+                    HandJointsCache& cache = GetHandJointsCache();
+                    if (&cache == &renderHandJointsCache)
+                    {
+                        SeedHandJointsCache(renderHandJointsCache, renderHandJointsSequence);
+                    }
+                    const HandJointsSnapshot* const hands[2] = {
+                        &cache.Locate(handTracker[0], proj->space, frameTime),
+                        &cache.Locate(handTracker[1], proj->space, frameTime),
+                    };
+                    handRenderer.SetJointsLocations(hands);
+                    preparedJointsMissedCount++;
                 }
 
                 // Render the hands.
+                std::unique_lock swapchainsLock(swapchainsMutex);
                 const XrSwapchain& leftColorSwapchain = colorSwapchain[0];
                 const XrSwapchain& rightColorSwapchain = colorSwapchain[1];
                 ID3D11RenderTargetView* const rtv[2] = {
@@ -1521,14 +3075,15 @@ namespace {
                     IsSwapchainHandled(rightDepthSwapchain) ?
                         swapchainResources[rightDepthSwapchain][swapchainIndices[rightDepthSwapchain]].dsv : ownDsv[leftColorSwapchain].Get(), /* Intentionally uses the same own depth buffer for rendering */
                 };
+                swapchainsLock.unlock();
 
                 const XrPosef eyePoses[2] = { proj->views[0].pose, proj->views[1].pose };
                 const XrFovf fovs[2] = { proj->views[0].fov, proj->views[1].fov };
 
                 const bool isVPRT = leftColorSwapchain == rightColorSwapchain;
-                handRenderer.SetProperties(config.skinTone, config.opacity);
+                handRenderer.SetIsolation(static_cast<HandRenderer::Isolation>(displayConfig.renderIsolation));
+                handRenderer.SetProperties(displayConfig.skinTone, displayConfig.opacity);
                 handRenderer.SetEyePoses(eyePoses, fovs);
-                handRenderer.SetJointsLocations(handResult, jointLocations);
                 handRenderer.RenderHands(
                     rtv, dsv, proj->views[0].subImage.imageRect,
                     isVPRT,
@@ -1542,12 +3097,62 @@ namespace {
         // Call the chain to perform the actual submission.
         const XrResult result = next_xrEndFrame(session, frameEndInfo);
 
+        // Only keep the render thread's snapshots for the duration of a frame.
+        renderHandJointsCache.Clear();
+        renderHandJointsSequence = 0;
+
+#ifdef HAND_TO_CONTROLLER_TRACK_ALLOCATIONS
+        framesCount++;
+#endif
+
         DebugLog("<-- HandToController_xrEndFrame %d\n", result);
 
         return result;
     }
 
     // Entry point for OpenXR calls.
+    XrResult HandToController_xrDestroyInstance(
+        const XrInstance instance)
+    {
+        DebugLog("--> HandToController_xrDestroyInstance\n");
+
+        // Stop the configuration thread before our DLL gets unloaded.
+        if (configThread.joinable())
+        {
+            SetEvent(configThreadStopEvent);
+            configThread.join();
+        }
+
+        // Release any key still held.
+        inputInjector.Stop();
+
+        const XrResult result = next_xrDestroyInstance(instance);
+
+        DebugLog("<-- HandToController_xrDestroyInstance %d\n", result);
+
+        // Flush the log. It is restarted with the next instance.
+        logger.Stop();
+
+        return result;
+    }
+
+    struct InterceptedCall
+    {
+        // Store the next function pointer.
+        void (*setNext)(PFN_xrVoidFunction function);
+        PFN_xrVoidFunction hook;
+        bool requiresConfig;
+    };
+
+#define INTERCEPTED_CALL(xrCall, requiresConfig)                                                        \
+    { [](PFN_xrVoidFunction function) { next_##xrCall = reinterpret_cast<PFN_##xrCall>(function); },    \
+      reinterpret_cast<PFN_xrVoidFunction>(HandToController_##xrCall), requiresConfig },
+
+    // In the order of InterceptedCallNames.
+    const InterceptedCall InterceptedCalls[] = { INTERCEPTED_CALLS(INTERCEPTED_CALL) };
+
+#undef INTERCEPTED_CALL
+
     XrResult HandToController_xrGetInstanceProcAddr(
         const XrInstance instance,
         const char* const name,
@@ -1557,38 +3162,15 @@ namespace {
 
         // Call the chain to resolve the next function pointer.
         const XrResult result = next_xrGetInstanceProcAddr(instance, name, function);
-        if (config.loaded && result == XR_SUCCESS)
+        if (result == XR_SUCCESS)
         {
-            const std::string apiName(name);
-
             // Intercept the calls handled by our layer.
-#define INTERCEPT_CALL(xrCall)                                                                  \
-            if (apiName == STRINGIFY(xrCall)) {                                                 \
-                next_##xrCall = reinterpret_cast<PFN_##xrCall>(*function);                      \
-                *function = reinterpret_cast<PFN_xrVoidFunction>(HandToController_##xrCall);    \
-            }
-
-            INTERCEPT_CALL(xrWaitFrame);
-            INTERCEPT_CALL(xrBeginFrame);
-            INTERCEPT_CALL(xrCreateSession);
-            INTERCEPT_CALL(xrDestroySession);
-            INTERCEPT_CALL(xrPollEvent);
-            INTERCEPT_CALL(xrGetCurrentInteractionProfile);
-            INTERCEPT_CALL(xrSuggestInteractionProfileBindings);
-            INTERCEPT_CALL(xrCreateActionSpace);
-            INTERCEPT_CALL(xrDestroySpace);
-            INTERCEPT_CALL(xrLocateSpace);
-            INTERCEPT_CALL(xrSyncActions);
-            INTERCEPT_CALL(xrGetActionStateBoolean);
-            INTERCEPT_CALL(xrGetActionStateFloat);
-            INTERCEPT_CALL(xrGetActionStatePose);
-            INTERCEPT_CALL(xrCreateSwapchain);
-            INTERCEPT_CALL(xrDestroySwapchain);
-            INTERCEPT_CALL(xrEnumerateSwapchainImages);
-            INTERCEPT_CALL(xrAcquireSwapchainImage);
-            INTERCEPT_CALL(xrEndFrame);
-
-#undef INTERCEPT_CALL
+            const int index = FindInterceptedCall(name);
+            if (index >= 0 && (IsConfigurationLoaded() || !InterceptedCalls[index].requiresConfig))
+            {
+                InterceptedCalls[index].setNext(*function);
+                *function = InterceptedCalls[index].hook;
+            }
 
             // Leave all unhandled calls to the next layer.
         }
@@ -1598,6 +3180,149 @@ namespace {
         return result;
     }
 
+
+    // Measure the phases of the instance creation, and log them all at once.
+    class StartupTimer
+    {
+    public:
+        StartupTimer()
+        {
+            QueryPerformanceFrequency(&m_frequency);
+            QueryPerformanceCounter(&m_start);
+            m_last = m_start;
+        }
+
+        // End the current phase.
+        void Phase(const char* name)
+        {
+            LARGE_INTEGER now;
+            QueryPerformanceCounter(&now);
+            if (m_phasesCount < MaxPhases)
+            {
+                m_phases[m_phasesCount++] = { name, ToMilliseconds(now.QuadPart - m_last.QuadPart) };
+            }
+            m_last = now;
+        }
+
+        void Dump() const
+        {
+            std::string phases;
+            for (uint32_t i = 0; i < m_phasesCount; i++)
+            {
+                char buf[128];
+                snprintf(buf, sizeof(buf), "%s%s %.1f ms", i ? ", " : "", m_phases[i].name, m_phases[i].milliseconds);
+                phases += buf;
+            }
+            Log("Startup: %s (total %.1f ms)\n", phases.c_str(), ToMilliseconds(m_last.QuadPart - m_start.QuadPart));
+        }
+
+    private:
+        static constexpr uint32_t MaxPhases = 8;
+
+        double ToMilliseconds(LONGLONG ticks) const
+        {
+            return ticks * 1000.0 / m_frequency.QuadPart;
+        }
+
+        LARGE_INTEGER m_frequency;
+        LARGE_INTEGER m_start;
+        LARGE_INTEGER m_last;
+
+        struct
+        {
+            const char* name;
+            double milliseconds;
+        } m_phases[MaxPhases];
+        uint32_t m_phasesCount{ 0 };
+    };
+
+    // Look for an extension in the list returned by xrEnumerateInstanceExtensionProperties().
+    XrResult FindInstanceExtension(
+        const PFN_xrEnumerateInstanceExtensionProperties enumerateInstanceExtensionProperties,
+        const std::string& name,
+        bool& found)
+    {
+        found = false;
+
+        uint32_t extensionsCount = 0;
+        XrResult result = enumerateInstanceExtensionProperties(nullptr, 0, &extensionsCount, nullptr);
+        if (result != XR_SUCCESS)
+        {
+            return result;
+        }
+        std::vector<XrExtensionProperties> extensions(extensionsCount, { XR_TYPE_EXTENSION_PROPERTIES });
+        result = enumerateInstanceExtensionProperties(nullptr, extensionsCount, &extensionsCount, extensions.data());
+        if (result != XR_SUCCESS)
+        {
+            return result;
+        }
+
+        for (uint32_t i = 0; i < extensionsCount; i++)
+        {
+            if (name == extensions[i].extensionName)
+            {
+                found = true;
+                break;
+            }
+        }
+
+        return XR_SUCCESS;
+    }
+
+    // Check that an extension is supported by the runtime and/or an upstream API layer.
+    //
+    // xrEnumerateInstanceExtensionProperties() does not need an instance, and the next xrGetInstanceProcAddr() must
+    // resolve it for XR_NULL_HANDLE. Some older layers and runtimes only resolve it for an instance they created though:
+    // for those, we fall back to creating a bootstrap instance, which brings the runtime up one more time.
+    bool IsInstanceExtensionSupported(
+        const XrInstanceCreateInfo* const instanceCreateInfo,
+        const struct XrApiLayerCreateInfo* const apiLayerInfo,
+        const std::string& name,
+        StartupTimer& timer)
+    {
+        bool found = false;
+
+        PFN_xrEnumerateInstanceExtensionProperties next_xrEnumerateInstanceExtensionProperties = nullptr;
+        if (next_xrGetInstanceProcAddr(XR_NULL_HANDLE, "xrEnumerateInstanceExtensionProperties", reinterpret_cast<PFN_xrVoidFunction*>(&next_xrEnumerateInstanceExtensionProperties)) == XR_SUCCESS &&
+            next_xrEnumerateInstanceExtensionProperties &&
+            FindInstanceExtension(next_xrEnumerateInstanceExtensionProperties, name, found) == XR_SUCCESS)
+        {
+            timer.Phase("extensions");
+            return found;
+        }
+
+        Log("Cannot query the extensions without an instance, using a bootstrap instance\n");
+
+        // Call the chain to create the bootstrap instance.
+        XrInstance bootstrapInstance = XR_NULL_HANDLE;
+        XrApiLayerCreateInfo chainApiLayerInfo = *apiLayerInfo;
+        chainApiLayerInfo.nextInfo = apiLayerInfo->nextInfo->next;
+        const XrResult result = apiLayerInfo->nextInfo->nextCreateApiLayerInstance(instanceCreateInfo, &chainApiLayerInfo, &bootstrapInstance);
+        if (result == XR_SUCCESS)
+        {
+            next_xrEnumerateInstanceExtensionProperties = nullptr;
+            next_xrGetInstanceProcAddr(bootstrapInstance, "xrEnumerateInstanceExtensionProperties", reinterpret_cast<PFN_xrVoidFunction*>(&next_xrEnumerateInstanceExtensionProperties));
+            if (next_xrEnumerateInstanceExtensionProperties)
+            {
+                FindInstanceExtension(next_xrEnumerateInstanceExtensionProperties, name, found);
+            }
+
+            PFN_xrDestroyInstance next_xrDestroyInstance = nullptr;
+            next_xrGetInstanceProcAddr(bootstrapInstance, "xrDestroyInstance", reinterpret_cast<PFN_xrVoidFunction*>(&next_xrDestroyInstance));
+            if (next_xrDestroyInstance)
+            {
+                next_xrDestroyInstance(bootstrapInstance);
+            }
+        }
+        else
+        {
+            Log("Failed to create bootstrap instance: %d\n", result);
+        }
+
+        timer.Phase("extensions (bootstrap instance)");
+        return found;
+    }
+
     // Entry point for creating the layer.
     XrResult HandToController_xrCreateApiLayerInstance(
         const XrInstanceCreateInfo* const instanceCreateInfo,
@@ -1625,41 +3350,9 @@ namespace {
         // Store the next xrGetInstanceProcAddr to resolve the functions not handled by our layer.
         next_xrGetInstanceProcAddr = apiLayerInfo->nextInfo->nextGetInstanceProcAddr;
 
-        // Check that the XR_EXT_hand_tracking extension is supported by the runtime and/or an upstream API layer.
-        // But first, we need to create a dummy instance in order to be able to perform these checks.
-        XrInstance dummyInstance = XR_NULL_HANDLE;
-        PFN_xrEnumerateInstanceExtensionProperties next_xrEnumerateInstanceExtensionProperties = nullptr;
-        {
-            // Call the chain to create the dummy instance.
-            XrApiLayerCreateInfo chainApiLayerInfo = *apiLayerInfo;
-            chainApiLayerInfo.nextInfo = apiLayerInfo->nextInfo->next;
-            const XrResult result = apiLayerInfo->nextInfo->nextCreateApiLayerInstance(instanceCreateInfo, &chainApiLayerInfo, &dummyInstance);
-            if (result == XR_SUCCESS)
-            {
-                next_xrGetInstanceProcAddr(dummyInstance, "xrEnumerateInstanceExtensionProperties", reinterpret_cast<PFN_xrVoidFunction*>(&next_xrEnumerateInstanceExtensionProperties));
-            }
-            else
-            {
-                Log("Failed to create bootstrap instance: %d\n", result);
-            }
-        }
-
-        bool hasHandTrackingExt = false;
-        if (next_xrEnumerateInstanceExtensionProperties)
-        {
-            uint32_t extensionsCount = 0;
-            next_xrEnumerateInstanceExtensionProperties(nullptr, 0, &extensionsCount, nullptr);
-            std::vector<XrExtensionProperties> extensions(extensionsCount, { XR_TYPE_EXTENSION_PROPERTIES });
-            next_xrEnumerateInstanceExtensionProperties(nullptr, extensionsCount, &extensionsCount, extensions.data());
-            for (auto extension : extensions) {
-                const std::string extensionName(extension.extensionName);
+        StartupTimer timer;
 
-                if (extensionName == "XR_EXT_hand_tracking")
-                {
-                    hasHandTrackingExt = true;
-                }
-            }
-        }
+        const bool hasHandTrackingExt = IsInstanceExtensionSupported(instanceCreateInfo, apiLayerInfo, "XR_EXT_hand_tracking", timer);
 
         // Request the XR_EXT_hand_tracking extension.
         XrInstanceCreateInfo chainInstanceCreateInfo = *instanceCreateInfo;
@@ -1676,13 +3369,6 @@ namespace {
             Log("XR_EXT_hand_tracking is not available from the OpenXR runtime or any upsteam API layer.\n");
         }
 
-        // Destroy the dummy instance.
-        {
-            PFN_xrDestroyInstance next_xrDestroyInstance = nullptr;
-            next_xrGetInstanceProcAddr(dummyInstance, "xrDestroyInstance", reinterpret_cast<PFN_xrVoidFunction*>(&next_xrDestroyInstance));
-            next_xrDestroyInstance(dummyInstance);
-        }
-
         // Call the chain to create the instance we actually want.
         XrApiLayerCreateInfo chainApiLayerInfo = *apiLayerInfo;
         chainApiLayerInfo.nextInfo = apiLayerInfo->nextInfo->next;
@@ -1691,16 +3377,37 @@ namespace {
         {
             delete[] chainInstanceCreateInfo.enabledExtensionNames;
         }
+        timer.Phase("instance");
 
         if (result == XR_SUCCESS)
         {
             instanceId = *instance;
 
-            config.Reset();
-
-            actionsMap.clear();
-            spacesMap.clear();
-            actionsState.clear();
+            logger.Start();
+
+            // The configuration thread of the previous instance is stopped by now.
+            std::atomic_store(&publishedConfig, std::shared_ptr<const Config>());
+            configGeneration++;
+            simulationConfig.reset();
+            isKeyPressed.clear();
+            pendingKeyReleases.clear();
+
+            UpdateBindings([](Bindings& bindings) { bindings = Bindings(); });
+            actionPathSlots.clear();
+            actionSlotPaths.assign(MaxActionSlots, std::string());
+            actionSlotsCount = 0;
+            pendingActionsValue.assign(MaxActionSlots, NAN);
+            for (auto& isPolled : isActionPolled)
+            {
+                isPolled = false;
+            }
+            polledActionsCount = 0;
+            simulationPolledActionsCount = 0;
+            actionsState.assign(MaxActionSlots, ActionState{});
+            for (auto& actionState : publishedActionsState)
+            {
+                actionState.Write(ActionState{});
+            }
 
             // Check that the system supports hand tracking. Note that if hasHandTrackingExt is false this is a no-op.
             // TODO: Robustness: implement proper error handling.
@@ -1735,6 +3442,7 @@ namespace {
             }
             else
             {
+
                 PFN_xrGetInstanceProperties xrGetInstanceProperties;
                 XrInstanceProperties instanceProperties = { XR_TYPE_INSTANCE_PROPERTIES };
                 if (next_xrGetInstanceProcAddr(*instance, "xrGetInstanceProperties", reinterpret_cast<PFN_xrVoidFunction*>(&xrGetInstanceProperties)) == XR_SUCCESS &&
@@ -1748,17 +3456,40 @@ namespace {
                 // Resolve additional symbols.
                 // TODO: Robustness: implement proper error handling.
                 next_xrGetInstanceProcAddr(*instance, "xrCreateReferenceSpace", reinterpret_cast<PFN_xrVoidFunction*>(&xrCreateReferenceSpace));
+                next_xrGetInstanceProcAddr(*instance, "xrLocateSpace", reinterpret_cast<PFN_xrVoidFunction*>(&xrLocateSpace));
                 next_xrGetInstanceProcAddr(*instance, "xrPathToString", reinterpret_cast<PFN_xrVoidFunction*>(&xrPathToString));
                 next_xrGetInstanceProcAddr(*instance, "xrStringToPath", reinterpret_cast<PFN_xrVoidFunction*>(&xrStringToPath));
 
+                handJointsCache.SetLocateFunctions(xrLocateHandJointsEXT, xrLocateSpace);
+                renderHandJointsCache.SetLocateFunctions(xrLocateHandJointsEXT, xrLocateSpace);
+                timer.Phase("system");
+
                 // Identify the application and load our configuration. Try by application first, then fallback to engines otherwise.
-                if (!LoadConfiguration(instanceCreateInfo->applicationInfo.applicationName)) {
-                    LoadConfiguration(instanceCreateInfo->applicationInfo.engineName);
+                profileStore.Open(std::filesystem::path(getenv("LOCALAPPDATA")) / std::filesystem::path(LayerName + ".profiles"),
+                    dllHome, CompiledConfigurationVersion, CompileConfiguration);
+                auto snapshot = std::make_unique<Config>();
+                snapshot->Reset();
+                if (!LoadConfiguration(*snapshot, instanceCreateInfo->applicationInfo.applicationName)) {
+                    LoadConfiguration(*snapshot, instanceCreateInfo->applicationInfo.engineName);
                 }
-                config.Dump();
+                snapshot->Dump();
+                const bool isLoaded = snapshot->loaded;
 
                 // TODO: Robustness: implement proper error handling.
-                xrStringToPath(*instance, config.rawInteractionProfile.c_str(), &config.interactionProfile);
+                xrStringToPath(*instance, snapshot->rawInteractionProfile.c_str(), &snapshot->interactionProfile);
+                xrStringToPath(*instance, "/user/hand/left", &handSubactionPath[0]);
+                xrStringToPath(*instance, "/user/hand/right", &handSubactionPath[1]);
+
+                if (!PublishConfiguration(std::move(snapshot)))
+                {
+                    // Keep the layer enabled for the application, with the default options.
+                    auto defaults = std::make_unique<Config>();
+                    defaults->Reset();
+                    defaults->loaded = isLoaded;
+                    xrStringToPath(*instance, defaults->rawInteractionProfile.c_str(), &defaults->interactionProfile);
+                    PublishConfiguration(std::move(defaults));
+                }
+                timer.Phase("configuration");
 
                 // Prepare the config socket.
                 if (configSocket == INVALID_SOCKET)
@@ -1781,11 +3512,50 @@ namespace {
                     if (configSocket == INVALID_SOCKET || bind(configSocket, (const struct sockaddr*)&saddr, sizeof(saddr)))
                     {
                         Log("Failed to create or bind configuration socket\n");
+                        if (configSocket != INVALID_SOCKET)
+                        {
+                            closesocket(configSocket);
+                            configSocket = INVALID_SOCKET;
+                        }
+                    }
+                }
+
+                // Prepare the control block.
+                if (!controlChannel.IsOpen())
+                {
+                    if (controlChannel.Open())
+                    {
+                        Log("Control block is open for process %u\n", GetCurrentProcessId());
+                    }
+                    else
+                    {
+                        Log("Failed to create control block\n");
+                    }
+                }
+
+                // Receive the configuration updates in the background. The thread is stopped in xrDestroyInstance().
+                if (isLoaded && (configSocket != INVALID_SOCKET || controlChannel.IsOpen()) && !configThread.joinable())
+                {
+                    if (!configThreadStopEvent)
+                    {
+                        configThreadStopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
                     }
+                    ResetEvent(configThreadStopEvent);
+                    configThread = std::thread(ConfigurationThread);
+                }
+
+                // Inject the keyboard input in the background. The thread is stopped in xrDestroyInstance().
+                if (isLoaded)
+                {
+                    inputInjector.Start(&sendInputSink);
                 }
+                timer.Phase("updates");
             }
         }
 
+
+        timer.Dump();
+
         DebugLog("<-- HandToController_xrCreateApiLayerInstance %d\n", result);
 
         return result;
@@ -1821,11 +3591,14 @@ extern "C" {
         }
 
         // Start logging to file.
-        if (!logStream.is_open())
+        if (!logger.IsOpen())
         {
             std::string logFile = (std::filesystem::path(getenv("LOCALAPPDATA")) / std::filesystem::path(LayerName + ".log")).string();
-            logStream.open(logFile, std::ios_base::ate);
+            logger.Open(logFile);
             Log("dllHome is \"%s\"\n", dllHome.c_str());
+
+            // Describe our options for the external tools.
+            ExportConfigurationSchema(std::filesystem::path(getenv("LOCALAPPDATA")) / std::filesystem::path(LayerName + ".schema.json"));
         }
 
         DebugLog("--> HandToController_xrNegotiateLoaderApiLayerInterface\n");
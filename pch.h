@@ -8,13 +8,25 @@
 #define PCH_H
 
 // Standard library.
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cfloat>
 #include <cstdarg>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <fstream>
+#include <functional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 // Windows header files.
@@ -27,6 +39,7 @@
 
 // D3D
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <d3dcompiler.h>
 
 // OpenXR + Windows-specific definitions.